@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Aggregat.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <fcntl.h> /* für open */
+#include <stdio.h> /* für Fehlermeldungen */
+#include <stdlib.h> /* für Rückgabewerte */
+#include <unistd.h> /* für pwrite und close */
+
+uint32_t const aggregatdauer[AGGREGAT_STUFEN] = { AGGREGAT_FENSTER };
+char const *const aggregatnamen[AGGREGAT_FELDER] = { "Ppv", "Pbat", "Phaus", "Pnetz", "Pext", "Pwall", "Ppvwall", "Pdc1", "Pdc2", "Pdc3" };
+
+size_t AggregatErstes(uint_fast8_t const stufe)
+{
+    size_t erstes = 0;
+    for (uint_fast8_t i = 0; i < stufe; i++)
+        erstes += NO_DATEN / aggregatdauer[i];
+    return erstes;
+}
+
+void AggregatHinzufuegen(s10aggregat *const aggregate, time_t const start, size_t const sekunde, s10daten const *const daten)
+{
+    int32_t const leistung[AGGREGAT_FELDER] = { daten->P_pv, daten->P_bat, daten->P_haus, daten->P_netz, daten->P_ext, daten->P_wall,
+                                                daten->P_pvwall, daten->Pdc1, daten->Pdc2, daten->Pdc3 };
+    size_t erstes = 0;
+    for (uint_fast8_t stufe = 0; stufe < AGGREGAT_STUFEN; stufe++)
+    {
+        s10aggregat *const fenster = aggregate + erstes + sekunde / aggregatdauer[stufe];
+        erstes += NO_DATEN / aggregatdauer[stufe];
+        if (0 == fenster->anzahl)
+        {
+            fenster->beginn = start + sekunde / aggregatdauer[stufe] * aggregatdauer[stufe];
+            fenster->dauer = aggregatdauer[stufe];
+            for (uint_fast8_t feld = 0; feld < AGGREGAT_FELDER; feld++)
+                fenster->min[feld] = fenster->max[feld] = leistung[feld];
+        }
+        fenster->anzahl++;
+        for (uint_fast8_t feld = 0; feld < AGGREGAT_FELDER; feld++)
+        {
+            if (leistung[feld] < fenster->min[feld]) fenster->min[feld] = leistung[feld];
+            if (leistung[feld] > fenster->max[feld]) fenster->max[feld] = leistung[feld];
+            fenster->summe[feld] += leistung[feld];
+        }
+    }
+}
+
+int_fast8_t AggregateSchreiben(char const *const name, time_t const start, uint_fast8_t const stufe, s10aggregat const *const fenster,
+                               size_t const von, size_t const bis)
+{
+    if (sizeof(ARCHIV_VERZEICHNIS) <= 1 || von >= bis) return EXIT_SUCCESS;
+
+    time_t const tag = start - start % 86400;
+    struct tm datum;
+    gmtime_r(&tag, &datum);
+    char pfad[sizeof(ARCHIV_VERZEICHNIS) + LEN_TABELLENAME + 8];
+    snprintf(pfad, sizeof(pfad), "%s/%s%s%04d_%02d_%02d.s10g", ARCHIV_VERZEICHNIS, name, '\0' == *name ? "" : "_", datum.tm_year + 1900,
+             datum.tm_mon + 1, datum.tm_mday);
+
+    int const fd = open(pfad, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "S10auslesen: Aggregatdatei %s kann nicht geöffnet werden\n", pfad);
+        return EXIT_FAILURE;
+    }
+
+    /* die Fenster aller kürzeren Stufen des Tages stehen vor denen dieser Stufe */
+    size_t platz = (start - tag) / aggregatdauer[stufe] + von;
+    for (uint_fast8_t i = 0; i < stufe; i++)
+        platz += 86400 / aggregatdauer[i];
+
+    int_fast8_t result = EXIT_SUCCESS;
+    size_t const laenge = (bis - von) * sizeof(s10aggregat);
+    if ((ssize_t) laenge != pwrite(fd, fenster + von, laenge, platz * sizeof(s10aggregat)))
+    {
+        fprintf(stderr, "S10auslesen: Aggregatdatei %s kann nicht geschrieben werden\n", pfad);
+        result = EXIT_FAILURE;
+    }
+#if JOURNAL_SYNC
+    else
+        fdatasync(fd);
+#endif
+    close(fd);
+    return result;
+}
@@ -0,0 +1,86 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Minimum, Maximum, Mittelwert und Energie der Leistungen je Minute, Viertelstunde und Stunde (Zeitfenster aus AGGREGAT_FENSTER).
+ * Die Erfassung rechnet jeden Messwert sofort in die laufenden Fenster seiner Stunde ein, der Schreib-Thread legt jedes Fenster
+ * ab, sobald es abgeschlossen ist. Jeder Messwert steht für eine Sekunde, die Summe der Leistungen ist daher die Energie in Ws.
+ *
+ * Die Aggregatdatei eines Tages (ARCHIV_VERZEICHNIS/[Name_]YYYY_MM_DD.s10g) besteht aus s10aggregat-Datensätzen fester Größe,
+ * zuerst alle Fenster der ersten Stufe des Tages, dann die der zweiten und dritten. Noch nicht geschriebene Fenster sind Nullen.
+ */
+
+#include "S10daten.h" /* für s10daten */
+
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int32_t und Konsorten */
+#include <time.h> /* für time_t */
+
+/* Anzahl der aggregierten Leistungen: P_pv, P_bat, P_haus, P_netz, P_ext, P_wall, P_pvwall, Pdc1, Pdc2, Pdc3 */
+#define AGGREGAT_FELDER     10
+/* Anzahl der Fensterlängen (Minute, Viertelstunde, Stunde) */
+#define AGGREGAT_STUFEN     3
+
+/**
+ * die Kennzahlen eines Zeitfensters.
+ */
+typedef struct
+{
+    int64_t beginn; /* Beginn des Fensters in Sekunden seit 1.1.1970 (UTC) */
+    uint32_t dauer; /* Länge des Fensters in Sekunden */
+    uint32_t anzahl; /* Anzahl der Messwerte im Fenster, 0 = leer */
+    int32_t min[AGGREGAT_FELDER];
+    int32_t max[AGGREGAT_FELDER];
+    int64_t summe[AGGREGAT_FELDER]; /* Energie in Ws, Mittelwert = summe / anzahl */
+} s10aggregat;
+
+/* Länge der Fenster je Stufe in Sekunden */
+extern uint32_t const aggregatdauer[AGGREGAT_STUFEN];
+/* Spaltennamen der aggregierten Leistungen in der Datenbank */
+extern char const *const aggregatnamen[AGGREGAT_FELDER];
+
+/**
+ * ermittelt, an welcher Stelle die Fenster einer Stufe innerhalb der Aggregate einer Stunde beginnen.
+ * @param Stufe, AGGREGAT_STUFEN = Gesamtzahl der Fenster einer Stunde.
+ * @return Index des ersten Fensters der Stufe.
+ */
+size_t AggregatErstes(uint_fast8_t const);
+
+/**
+ * rechnet einen Messwert in die laufenden Fenster aller Stufen ein, O(1) je Messwert.
+ * @param die AggregatErstes(AGGREGAT_STUFEN) Fenster der Stunde, mit calloc angelegt.
+ * @param hh:00:00 Uhr der Stunde als Sekunden seit 1.1.1970 (UTC).
+ * @param Sekunde des Messwerts innerhalb der Stunde.
+ * @param der Messwert.
+ */
+void AggregatHinzufuegen(s10aggregat* const, time_t const, size_t const, s10daten const* const);
+
+/**
+ * schreibt Fenster einer Stufe an ihre feste Stelle in der Aggregatdatei ihres Tages, ein wiederholter Aufruf ist daher unschädlich.
+ * @param Name der Anlage, der dem Dateinamen vorangestellt wird, "" = ohne Namen.
+ * @param hh:00:00 Uhr der Stunde als Sekunden seit 1.1.1970 (UTC).
+ * @param Stufe der Fenster.
+ * @param das erste Fenster der Stufe in dieser Stunde.
+ * @param erstes Fenster, das geschrieben wird.
+ * @param erstes Fenster, das nicht mehr geschrieben wird.
+ * @return EXIT_SUCCESS wenn die Fenster geschrieben wurden oder kein ARCHIV_VERZEICHNIS eingestellt ist, sonst EXIT_FAILURE.
+ */
+int_fast8_t AggregateSchreiben(char const* const, time_t const, uint_fast8_t const, s10aggregat const* const, size_t const, size_t const);
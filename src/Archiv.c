@@ -0,0 +1,211 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Archiv.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <stdio.h> /* für Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+
+/**
+ * hängt einen Wert als Varint an.
+ * @param ziel Schreibposition.
+ * @param wert der Wert.
+ * @return Schreibposition hinter dem Varint.
+ */
+static uint8_t *VarintSchreiben(uint8_t *ziel, uint64_t wert)
+{
+    while (wert >= 0x80u)
+    {
+        *ziel++ = (uint8_t) (wert | 0x80u);
+        wert >>= 7;
+    }
+    *ziel++ = (uint8_t) wert;
+    return ziel;
+}
+
+/**
+ * kodiert eine Spalte eines Blocks als Differenzen zum jeweils vorherigen Wert, Folgen von Differenzen 0 werden zusammengefasst.
+ * @param ziel Schreibposition.
+ * @param zeilen die Zeilen der Stunde.
+ * @param zeilenlaenge Länge einer Zeile in Bytes.
+ * @param gueltig Gültigkeit der Zeilen, fehlende Zeilen werden übersprungen.
+ * @param von erste Sekunde des Blocks innerhalb der Stunde.
+ * @param anzahl Anzahl der Sekunden im Block.
+ * @param spalte die Spalte.
+ * @return Schreibposition hinter der Spalte.
+ */
+static uint8_t *SpalteKodieren(uint8_t *ziel, uint8_t const *const zeilen, size_t const zeilenlaenge, s10gueltig const *const gueltig,
+                               size_t const von, size_t const anzahl, s10archivspalte const *const spalte)
+{
+    int64_t vorher = 0;
+    uint64_t nullen = 0;
+    for (size_t i = GueltigSuchen(gueltig, von, von + anzahl); i < von + anzahl; i = GueltigSuchen(gueltig, i + 1, von + anzahl))
+    {
+        int64_t const wert = ArchivFeldLesen(zeilen + i * zeilenlaenge, spalte);
+        int64_t const differenz = wert - vorher;
+        vorher = wert;
+        if (0 == differenz)
+        {
+            nullen++;
+            continue;
+        }
+        if (nullen > 0)
+        {
+            ziel = VarintSchreiben(ziel, 0);
+            ziel = VarintSchreiben(ziel, nullen - 1);
+            nullen = 0;
+        }
+        ziel = VarintSchreiben(ziel, ((uint64_t) differenz << 1) ^ (uint64_t) (differenz >> 63));
+    }
+    if (nullen > 0)
+    {
+        ziel = VarintSchreiben(ziel, 0);
+        ziel = VarintSchreiben(ziel, nullen - 1);
+    }
+    return ziel;
+}
+
+uint8_t *ArchivBlockKodieren(uint32_t const erste, void const *const zeilen, size_t const zeilenlaenge, s10archivspalte const *const spalten,
+                             size_t const spaltenzahl, s10gueltig const *const gueltig, size_t const von, size_t const anzahl, size_t *const laenge)
+{
+    size_t const laengeBitmap = (anzahl + 7) / 8;
+    size_t const maxSpalte = 2 * 10 + anzahl * 10; /* jeder Varint belegt höchstens 10 Bytes */
+    uint8_t *const block = (uint8_t*) malloc(sizeof(s10archivblock) + laengeBitmap + spaltenzahl * (10 + maxSpalte));
+    if (NULL == block) return NULL;
+    uint8_t *const spaltenpuffer = (uint8_t*) malloc(maxSpalte);
+    if (NULL == spaltenpuffer)
+    {
+        free(block);
+        return NULL;
+    }
+
+    uint8_t *const bitmap = block + sizeof(s10archivblock);
+    memset(bitmap, 0, laengeBitmap);
+    for (size_t i = GueltigSuchen(gueltig, von, von + anzahl); i < von + anzahl; i = GueltigSuchen(gueltig, i + 1, von + anzahl))
+        bitmap[(i - von) / 8] |= 1u << (i - von) % 8;
+
+    uint8_t *ende = bitmap + laengeBitmap;
+    for (size_t spalte = 0; spalte < spaltenzahl; spalte++)
+    {
+        size_t const laengeSpalte = SpalteKodieren(spaltenpuffer, (uint8_t const*) zeilen, zeilenlaenge, gueltig, von, anzahl, spalten + spalte)
+                                    - spaltenpuffer;
+        ende = VarintSchreiben(ende, laengeSpalte);
+        memcpy(ende, spaltenpuffer, laengeSpalte);
+        ende += laengeSpalte;
+    }
+    free(spaltenpuffer);
+
+    s10archivblock const kopf = { erste, anzahl, ende - bitmap };
+    memcpy(block, &kopf, sizeof(kopf));
+    *laenge = ende - block;
+    return block;
+}
+
+/**
+ * legt den Kopf einer neuen Archivdatei an.
+ * @param fd die leere Archivdatei.
+ * @param tag 00:00:00 Uhr des Tages als Sekunden seit 1.1.1970 (UTC).
+ * @param id Identifikationsdaten der Anlage.
+ * @return EXIT_SUCCESS wenn der Kopf geschrieben wurde, sonst EXIT_FAILURE.
+ */
+static int_fast8_t KopfAnlegen(int const fd, time_t const tag, s10konstanten const *const id)
+{
+    s10archivkopf *const kopf = (s10archivkopf*) calloc(1, sizeof(s10archivkopf));
+    if (NULL == kopf) return EXIT_FAILURE;
+    kopf->magic = ARCHIV_MAGIC;
+    kopf->version = ARCHIV_VERSION;
+    kopf->tag = tag;
+    kopf->spalten = ARCHIV_SPALTEN;
+    atomic_init(&kopf->groesse, sizeof(s10archivkopf));
+    memcpy((void*) &kopf->id, id, sizeof(s10konstanten));
+    int_fast8_t const result = sizeof(s10archivkopf) == pwrite(fd, kopf, sizeof(s10archivkopf), 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    free(kopf);
+    return result;
+}
+
+int_fast8_t ArchivAnhaengen(char const *const name, s10konstanten const *const id, time_t const start, s10daten const *const daten,
+                            s10gueltig const *const gueltig, size_t von, size_t bis)
+{
+    if (sizeof(ARCHIV_VERZEICHNIS) <= 1 || von >= bis) return EXIT_SUCCESS;
+
+    time_t const tag = start - start % ARCHIV_SEKUNDEN;
+    struct tm datum;
+    gmtime_r(&tag, &datum);
+    char pfad[sizeof(ARCHIV_VERZEICHNIS) + LEN_TABELLENAME + 8];
+    snprintf(pfad, sizeof(pfad), "%s/%s%s%04d_%02d_%02d.s10a", ARCHIV_VERZEICHNIS, name, '\0' == *name ? "" : "_", datum.tm_year + 1900,
+             datum.tm_mon + 1, datum.tm_mday);
+
+    int const fd = open(pfad, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "S10auslesen: Archiv %s kann nicht geöffnet werden\n", pfad);
+        return EXIT_FAILURE;
+    }
+
+    int_fast8_t result = EXIT_FAILURE;
+    struct stat info;
+    s10archivkopf *kopf = MAP_FAILED;
+    if (0 == fstat(fd, &info) && (info.st_size > 0 || EXIT_SUCCESS == KopfAnlegen(fd, tag, id)))
+        kopf = (s10archivkopf*) mmap(NULL, sizeof(s10archivkopf), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED != kopf)
+    {
+        if (ARCHIV_MAGIC == kopf->magic && ARCHIV_VERSION == kopf->version && tag == kopf->tag)
+        {
+            /* bereits archivierte Sekunden überspringen, fehlende Messwerte am Rand gar nicht erst ablegen */
+            uint32_t const sekunde = start - tag;
+            if (sekunde + von < kopf->ende) von = kopf->ende - sekunde;
+            size_t const archivEnde = bis;
+            von = GueltigSuchen(gueltig, von, bis);
+            while (bis > von && !Gueltig(gueltig, bis - 1))
+                bis--;
+
+            result = EXIT_SUCCESS;
+            for (size_t blockStart = von; blockStart < bis && EXIT_SUCCESS == result; blockStart += ARCHIV_BLOCK_MAX)
+            {
+                size_t const anzahl = bis - blockStart < ARCHIV_BLOCK_MAX ? bis - blockStart : ARCHIV_BLOCK_MAX;
+                uint32_t const erste = sekunde + blockStart;
+                uint32_t const position = atomic_load(&kopf->groesse);
+                size_t laenge;
+                uint8_t *const block = ArchivBlockKodieren(erste, daten, sizeof(s10daten), archivspalten, ARCHIV_SPALTEN, gueltig, blockStart, anzahl,
+                                                           &laenge);
+                result = EXIT_FAILURE;
+                if (NULL != block && laenge == (size_t) pwrite(fd, block, laenge, position))
+                {
+#if JOURNAL_SYNC
+                    fdatasync(fd);
+#endif
+                    for (uint32_t minute = 0; minute <= (erste + anzahl - 1) / 60; minute++)
+                        if (0 == kopf->minute[minute]) kopf->minute[minute] = position;
+                    /* erst jetzt wird der Block für Leser sichtbar */
+                    atomic_store_explicit(&kopf->groesse, position + laenge, memory_order_release);
+                    result = EXIT_SUCCESS;
+                }
+                free(block);
+            }
+            if (EXIT_SUCCESS == result && sekunde + archivEnde > kopf->ende) kopf->ende = sekunde + archivEnde;
+        }
+        else
+            fprintf(stderr, "S10auslesen: %s ist keine passende Archivdatei\n", pfad);
+        munmap(kopf, sizeof(s10archivkopf));
+    }
+    if (EXIT_SUCCESS != result) fprintf(stderr, "S10auslesen: Messwerte können nicht in %s archiviert werden\n", pfad);
+    close(fd);
+    return result;
+}
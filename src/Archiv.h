@@ -0,0 +1,392 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * spaltenweises Binärarchiv der Messwerte, eine Datei pro Anlage und Tag (ARCHIV_VERZEICHNIS/[Name_]YYYY_MM_DD.s10a).
+ *
+ * Aufbau einer Datei:
+ *     s10archivkopf         Identifikationsdaten und Minutenindex, der Index zeigt je Minute auf den ersten Block,
+ *                           der Messwerte dieser oder einer späteren Minute enthält
+ *     Block, Block, ...     zeitlich aufsteigend angehängt, jeder Block lässt sich unabhängig von den anderen lesen
+ * Aufbau eines Blocks:
+ *     s10archivblock        erste Sekunde des Tages, Anzahl der Sekunden und Länge des Blocks
+ *     Bitmap                ein Bit pro Sekunde, gesetzt wenn für die Sekunde ein Messwert vorliegt
+ *     ARCHIV_SPALTEN Spalten, jede mit ihrer Länge in Bytes als Varint vorweg, danach je vorhandenem Messwert die Differenz zum
+ *                           vorherigen Wert der Spalte (zigzag-kodiert als Varint). Eine Differenz 0 wird als 0 gefolgt von der Anzahl
+ *                           weiterer Nullen als Varint abgelegt, unveränderte Werte kosten daher fast keinen Platz.
+ * Leser blenden die Datei mit ArchivVerbinden() nur lesend ein, auch während S10auslesen noch Blöcke anhängt.
+ *
+ * Beispiel für einen Leser:
+ *     s10archiv archiv;
+ *     s10daten messwert;
+ *     if (ArchivVerbinden("/var/lib/S10auslesen/archiv/2024_05_01.s10a", &archiv) && ArchivLesen(&archiv, 12 * 3600, &messwert))
+ *         printf("%d W\n", messwert.P_pv);
+ *     ArchivTrennen(&archiv);
+ */
+
+#include "S10daten.h" /* für s10daten und s10konstanten */
+
+#include <fcntl.h> /* für O_RDONLY */
+#include <stdatomic.h> /* für die gültige Länge */
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für offsetof und size_t */
+#include <stdint.h> /* für uint32_t und Konsorten */
+#include <string.h> /* für memcpy */
+#include <sys/mman.h> /* für mmap */
+#include <sys/stat.h> /* für fstat */
+#include <time.h> /* für time_t */
+#include <unistd.h> /* für close */
+
+/* "S10A" */
+#define ARCHIV_MAGIC        0x53313041u
+/* wird bei jeder Änderung des Aufbaus erhöht */
+#define ARCHIV_VERSION      1u
+/* Sekunden pro Tag bzw. Archivdatei */
+#define ARCHIV_SEKUNDEN     86400u
+/* Anzahl der Spalten, entspricht den Feldern von s10daten */
+#define ARCHIV_SPALTEN      31u
+/* so viele Sekunden umfasst ein Block höchstens */
+#define ARCHIV_BLOCK_MAX    3600u
+/* Kennung fehlender Messwerte bei ArchivSpalteLesen() */
+#define ARCHIV_FEHLT        INT32_MIN
+
+/**
+ * Kopf einer Archivdatei.
+ */
+typedef struct
+{
+    uint32_t magic; /* ARCHIV_MAGIC */
+    uint32_t version; /* ARCHIV_VERSION */
+    int64_t tag; /* 00:00:00 Uhr des Tages als Sekunden seit 1.1.1970 (UTC) */
+    uint32_t spalten; /* ARCHIV_SPALTEN */
+    uint32_t ende; /* erste Sekunde des Tages, die noch nicht archiviert ist */
+    _Atomic uint32_t groesse; /* gültige Länge der Datei, wird erst nach dem vollständigen Anhängen eines Blocks erhöht */
+    s10konstanten id; /* Identifikationsdaten der Anlage */
+    uint32_t minute[ARCHIV_SEKUNDEN / 60]; /* Dateiposition des ersten Blocks mit Messwerten dieser oder einer späteren Minute, 0 = noch keiner */
+} s10archivkopf;
+
+/**
+ * Kopf eines Blocks.
+ */
+typedef struct
+{
+    uint32_t erste; /* Sekunde des Tages, mit welcher der Block beginnt */
+    uint32_t anzahl; /* Anzahl der Sekunden im Block, fehlende Messwerte eingeschlossen */
+    uint32_t laenge; /* Länge des Blocks hinter diesem Kopf in Bytes */
+} s10archivblock;
+
+/**
+ * beschreibt eine Spalte, also ein Feld von s10daten.
+ */
+typedef struct
+{
+    uint16_t offset; /* Position des Felds in s10daten bzw. in einer Zeile mit Rohwerten */
+    uint8_t groesse; /* Größe des Felds in Bytes */
+    bool vorzeichen; /* Feld ist vorzeichenbehaftet */
+} s10archivspalte;
+
+#define ARCHIV_SPALTE(feld, vorzeichen) { offsetof(s10daten, feld), sizeof(((s10daten*) 0)->feld), vorzeichen }
+
+/* die Spalten in der Reihenfolge, in der sie in jedem Block stehen */
+static s10archivspalte const archivspalten[ARCHIV_SPALTEN] = {
+    ARCHIV_SPALTE(P_pv, true), ARCHIV_SPALTE(P_bat, true), ARCHIV_SPALTE(P_haus, true), ARCHIV_SPALTE(P_netz, true),
+    ARCHIV_SPALTE(P_ext, true), ARCHIV_SPALTE(P_wall, true), ARCHIV_SPALTE(P_pvwall, true), ARCHIV_SPALTE(eigen, false),
+    ARCHIV_SPALTE(autarkie, false), ARCHIV_SPALTE(soc, false), ARCHIV_SPALTE(notstr, false), ARCHIV_SPALTE(ems, false),
+    ARCHIV_SPALTE(emsrc, true), ARCHIV_SPALTE(emsctrl, false), ARCHIV_SPALTE(wall1, false), ARCHIV_SPALTE(wall2, false),
+    ARCHIV_SPALTE(wall3, false), ARCHIV_SPALTE(wall4, false), ARCHIV_SPALTE(wall5, false), ARCHIV_SPALTE(wall6, false),
+    ARCHIV_SPALTE(wall7, false), ARCHIV_SPALTE(wall8, false), ARCHIV_SPALTE(Vdc1, false), ARCHIV_SPALTE(Vdc2, false),
+    ARCHIV_SPALTE(Vdc3, false), ARCHIV_SPALTE(Idc1, false), ARCHIV_SPALTE(Idc2, false), ARCHIV_SPALTE(Idc3, false),
+    ARCHIV_SPALTE(Pdc1, false), ARCHIV_SPALTE(Pdc2, false), ARCHIV_SPALTE(Pdc3, false)
+};
+
+/**
+ * eine nur lesend eingeblendete Archivdatei.
+ */
+typedef struct
+{
+    s10archivkopf const *kopf; /* NULL wenn nicht eingeblendet */
+    size_t laenge; /* eingeblendete Länge */
+} s10archiv;
+
+/**
+ * hängt die Messwerte eines Ausschnitts einer Stunde als Block an die Archivdatei ihres Tages an und legt diese ggfs. an.
+ * Bereits archivierte Sekunden werden übersprungen, ein wiederholter Aufruf (z.B. aus dem Journal) ist daher unschädlich.
+ * @param Name der Anlage, der dem Dateinamen vorangestellt wird, "" = ohne Namen.
+ * @param Identifikationsdaten der Anlage für den Kopf einer neuen Datei.
+ * @param hh:00:00 Uhr der Stunde als Sekunden seit 1.1.1970 (UTC).
+ * @param Array der Messwerte der Stunde.
+ * @param Gültigkeit der Messwerte, fehlende Messwerte werden nicht archiviert.
+ * @param erste Sekunde der Stunde, die archiviert wird.
+ * @param erste Sekunde der Stunde, die nicht mehr archiviert wird.
+ * @return EXIT_SUCCESS wenn der Block angehängt wurde oder nichts zu tun war, sonst EXIT_FAILURE.
+ */
+int_fast8_t ArchivAnhaengen(char const* const, s10konstanten const* const, time_t const, s10daten const* const, s10gueltig const* const,
+                            size_t const, size_t const);
+
+/**
+ * kodiert einen Block samt Kopf und Bitmap aus beliebigen Zeilen, z.B. s10daten oder Rohwerten.
+ * @param Sekunde des Tages, mit welcher der Block beginnt.
+ * @param die Zeilen der Stunde.
+ * @param Länge einer Zeile in Bytes.
+ * @param die Spalten innerhalb einer Zeile.
+ * @param Anzahl der Spalten.
+ * @param Gültigkeit der Zeilen, fehlende Zeilen werden übersprungen.
+ * @param erste Zeile des Blocks.
+ * @param Anzahl der Sekunden im Block.
+ * @param wird auf die Länge des Blocks samt Kopf gesetzt.
+ * @return mit malloc angelegter Block oder NULL falls kein Speicher verfügbar ist.
+ */
+uint8_t *ArchivBlockKodieren(uint32_t const, void const* const, size_t const, s10archivspalte const* const, size_t const, s10gueltig const* const,
+                             size_t const, size_t const, size_t* const);
+
+/**
+ * liest einen zigzag-kodierten Varint und rückt die Leseposition weiter.
+ * @param pos Leseposition.
+ * @param ende Ende des lesbaren Bereichs.
+ * @return der dekodierte Wert, 0 am Ende des Bereichs.
+ */
+static inline uint64_t ArchivVarint(uint8_t const **const pos, uint8_t const *const ende)
+{
+    uint64_t wert = 0;
+    for (uint_fast8_t schieben = 0; *pos < ende && schieben < 64; schieben += 7)
+    {
+        uint8_t const byte = *(*pos)++;
+        wert |= (uint64_t) (byte & 0x7Fu) << schieben;
+        if (0 == (byte & 0x80u)) break;
+    }
+    return wert;
+}
+
+/**
+ * blendet eine Archivdatei nur lesend ein.
+ * @param pfad Pfad der Archivdatei.
+ * @param archiv wird mit der eingeblendeten Datei gefüllt.
+ * @return true wenn die Datei eingeblendet wurde, false wenn sie nicht existiert oder nicht zu diesem Header passt.
+ */
+static inline bool ArchivVerbinden(char const *const pfad, s10archiv *const archiv)
+{
+    archiv->kopf = NULL;
+    archiv->laenge = 0;
+    int const fd = open(pfad, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat info;
+    void *datei = MAP_FAILED;
+    if (0 == fstat(fd, &info) && info.st_size >= (off_t) sizeof(s10archivkopf)) datei = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == datei) return false;
+
+    s10archivkopf const *const kopf = (s10archivkopf const*) datei;
+    if (ARCHIV_MAGIC != kopf->magic || ARCHIV_VERSION != kopf->version || ARCHIV_SPALTEN != kopf->spalten)
+    {
+        munmap(datei, info.st_size);
+        return false;
+    }
+    archiv->kopf = kopf;
+    archiv->laenge = info.st_size;
+    return true;
+}
+
+/**
+ * blendet eine mit ArchivVerbinden() eingeblendete Datei wieder aus.
+ * @param archiv die Archivdatei.
+ */
+static inline void ArchivTrennen(s10archiv *const archiv)
+{
+    if (NULL != archiv->kopf) munmap((void*) archiv->kopf, archiv->laenge);
+    archiv->kopf = NULL;
+    archiv->laenge = 0;
+}
+
+/**
+ * sucht den Block, der eine Sekunde des Tages enthält.
+ * @param archiv die Archivdatei.
+ * @param sekunde Sekunde des Tages.
+ * @return der Block oder NULL, falls die Sekunde nicht archiviert ist.
+ */
+static inline s10archivblock const *ArchivBlock(s10archiv const *const archiv, uint32_t const sekunde)
+{
+    if (sekunde >= ARCHIV_SEKUNDEN) return NULL;
+    size_t groesse = atomic_load_explicit(&archiv->kopf->groesse, memory_order_acquire);
+    if (groesse > archiv->laenge) groesse = archiv->laenge; /* erst nach dem Einblenden angehängte Blöcke bleiben unsichtbar */
+
+    uint8_t const *const datei = (uint8_t const*) archiv->kopf;
+    size_t position = archiv->kopf->minute[sekunde / 60];
+    while (0 != position && position + sizeof(s10archivblock) <= groesse)
+    {
+        s10archivblock const *const block = (s10archivblock const*) (datei + position);
+        if (sekunde < block->erste) return NULL;
+        if (sekunde < block->erste + block->anzahl) return position + sizeof(s10archivblock) + block->laenge <= groesse ? block : NULL;
+        position += sizeof(s10archivblock) + block->laenge;
+    }
+    return NULL;
+}
+
+/**
+ * dekodiert die Werte einer Spalte eines Blocks.
+ * @param pos Beginn der Spaltendaten.
+ * @param ende Ende der Spaltendaten.
+ * @param anzahl so viele Werte werden dekodiert.
+ * @param werte wird mit den Werten gefüllt, darf NULL sein.
+ * @return der letzte dekodierte Wert.
+ */
+static inline int64_t ArchivSpalteDekodieren(uint8_t const *pos, uint8_t const *const ende, size_t const anzahl, int64_t *const werte)
+{
+    int64_t wert = 0;
+    uint64_t nullen = 0; /* noch ausstehende Differenzen 0 einer Folge */
+    for (size_t i = 0; i < anzahl; i++)
+    {
+        if (0 == nullen)
+        {
+            uint64_t const zigzag = ArchivVarint(&pos, ende);
+            if (0 == zigzag)
+                nullen = ArchivVarint(&pos, ende);
+            else
+                wert += (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+        }
+        else
+            nullen--;
+        if (NULL != werte) werte[i] = wert;
+    }
+    return wert;
+}
+
+/**
+ * liest das zu einer Spalte gehörende Feld eines Messwerts.
+ * @param daten der Messwert bzw. eine Zeile mit Rohwerten.
+ * @param spalte die Spalte.
+ * @return der Wert des Felds.
+ */
+static inline int64_t ArchivFeldLesen(void const *const daten, s10archivspalte const *const spalte)
+{
+    uint8_t const *const feld = (uint8_t const*) daten + spalte->offset;
+    if (4 == spalte->groesse)
+    {
+        int32_t wert;
+        memcpy(&wert, feld, sizeof(wert));
+        return wert;
+    }
+    if (2 == spalte->groesse)
+    {
+        uint16_t wert;
+        memcpy(&wert, feld, sizeof(wert));
+        return spalte->vorzeichen ? (int16_t) wert : wert;
+    }
+    return *feld;
+}
+
+/**
+ * schreibt einen Spaltenwert in das passende Feld eines Messwerts.
+ * @param ziel der Messwert.
+ * @param spalte die Spalte.
+ * @param wert der Wert.
+ */
+static inline void ArchivFeldSetzen(s10daten *const ziel, s10archivspalte const *const spalte, int64_t const wert)
+{
+    uint8_t *const feld = (uint8_t*) ziel + spalte->offset;
+    if (4 == spalte->groesse)
+    {
+        int32_t const w = (int32_t) wert;
+        memcpy(feld, &w, sizeof(w));
+    }
+    else if (2 == spalte->groesse)
+    {
+        uint16_t const w = (uint16_t) wert;
+        memcpy(feld, &w, sizeof(w));
+    }
+    else
+        *feld = (uint8_t) wert;
+}
+
+/**
+ * liest den Messwert einer Sekunde ohne Systemaufruf, dekodiert wird nur der Block, der die Sekunde enthält.
+ * @param archiv die Archivdatei.
+ * @param sekunde Sekunde des Tages (0 = 00:00:00 Uhr UTC).
+ * @param ziel wird mit dem Messwert gefüllt.
+ * @return true wenn für die Sekunde ein Messwert archiviert ist, sonst false.
+ */
+static inline bool ArchivLesen(s10archiv const *const archiv, uint32_t const sekunde, s10daten *const ziel)
+{
+    s10archivblock const *const block = ArchivBlock(archiv, sekunde);
+    if (NULL == block) return false;
+
+    uint8_t const *const bitmap = (uint8_t const*) (block + 1);
+    uint32_t const index = sekunde - block->erste;
+    if (0 == (bitmap[index / 8] & (1u << index % 8))) return false;
+    /* Position unter den vorhandenen Messwerten des Blocks */
+    size_t vorhanden = 0;
+    for (uint32_t i = 0; i < index / 8; i++)
+        vorhanden += __builtin_popcount(bitmap[i]);
+    vorhanden += __builtin_popcount(bitmap[index / 8] & ((1u << index % 8) - 1));
+
+    uint8_t const *pos = bitmap + (block->anzahl + 7) / 8;
+    uint8_t const *const ende = (uint8_t const*) (block + 1) + block->laenge;
+    memset(ziel, 0, sizeof(s10daten));
+    for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+    {
+        uint64_t const laenge = ArchivVarint(&pos, ende);
+        ArchivFeldSetzen(ziel, archivspalten + spalte, ArchivSpalteDekodieren(pos, pos + laenge, vorhanden + 1, NULL));
+        pos += laenge;
+    }
+    return true;
+}
+
+/**
+ * liest eine Spalte des ganzen Tages, dabei werden nur die Bytes dieser Spalte dekodiert.
+ * @param archiv die Archivdatei.
+ * @param spalte Nummer der Spalte, siehe archivspalten.
+ * @param werte Array mit ARCHIV_SEKUNDEN Plätzen, wird je Sekunde mit dem Wert oder ARCHIV_FEHLT gefüllt.
+ * @return Anzahl der vorhandenen Messwerte.
+ */
+static inline size_t ArchivSpalteLesen(s10archiv const *const archiv, uint_fast8_t const spalte, int32_t *const werte)
+{
+    size_t gefunden = 0;
+    for (uint32_t i = 0; i < ARCHIV_SEKUNDEN; i++)
+        werte[i] = ARCHIV_FEHLT;
+    if (spalte >= ARCHIV_SPALTEN) return 0;
+
+    int64_t dekodiert[ARCHIV_BLOCK_MAX];
+    for (uint32_t sekunde = 0; sekunde < ARCHIV_SEKUNDEN;)
+    {
+        s10archivblock const *const block = ArchivBlock(archiv, sekunde);
+        if (NULL == block)
+        {
+            sekunde++;
+            continue;
+        }
+        uint8_t const *const bitmap = (uint8_t const*) (block + 1);
+        uint8_t const *pos = bitmap + (block->anzahl + 7) / 8;
+        uint8_t const *const ende = (uint8_t const*) (block + 1) + block->laenge;
+        for (uint_fast8_t s = 0; s < spalte; s++)
+            pos += ArchivVarint(&pos, ende);
+        uint64_t const laenge = ArchivVarint(&pos, ende);
+
+        size_t vorhanden = 0;
+        for (uint32_t i = 0; i < block->anzahl && i < ARCHIV_BLOCK_MAX; i++)
+            if (bitmap[i / 8] & (1u << i % 8)) vorhanden++;
+        ArchivSpalteDekodieren(pos, pos + laenge, vorhanden, dekodiert);
+        for (uint32_t i = 0, k = 0; i < block->anzahl && i < ARCHIV_BLOCK_MAX; i++)
+            if (bitmap[i / 8] & (1u << i % 8)) werte[block->erste + i] = (int32_t) dekodiert[k++];
+        gefunden += vorhanden;
+        sekunde = block->erste + block->anzahl;
+    }
+    return gefunden;
+}
@@ -0,0 +1,230 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Ausgabe.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+#include "JSON.h" /* Ausgabe der Messwerte als JSON-Datei */
+#include "Metriken.h" /* Laufzeitmetriken */
+#include "MQTT.h" /* Veröffentlichung der Messwerte über MQTT */
+#include "Register.h" /* für zusatzregister */
+#include "Ringpuffer.h" /* Shared-Memory-Ausgabe der letzten Messwerte */
+#include "Webserver.h" /* HTTP-Ausgabe der Messwerte */
+
+#include <pthread.h> /* für die Ausgabe-Threads */
+#include <semaphore.h> /* zum Wecken der Ausgabe-Threads */
+#include <stdatomic.h> /* für die Indizes der Warteschlangen */
+#include <stdio.h> /* für Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* für memcpy */
+
+#if 0 != (AUSGABE_PLAETZE & (AUSGABE_PLAETZE - 1))
+#error AUSGABE_PLAETZE muss eine Zweierpotenz sein
+#endif
+
+/**
+ * ein Platz in der Warteschlange, gefolgt von den zusatzregister Werten der zusätzlichen Register.
+ */
+typedef struct
+{
+    int64_t zeit; /* Erfassungszeitpunkt in Nanosekunden seit 1.1.1970 (UTC) */
+    uint32_t latenz; /* Dauer der Modbus-Abfrage in Mikrosekunden */
+    s10daten daten;
+    int32_t zusatzwerte[];
+} ausgabeplatz;
+
+/**
+ * Warteschlange einer Anlage. Beide Indizes laufen frei hoch, der Platz ergibt sich aus dem Index modulo AUSGABE_PLAETZE.
+ * Sie liegen in getrennten Cache-Zeilen, damit sich Erfassung und Ausgabe-Thread nicht gegenseitig ausbremsen.
+ */
+typedef struct
+{
+    _Alignas(64) atomic_size_t kopf; /* Index des nächsten freien Platzes, nur vom Erfassungs-Thread geschrieben */
+    _Alignas(64) atomic_size_t schwanz; /* Index des ältesten noch auszugebenden Platzes, nur vom Ausgabe-Thread geschrieben */
+    unsigned char *plaetze; /* AUSGABE_PLAETZE Plätze mit je platzgroesse Bytes */
+} warteschlange;
+
+/**
+ * ein Ausgabe-Thread, er bedient alle Anlagen, deren Nummer modulo AUSGABE_THREADS seiner Nummer entspricht.
+ */
+typedef struct
+{
+    pthread_t thread;
+    sem_t wecken; /* wird je eingereihtem Messwert und zum Beenden erhöht */
+    size_t nummer;
+} ausgabethread;
+
+static warteschlange *schlangen = NULL; /* je Anlage */
+static size_t anlagen = 0; /* Anzahl der Warteschlangen */
+static size_t platzgroesse = 0; /* sizeof(ausgabeplatz) samt zusätzlicher Register, auf 8 Bytes aufgerundet */
+static ausgabethread *threads = NULL;
+static size_t gestartet = 0; /* Anzahl der laufenden Ausgabe-Threads */
+static atomic_bool anhalten = false;
+
+/**
+ * gibt einen Messwert auf allen Wegen aus.
+ * @param anlage Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param daten der Messwert.
+ * @param zusatzwerte Werte der zusätzlichen Register.
+ * @param zeit Erfassungszeitpunkt in Nanosekunden seit 1.1.1970 (UTC).
+ * @param latenz Dauer der Modbus-Abfrage in Mikrosekunden.
+ */
+static void Ausgeben(uint32_t const anlage, s10daten const *const daten, int32_t const *const zusatzwerte, int64_t const zeit,
+                     uint32_t const latenz)
+{
+    MQTTVeroeffentlichen(anlage, daten, zusatzwerte, zeit / 1000000);
+    if (0 != anlage) return;
+
+    RingpufferSchreiben(daten, zeit, latenz);
+    WebserverBenachrichtigen();
+    struct timespec jsonStart, jsonEnde;
+    clock_gettime(CLOCK_MONOTONIC, &jsonStart);
+    ErzeugeJSON(daten, zusatzwerte, zeit / 1000000);
+    clock_gettime(CLOCK_MONOTONIC, &jsonEnde);
+    MetrikJSON((jsonEnde.tv_sec - jsonStart.tv_sec) * 1000000 + (jsonEnde.tv_nsec - jsonStart.tv_nsec) / 1000);
+}
+
+/**
+ * gibt alle eingereihten Messwerte einer Anlage aus.
+ * @param anlage Nummer des Hauskraftwerks in der Anlagenliste.
+ */
+static void WarteschlangeLeeren(uint32_t const anlage)
+{
+    warteschlange *const schlange = schlangen + anlage;
+    size_t schwanz = atomic_load_explicit(&schlange->schwanz, memory_order_relaxed);
+    size_t const kopf = atomic_load_explicit(&schlange->kopf, memory_order_acquire);
+    for (; schwanz != kopf; schwanz++)
+    {
+        ausgabeplatz const *const platz = (ausgabeplatz const*) (schlange->plaetze + (schwanz % AUSGABE_PLAETZE) * platzgroesse);
+        Ausgeben(anlage, &platz->daten, platz->zusatzwerte, platz->zeit, platz->latenz);
+
+        struct timespec jetzt;
+        clock_gettime(CLOCK_REALTIME, &jetzt);
+        MetrikAusgabe(anlage, ((int64_t) jetzt.tv_sec * 1000000000 + jetzt.tv_nsec - platz->zeit) / 1000);
+        /* erst danach darf die Erfassung den Platz wieder belegen */
+        atomic_store_explicit(&schlange->schwanz, schwanz + 1, memory_order_release);
+    }
+}
+
+/**
+ * gibt die Messwerte seiner Anlagen aus, sobald sie eingereiht werden, bis die Ausgabe beendet wird.
+ * @param arg ausgabethread_t des Threads.
+ * @return NULL.
+ */
+static void *AusgabeThread(void *const arg)
+{
+    ausgabethread *const t = (ausgabethread*) arg;
+    for (;;)
+    {
+        while (0 != sem_wait(&t->wecken))
+            ;
+        bool const ende = atomic_load(&anhalten);
+        for (size_t anlage = t->nummer; anlage < anlagen; anlage += AUSGABE_THREADS)
+            WarteschlangeLeeren(anlage);
+        if (ende) break;
+    }
+    return NULL;
+}
+
+int_fast8_t AusgabeStarten(size_t const anzahl)
+{
+    if (0 == AUSGABE_THREADS || NULL != schlangen) return EXIT_FAILURE;
+
+    platzgroesse = (sizeof(ausgabeplatz) + zusatzregister * sizeof(int32_t) + 7) & ~(size_t) 7;
+    schlangen = (warteschlange*) aligned_alloc(_Alignof(warteschlange), anzahl * sizeof(warteschlange));
+    threads = (ausgabethread*) calloc(AUSGABE_THREADS, sizeof(ausgabethread));
+    if (NULL == schlangen || NULL == threads)
+    {
+        free(threads);
+        free(schlangen);
+        threads = NULL;
+        schlangen = NULL;
+        return EXIT_FAILURE;
+    }
+    for (anlagen = 0; anlagen < anzahl; anlagen++)
+    {
+        atomic_init(&schlangen[anlagen].kopf, 0);
+        atomic_init(&schlangen[anlagen].schwanz, 0);
+        schlangen[anlagen].plaetze = (unsigned char*) calloc(AUSGABE_PLAETZE, platzgroesse);
+        if (NULL == schlangen[anlagen].plaetze) break;
+    }
+
+    atomic_store(&anhalten, false);
+    for (gestartet = 0; anlagen == anzahl && gestartet < AUSGABE_THREADS; gestartet++)
+    {
+        threads[gestartet].nummer = gestartet;
+        if (0 != sem_init(&threads[gestartet].wecken, 0, 0)) break;
+        if (0 != pthread_create(&threads[gestartet].thread, NULL, AusgabeThread, threads + gestartet))
+        {
+            sem_destroy(&threads[gestartet].wecken);
+            break;
+        }
+    }
+    if (AUSGABE_THREADS == gestartet) return EXIT_SUCCESS;
+
+    /* nicht alle Threads gestartet: die laufenden beenden, die Messwerte werden dann direkt ausgegeben */
+    fprintf(stderr, "S10auslesen: Ausgabe-Threads können nicht gestartet werden, die Ausgabe erfolgt direkt in der Erfassung\n");
+    AusgabeBeenden();
+    return EXIT_FAILURE;
+}
+
+bool AusgabeEinreihen(uint32_t const anlage, s10daten const *const daten, int32_t const *const zusatzwerte, int64_t const zeit,
+                      uint32_t const latenz)
+{
+    if (0 == gestartet || anlage >= anlagen)
+    {
+        /* ohne Ausgabe-Threads wie bisher direkt in der Erfassung */
+        Ausgeben(anlage, daten, zusatzwerte, zeit, latenz);
+        return true;
+    }
+
+    warteschlange *const schlange = schlangen + anlage;
+    size_t const kopf = atomic_load_explicit(&schlange->kopf, memory_order_relaxed);
+    if (kopf - atomic_load_explicit(&schlange->schwanz, memory_order_acquire) >= AUSGABE_PLAETZE)
+    {
+        MetrikAusgabeVerworfen(anlage);
+        return false;
+    }
+    ausgabeplatz *const platz = (ausgabeplatz*) (schlange->plaetze + (kopf % AUSGABE_PLAETZE) * platzgroesse);
+    ausgabeplatz const kopie = { zeit, latenz, *daten };
+    memcpy(platz, &kopie, sizeof(kopie));
+    memcpy(platz->zusatzwerte, zusatzwerte, zusatzregister * sizeof(int32_t));
+    atomic_store_explicit(&schlange->kopf, kopf + 1, memory_order_release);
+    sem_post(&threads[anlage % AUSGABE_THREADS].wecken);
+    return true;
+}
+
+void AusgabeBeenden(void)
+{
+    atomic_store(&anhalten, true);
+    for (size_t i = 0; i < gestartet; i++)
+        sem_post(&threads[i].wecken);
+    for (size_t i = 0; i < gestartet; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+        sem_destroy(&threads[i].wecken);
+    }
+    gestartet = 0;
+    for (size_t i = 0; NULL != schlangen && i < anlagen; i++)
+        free(schlangen[i].plaetze);
+    free(schlangen);
+    free(threads);
+    schlangen = NULL;
+    threads = NULL;
+    anlagen = 0;
+}
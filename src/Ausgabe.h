@@ -0,0 +1,60 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Ausgabe der Messwerte abseits der Erfassung. Jede Anlage hat eine eigene Warteschlange mit AUSGABE_PLAETZE Plätzen, in die nur ihr
+ * Erfassungs-Thread schreibt und aus der nur ein Ausgabe-Thread liest (ein Erzeuger, ein Verbraucher). Beide Seiten kommen daher ohne
+ * Sperre aus, jede schreibt nur ihren eigenen Index. Die Ausgabe-Threads reichen die Messwerte an die MQTT-Ausgabe weiter und geben die
+ * der ersten Anlage im Ring, über den Webserver und als JSON-Datei aus. Hängt eine dieser Ausgaben (z.B. ein langsames Dateisystem),
+ * läuft die Warteschlange voll und weitere Messwerte werden für die Ausgabe verworfen und gezählt, die Erfassung wird dadurch nie
+ * verzögert. Das Journal gehört nicht dazu: die Erfassung schreibt es selbst, bevor sie einreiht, damit kein Messwert verloren geht
+ * und der Schreib-Thread nie Sekunden bestätigt, die noch nicht im Journal stehen.
+ */
+
+#include "S10daten.h" /* für s10daten */
+
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int64_t und Konsorten */
+#include <time.h> /* für time_t */
+
+/**
+ * legt die Warteschlangen an und startet AUSGABE_THREADS Ausgabe-Threads. Ohne Ausgabe-Threads gibt AusgabeEinreihen() direkt aus.
+ * @param Anzahl der Hauskraftwerke.
+ * @return EXIT_SUCCESS wenn die Ausgabe-Threads laufen, sonst EXIT_FAILURE.
+ */
+int_fast8_t AusgabeStarten(size_t const);
+
+/**
+ * reiht einen Messwert zur Ausgabe ein, nur aus dem Erfassungs-Thread der jeweiligen Anlage aufrufen.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param der Messwert.
+ * @param Werte der zusätzlichen Register (S10_ZUSATZREGISTER).
+ * @param Erfassungszeitpunkt in Nanosekunden seit 1.1.1970 (UTC).
+ * @param Dauer der Modbus-Abfrage in Mikrosekunden.
+ * @return false wenn die Warteschlange voll war und der Messwert verworfen wurde.
+ */
+bool AusgabeEinreihen(uint32_t const, s10daten const* const, int32_t const* const, int64_t const, uint32_t const);
+
+/**
+ * gibt alle noch eingereihten Messwerte aus und beendet die Ausgabe-Threads.
+ */
+void AusgabeBeenden(void);
@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Delta.h" /* zugehöriger Header dieser Datei */
+#include "Archiv.h" /* für die Beschreibung der Felder */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <stdint.h> /* für int32_t */
+
+/* Totband je Feld in der Reihenfolge von archivspalten, emsrc und emsctrl stehen nicht in der Datenbank und werden nie verglichen */
+static int32_t const totband[ARCHIV_SPALTEN] = {
+    DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG, /* P_pv, P_bat, P_haus, P_netz */
+    DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG, 0, /* P_ext, P_wall, P_pvwall, eigen */
+    0, 0, 0, 0, INT32_MAX, INT32_MAX, /* autarkie, soc, notstr, ems, emsrc, emsctrl */
+    0, 0, 0, 0, 0, 0, 0, 0, /* wall1 bis wall8 */
+    DELTA_TOTBAND_STRANG, DELTA_TOTBAND_STRANG, DELTA_TOTBAND_STRANG, /* Vdc1 bis Vdc3 */
+    DELTA_TOTBAND_STRANG, DELTA_TOTBAND_STRANG, DELTA_TOTBAND_STRANG, /* Idc1 bis Idc3 */
+    DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG, DELTA_TOTBAND_LEISTUNG /* Pdc1 bis Pdc3 */
+};
+
+/**
+ * vergleicht einen Messwert mit der Zeile, für die er stehen soll.
+ * @param zeile Messwert der Zeile.
+ * @param messwert der spätere Messwert.
+ * @return true wenn sich kein Feld um mehr als sein Totband unterscheidet.
+ */
+static bool ImTotband(s10daten const *const zeile, s10daten const *const messwert)
+{
+    for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+    {
+        int64_t const differenz = ArchivFeldLesen(messwert, archivspalten + spalte) - ArchivFeldLesen(zeile, archivspalten + spalte);
+        if (differenz > totband[spalte] || -differenz > totband[spalte]) return false;
+    }
+    return true;
+}
+
+size_t DeltaDauer(s10daten const *const daten, s10gueltig const *const gueltig, size_t const sekunde, size_t const bis)
+{
+    size_t ende = sekunde + 1;
+    /* verglichen wird immer mit der Zeile selbst, so summieren sich kleine Änderungen nicht über das Totband hinaus auf */
+    while (ende < bis && ende - sekunde < DELTA_SCHLUESSEL && Gueltig(gueltig, ende) && ImTotband(daten + sekunde, daten + ende))
+        ende++;
+    return ende - sekunde;
+}
+
+size_t DeltaOffen(s10daten const *const daten, s10gueltig const *const gueltig, size_t const von, size_t const bis)
+{
+    size_t offen = bis;
+    for (size_t sekunde = GueltigSuchen(gueltig, von, bis); sekunde < bis;)
+    {
+        size_t const dauer = DeltaDauer(daten, gueltig, sekunde, bis);
+        /* nur eine Zeile, die bis an das Ende reicht, kann mit dem nächsten Messwert noch länger werden */
+        if (sekunde + dauer == bis && dauer < DELTA_SCHLUESSEL) offen = sekunde;
+        sekunde = GueltigSuchen(gueltig, sekunde + dauer, bis);
+    }
+    return offen;
+}
@@ -0,0 +1,82 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Änderungsaufzeichnung (DELTA_MODUS): statt einer Zeile je Sekunde wird nur dann eine Zeile in die Datenbank geschrieben, wenn sich ein
+ * Feld gegenüber der letzten Zeile um mehr als sein Totband ändert, spätestens aber nach DELTA_SCHLUESSEL Sekunden (Schlüsselzeile).
+ * Die Spalte dauer gibt an, für wie viele Sekunden ab ihrem Zeitpunkt eine Zeile steht. Eine Zeile reicht nie über eine fehlende Sekunde
+ * oder das Ende der Stunde hinaus, Lücken bleiben daher auch nach dem Ausdehnen erhalten. Ohne DELTA_MODUS ist dauer immer 1.
+ *
+ * Beispiel für einen Leser, der die Zeilen einer Stunde (zeilen[i] mit sekunde[i] und dauer[i]) wieder auf 1 Hz ausdehnt:
+ *     s10daten messwerte[3600];
+ *     s10gueltig gueltig[GUELTIG_WORTE(3600)] = { 0 };
+ *     for (size_t i = 0; i < anzahl; i++)
+ *         DeltaAusdehnen(messwerte, gueltig, 3600, sekunde[i], dauer[i], zeilen + i);
+ */
+
+#include "S10daten.h" /* für s10daten und die Gültigkeit */
+
+#include <stddef.h> /* für size_t */
+#include <string.h> /* für memcpy */
+
+/**
+ * ermittelt, für wie viele Sekunden ein Messwert als Zeile steht: solange die folgenden Messwerte vorhanden sind, sich kein Feld um
+ * mehr als sein Totband vom Messwert unterscheidet und DELTA_SCHLUESSEL Sekunden nicht erreicht sind.
+ * @param Array der Messwerte der Stunde.
+ * @param Gültigkeit der Messwerte.
+ * @param Sekunde des Messwerts innerhalb der Stunde, muss gültig sein.
+ * @param erste Sekunde der Stunde, die nicht mehr betrachtet wird.
+ * @return Anzahl der Sekunden, mindestens 1.
+ */
+size_t DeltaDauer(s10daten const* const, s10gueltig const* const, size_t const, size_t const);
+
+/**
+ * ermittelt, ab welcher Sekunde die Zeilen eines Ausschnitts noch nicht feststehen, weil die letzte Zeile mit weiteren Messwerten
+ * noch länger werden könnte. Der Schreib-Thread trägt diese Zeile erst im nächsten Durchlauf ein.
+ * @param Array der Messwerte der Stunde.
+ * @param Gültigkeit der Messwerte.
+ * @param erste Sekunde des Ausschnitts.
+ * @param erste Sekunde, die noch nicht erfasst ist.
+ * @return Beginn der letzten, noch offenen Zeile oder die zweite Sekunde, falls alle Zeilen feststehen.
+ */
+size_t DeltaOffen(s10daten const* const, s10gueltig const* const, size_t const, size_t const);
+
+/**
+ * dehnt eine Zeile wieder auf die Sekunden aus, für die sie steht.
+ * @param ziel Array mit einem Platz je Sekunde.
+ * @param gueltig Gültigkeit je Sekunde, die Bits der ausgedehnten Sekunden werden gesetzt.
+ * @param sekunden Anzahl der Plätze in ziel, spätere Sekunden werden abgeschnitten.
+ * @param sekunde Sekunde der Zeile.
+ * @param dauer Spalte dauer der Zeile.
+ * @param zeile die Messwerte der Zeile.
+ * @return die Sekunde hinter der Zeile.
+ */
+static inline size_t DeltaAusdehnen(s10daten *const ziel, s10gueltig *const gueltig, size_t const sekunden, size_t const sekunde,
+                                    size_t const dauer, s10daten const *const zeile)
+{
+    size_t const ende = sekunde + dauer < sekunden ? sekunde + dauer : sekunden;
+    for (size_t i = sekunde; i < ende; i++)
+    {
+        memcpy(ziel + i, zeile, sizeof(s10daten));
+        GueltigSetzen(gueltig, i);
+    }
+    return ende;
+}
@@ -19,20 +19,47 @@
 
 #pragma once
 
+/* 1 = S10auslesen läuft dauerhaft als Dienst und behält seine Verbindungen über Stunden und Tage hinweg,
+ * 0 = S10auslesen wird stündlich per Cronjob gestartet und beendet sich nach einer Stunde */
+#define DAEMON_MODUS        0
+
 /* Adresse des S10 Hauskraftwerks, welches ausgelesen werden soll */
 #define S10_ADRESSE         "192.168.0.100"
 /* Modbus-Port, auf dem die Verbindung aufgebaut wird */
 #define S10_PORT            502
+/* weitere S10 Hauskraftwerke, die parallel im selben Prozess ausgelesen werden, als Liste { "Name", "Adresse", Port },
+ * ihre Messwerte landen in den Tabellen Name_YYYY_MM_DD (Name nur aus Buchstaben, Ziffern und _), leer = nur S10_ADRESSE auslesen */
+#define S10_WEITERE         /* { "garage", "192.168.0.101", 502 }, { "halle", "192.168.0.102", 502 } */
 
-/* so viele Lesefehler werden toleriert bevor eine Neuverbindung aufgebaut wird */
-#define LESEFEHLER_AKZEPT   60
-/* Programmabbruch wenn nach so vielen Versuchen keine neue Verbindung aufgebaut werden konnte */
+/* so viele Lesefehler in Folge werden toleriert bevor eine Neuverbindung aufgebaut wird, bei abgebrochener Verbindung wird sofort neu verbunden */
+#define LESEFEHLER_AKZEPT   5
+/* Programmabbruch wenn so viele Sekunden lang keine neue Verbindung aufgebaut werden konnte */
 #define NEUVERBIND_AKZEPT   600
+/* so lange wird höchstens auf die Antwort einer Modbus-Abfrage bzw. auf den Verbindungsaufbau gewartet, in Millisekunden. Zusammen
+ * (Lesefehler, Neuverbinden und Identifikationsdaten) müssen sie in eine Sekunde passen, damit kein Ausfall die Erfassung aufhält */
+#define MODBUS_ANTWORTZEIT  250
+#define MODBUS_VERBINDEN    250
+/* gelingt das Neuverbinden nicht, wird der Abstand der Versuche ab NEUVERBIND_MIN Sekunden jeweils verdoppelt bis höchstens
+ * NEUVERBIND_MAX Sekunden, zufällig um bis zur Hälfte verkürzt, damit mehrere Anlagen bzw. Programme nicht im Gleichtakt anklopfen */
+#define NEUVERBIND_MIN      1
+#define NEUVERBIND_MAX      30
 
 /* die Anzahl der Register mit den Identifikationsregistern, beginnend ab 0 */
 #define IDENTIFIKREGISTER   67
-/* die Anzahl der Register mit den Leistungswerten, beginnend ab IDENTIFIKREGISTER */
+/* die Anzahl der Register mit den Leistungswerten, beginnend ab IDENTIFIKREGISTER (Aufbau siehe Registerkarte in src/Register.c) */
 #define LEISTUNGSREGISTER   37
+/* zusätzliche Register, die ohne weitere Abfrage mit den Leistungswerten gelesen und in der JSON-Datei ausgegeben werden, als Liste
+ * REGISTER_S32("Name", Adresse ab 0, Teiler), auch REGISTER_U32, REGISTER_S16 und REGISTER_U16, mit eigener Periode in Sekunden als
+ * REGISTER("Name", Adresse ab 0, Bits, Vorzeichen, Teiler, Periode), leer = keine */
+#define S10_ZUSATZREGISTER  /* REGISTER_S32("Pzusatz", 40105 - 40001, 1), REGISTER_U16("Uzusatz", 40110 - 40001, 10) */
+/* so viele ungenutzte Register zwischen zwei Feldern werden mitgelesen, bevor eine weitere Abfrage gestellt wird */
+#define REGISTER_LUECKE     16
+/* alle so viele Sekunden werden Leistungen, Eigenverbrauch, Autarkie, Ladestand und Strangwerte gelesen (auch S10_ZUSATZREGISTER) */
+#define REGISTER_TAKT_LEISTUNG 1
+/* alle so viele Sekunden werden Notstrom- und EMS-Status gelesen, dazwischen gilt der zuletzt gelesene Wert */
+#define REGISTER_TAKT_STATUS 10
+/* alle so viele Sekunden werden die Zustände der Wallboxen gelesen, dazwischen gilt der zuletzt gelesene Wert */
+#define REGISTER_TAKT_WALLBOX 30
 
 /* Adresse, unter der die SQL-Datenbank erreichbar ist */
 #define SQL_ADRESSE         "localhost"
@@ -51,18 +78,119 @@
 #define LEN_TABELLENAME     48
 /* Max-Länge des Tabellenkommentars worst case 238 Zeichen */
 #define LEN_TABKOMMENTAR    256
-/* Max-Länge des SQL-Querys für die Messwerte einer Sekunde worst case: 508 Zeichen */
-#define LEN_WERTE           512
-/* Max-Länge des SQL-Querys für die Erstellung der Tabelle worst case 1292 Zeichen */
+/* Max-Länge des SQL-Querys für die Messwerte einer Sekunde worst case: 531 Zeichen (mit SQL_ZEITREIHE und DELTA_MODUS) */
+#define LEN_WERTE           544
+/* Max-Länge des SQL-Querys für die Erstellung der Tabelle worst case 1335 Zeichen (mit DELTA_MODUS) */
 #define LEN_TABELLE         1344
+/* Max-Länge des SQL-Querys für die Kennzahlen eines Zeitfensters worst case: 592 Zeichen (mit SQL_ZEITREIHE) */
+#define LEN_AGGREGAT        640
+/* Max-Länge des SQL-Querys für eine Lücke worst case: 49 Zeichen (mit SQL_ZEITREIHE) */
+#define LEN_LUECKE          64
+
+/* so viele Messwerte werden in einem mehrzeiligen INSERT zusammengefasst (max_allowed_packet beachten: LEN_WERTE je Zeile) */
+#define SQL_BLOCKZEILEN     600
 
 /* 60*60 Sekunden */
 #define NO_DATEN            3600
 
+/* alle so viele Sekunden schreibt ein Hintergrund-Thread die neuen Messwerte in die Datenbank, 0 = erst nach Ablauf der Stunde */
+#define SQL_SCHREIBINTERVALL 10
+/* nach einem Fehler beim Eintragen wird es frühestens nach so vielen Sekunden mit einer neuen SQL-Verbindung erneut versucht */
+#define SQL_WIEDERHOLEN     30
+
+/* Dateiname und Pfad des Journals, in dem jeder Messwert sofort gesichert wird bis er in der Datenbank steht (nicht auf die Ramdisk legen) */
+#define JOURNAL_FILE        "/var/lib/S10auslesen/journal.bin"
+/* 1 = Journal nach jedem Messwert mit fdatasync auf den Datenträger zwingen (schützt auch bei Stromausfall, belastet aber SD-Karten) */
+#define JOURNAL_SYNC        0
+/* ab dieser Größe in Byte wird das Journal auf die noch nicht bestätigten Messwerte eingekürzt, sobald mindestens die Hälfte bestätigt ist */
+#define JOURNAL_MAX         1048576
+/* so viele Messwerte aus dem Journal trägt der Schreib-Thread nach einem Ausfall der Datenbank je Durchlauf höchstens nach */
+#define NACHTRAG_ZEILEN     7200
+/* so viele Sekunden pausiert der Schreib-Thread zwischen zwei Durchläufen des Nachtragens */
+#define NACHTRAG_PAUSE      1
+
+/* 0 = Messwerte nicht in die SQL Datenbank schreiben (z.B. wenn nur das Archiv verwendet wird) */
+#define SQL_AKTIV           1
+/* 1 = alle Anlagen und Tage in die nach Monaten partitionierte Tabelle s10messwerte (Kennzahlen: s10kennzahlen) statt in Tagestabellen
+ * schreiben, die Anlagen stehen dann in s10anlagen und ihre Identifikationsdaten in s10geraete, Umstellung siehe tools/S10migration.c */
+#define SQL_ZEITREIHE       0
+/* 1 = nur Änderungen in die Datenbank schreiben: eine neue Zeile erst, wenn sich ein Feld um mehr als sein Totband ändert oder
+ * DELTA_SCHLUESSEL Sekunden vergangen sind, die Spalte dauer gibt an, für wie viele Sekunden eine Zeile steht (siehe src/Delta.h) */
+#define DELTA_MODUS         0
+/* spätestens nach so vielen Sekunden wird eine neue Zeile geschrieben (1 bis NO_DATEN) */
+#define DELTA_SCHLUESSEL    60
+/* um so viel W dürfen P_* und Pdc* von der letzten Zeile abweichen, ohne dass eine neue Zeile geschrieben wird, 0 = jede Änderung */
+#define DELTA_TOTBAND_LEISTUNG 0
+/* um so viel dürfen Vdc* und Idc* (in Einheiten des S10) von der letzten Zeile abweichen, alle übrigen Felder werden genau verglichen */
+#define DELTA_TOTBAND_STRANG 0
+/* Verzeichnis, in dem je Anlage und Tag eine kompakte Archivdatei (*.s10a) angelegt wird, "" = kein Archiv */
+#define ARCHIV_VERZEICHNIS  ""
+/* so viele Sekunden werden mindestens zu einem Archivblock zusammengefasst, der Rest folgt am Ende der Stunde */
+#define ARCHIV_BLOCK        60
+
+/* Verzeichnis für die Rohdaten [Name_]YYYY_MM_DD.s10r, in denen die gelesenen Register jeder Sekunde unverarbeitet abgelegt werden,
+ * z.B. "/var/lib/S10auslesen/roh", "" = keine Rohdaten */
+#define ROH_VERZEICHNIS     ""
+
+/* 1 = Minimum, Maximum, Mittelwert und Energie der Leistungen je Zeitfenster in eigene Tabellen bzw. Aggregatdateien schreiben */
+#define AGGREGATE           1
+/* Länge der drei Zeitfenster in Sekunden, jede muss NO_DATEN ohne Rest teilen */
+#define AGGREGAT_FENSTER    60, 900, 3600
+
+/* 1 = Sekunden ohne Messwert mit Beginn, Dauer und Grund in eigene Tabellen schreiben ([Name_]YYYY_MM_DD_luecken bzw. s10luecken) */
+#define LUECKEN             1
+
+/* so viele Ausgabe-Threads übernehmen JSON-Datei, Ring, Webserver und MQTT, damit die Erfassung nie auf eine Ausgabe wartet,
+ * 0 = alles direkt in der Erfassung ausgeben */
+#define AUSGABE_THREADS     1
+/* so viele Messwerte je Anlage puffert die Warteschlange zu den Ausgabe-Threads, Zweierpotenz. Ist sie voll, werden weitere Messwerte
+ * nicht ausgegeben (Metrik s10_ausgabe_verworfen_total), stehen aber weiterhin in der Datenbank bzw. im Archiv */
+#define AUSGABE_PLAETZE     64
+
 /* Dateiname und Pfad, unter dem die JSON-Datei ausgegeben werden soll */
 #define JSON_FILE           "/ram/s10daten.json"
+/* jeder Messwert wird zusätzlich als Zeile samt Erfassungszeitpunkt an diese Datei angehängt (NDJSON), "" = kein Protokoll */
+#define JSON_PROTOKOLL      ""
+/* ab dieser Größe in Bytes wird das Protokoll nach JSON_PROTOKOLL.1 verschoben und neu begonnen, etwa 4 MB je Stunde */
+#define JSON_PROTOKOLL_GROESSE (64 * 1024 * 1024)
+
+/* Name des POSIX Shared-Memory-Segments (unter Linux /dev/shm/S10auslesen), in dem die letzten Messwerte für lokale Leser bereitstehen */
+#define RING_NAME           "/S10auslesen"
+/* so viele der letzten Messwerte hält das Shared-Memory-Segment vor */
+#define RING_PLAETZE        3600
+
+/* TCP-Port des eingebauten Webservers für aktuelle Messwerte, Verlauf und Server-Sent-Events, 0 = kein Webserver */
+#define HTTP_PORT           8080
+/* Adresse, an die der Webserver gebunden wird, 127.0.0.1 = nur lokal erreichbar */
+#define HTTP_ADRESSE        "127.0.0.1"
+/* (POSIX) Unix-Socket, über den der Webserver statt über HTTP_PORT erreichbar ist, "" = TCP-Port verwenden */
+#define HTTP_SOCKET         ""
+/* so viele Clients bedient der Webserver gleichzeitig */
+#define HTTP_CLIENTS        64
+/* fällt ein Client des Ereignisstroms um mehr als so viele Messwerte zurück, springt er direkt zum neuesten Messwert */
+#define HTTP_RUECKSTAND     60
+
+/* Adresse oder Name des MQTT-Brokers (MQTT 3.1.1), an den die Messwerte aller Anlagen veröffentlicht werden, "" = kein MQTT */
+#define MQTT_ADRESSE        ""
+/* TCP-Port des MQTT-Brokers */
+#define MQTT_PORT           1883
+/* Benutzername und Passwort am Broker, "" = anonym, ein Passwort nur zusammen mit einem Benutzernamen */
+#define MQTT_BENUTZER       ""
+#define MQTT_PASSWORT       ""
+/* Anfang aller Topics: PRAEFIX[/Name]/Ppv usw. je Feld, PRAEFIX[/Name]/json mit dem ganzen Messwert, PRAEFIX/status mit online/offline */
+#define MQTT_PRAEFIX        "s10"
+/* QoS der Veröffentlichungen, 0 oder 1. Mit 1 wird der nächste Messwert erst gesendet, wenn der Broker den vorherigen bestätigt hat */
+#define MQTT_QOS            0
+/* 1 = als retained veröffentlichen, neue Abonnenten erhalten so sofort den letzten Messwert */
+#define MQTT_RETAIN         1
+/* 1 = jedes Feld zusätzlich unter einem eigenen Topic veröffentlichen, 0 = nur PRAEFIX[/Name]/json */
+#define MQTT_FELDER         1
+/* Keep-Alive der Verbindung in Sekunden */
+#define MQTT_KEEPALIVE      60
+
+/* 1 = zum Ende jeder Stunde Weckverzug, Jitter und Modbus-Latenz der Abfragen ausgeben, 0 = keine Ausgabe */
+#define ZEITSTATISTIK       0
 
-/* 100ms Raster beim Warten auf die volle Stunde */
-#define AUFLOESUNG_WART_NS  100000000
-/* 30ms Raster beim sekundengenauen Abfragen der Daten */
-#define AUFLOESUNG_LESE_NS  30000000
+/* Textdatei für den textfile-Collector des node_exporter, in welche der Schreib-Thread die Metriken schreibt,
+ * z.B. "/var/lib/node_exporter/textfile_collector/s10auslesen.prom", "" = nur über GET /metrics des Webservers */
+#define METRIK_DATEI        ""
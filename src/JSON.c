@@ -0,0 +1,210 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "JSON.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+#include "Register.h" /* für die zusätzlichen Register */
+
+#include <fcntl.h> /* für open */
+#include <stdbool.h> /* für bool */
+#include <stdio.h> /* für rename und snprintf */
+#include <string.h> /* für memcpy und strlen */
+#include <unistd.h> /* für write und close */
+
+/* Platz je zusätzlichem Register neben seinem Namen: ,"": und ein Wert mit Vorzeichen, Dezimalpunkt und 10 Ziffern */
+#define LEN_ZUSATZ          24
+
+/**
+ * schreibt eine ganze Zahl ohne printf.
+ * @param ziel hier beginnt die Zahl, Platz für mindestens 20 Zeichen.
+ * @param wert die Zahl.
+ * @return Position hinter der letzten Ziffer.
+ */
+static inline char *ZahlSchreiben(char *ziel, int64_t const wert)
+{
+    uint64_t betrag = wert < 0 ? -(uint64_t) wert : (uint64_t) wert;
+    if (wert < 0) *ziel++ = '-';
+    char ziffern[20];
+    size_t anzahl = 0;
+    do
+    {
+        ziffern[anzahl++] = (char) ('0' + betrag % 10);
+        betrag /= 10;
+    } while (0 != betrag);
+    while (anzahl > 0)
+        *ziel++ = ziffern[--anzahl];
+    return ziel;
+}
+
+/**
+ * schreibt den Wert eines zusätzlichen Registers geteilt durch seinen Teiler. Zehnerpotenzen werden exakt als Dezimalzahl ohne
+ * abschließende Nullen geschrieben, andere Teiler wie bisher mit %g.
+ * @param ziel hier beginnt der Wert, Platz für mindestens LEN_ZUSATZ Zeichen.
+ * @param wert der Rohwert.
+ * @param skala der Teiler.
+ * @return Position hinter dem Wert.
+ */
+static char *SkaliertSchreiben(char *ziel, int32_t const wert, int32_t const skala)
+{
+    if (1 == skala) return ZahlSchreiben(ziel, wert);
+
+    uint_fast8_t stellen = 0;
+    for (int32_t rest = skala; rest > 1 && 0 == rest % 10; rest /= 10)
+        stellen++;
+    int64_t zehner = 1;
+    for (uint_fast8_t i = 0; i < stellen; i++)
+        zehner *= 10;
+    if (skala != zehner) return ziel + snprintf(ziel, LEN_ZUSATZ, "%g", (double) wert / skala);
+
+    int64_t const betrag = wert < 0 ? -(int64_t) wert : wert;
+    if (wert < 0) *ziel++ = '-';
+    ziel = ZahlSchreiben(ziel, betrag / zehner);
+    int64_t nachkomma = betrag % zehner;
+    if (0 == nachkomma) return ziel;
+    for (; 0 == nachkomma % 10; nachkomma /= 10)
+        stellen--;
+    *ziel++ = '.';
+    for (char *stelle = ziel + stellen; stelle > ziel; nachkomma /= 10)
+        *--stelle = (char) ('0' + nachkomma % 10);
+    return ziel + stellen;
+}
+
+/* hängt einen Feldnamen (als Literal samt Trennzeichen) und den Wert des Felds an */
+#define FELD(name, wert)                                                                                                                                  \
+    do                                                                                                                                                    \
+    {                                                                                                                                                     \
+        memcpy(z, name, sizeof(name) - 1);                                                                                                                \
+        z = ZahlSchreiben(z + sizeof(name) - 1, wert);                                                                                                    \
+    } while (0)
+
+size_t JSONFormatieren(char *const ziel, s10daten const *const p, int64_t const zeit)
+{
+    char *z = ziel;
+    *z++ = '{';
+    if (zeit >= 0)
+    {
+        FELD("\"zeit\":", zeit);
+        *z++ = ',';
+    }
+    FELD("\"Ppv\":", p->P_pv);
+    FELD(",\"Pbat\":", p->P_bat);
+    FELD(",\"Phaus\":", p->P_haus);
+    FELD(",\"Pnetz\":", p->P_netz);
+    FELD(",\"Pext\":", p->P_ext);
+    FELD(",\"Pwbx\":", p->P_wall);
+    FELD(",\"Ppvwb\":", p->P_pvwall);
+    FELD(",\"eigen\":", p->eigen);
+    FELD(",\"autark\":", p->autarkie);
+    FELD(",\"SOC\":", p->soc);
+    FELD(",\"NOT\":", p->notstr);
+    FELD(",\"EMS\":", p->ems);
+    FELD(",\"Wb1\":", p->wall1);
+    FELD(",\"Wb2\":", p->wall2);
+    FELD(",\"Wb3\":", p->wall3);
+    FELD(",\"Wb4\":", p->wall4);
+    FELD(",\"Wb5\":", p->wall5);
+    FELD(",\"Wb6\":", p->wall6);
+    FELD(",\"Wb7\":", p->wall7);
+    FELD(",\"Wb8\":", p->wall8);
+    FELD(",\"Vdc1\":", p->Vdc1);
+    FELD(",\"Vdc2\":", p->Vdc2);
+    FELD(",\"Vdc3\":", p->Vdc3);
+    FELD(",\"Idc1\":", p->Idc1);
+    FELD(",\"Idc2\":", p->Idc2);
+    FELD(",\"Idc3\":", p->Idc3);
+    FELD(",\"Pdc1\":", p->Pdc1);
+    FELD(",\"Pdc2\":", p->Pdc2);
+    FELD(",\"Pdc3\":", p->Pdc3);
+    *z++ = '}';
+    *z = '\0';
+    return z - ziel;
+}
+
+size_t JSONZusatzAnhaengen(char *const json, size_t const laenge, size_t const groesse, int32_t const *const zusatz)
+{
+    char *z = json + laenge - 1;
+    for (size_t i = 0; i < zusatzregister; i++)
+    {
+        s10register const *const feld = registerkarte + leistungsfelder + i;
+        size_t const namenslaenge = strlen(feld->name);
+        if ((size_t) (z - json) + namenslaenge + 4 + LEN_ZUSATZ + 2 > groesse) break;
+        memcpy(z, ",\"", 2);
+        memcpy(z + 2, feld->name, namenslaenge);
+        memcpy(z + 2 + namenslaenge, "\":", 2);
+        z = SkaliertSchreiben(z + 4 + namenslaenge, zusatz[i], feld->skala);
+    }
+    *z++ = '}';
+    *z = '\0';
+    return z - json;
+}
+
+/**
+ * hängt einen Messwert als Zeile an das NDJSON-Protokoll an. Überschreitet das Protokoll JSON_PROTOKOLL_GROESSE, wird es in
+ * JSON_PROTOKOLL.1 umbenannt (eine ältere Datei wird dabei ersetzt) und neu begonnen.
+ * @param zeile die Zeile samt Zeilenumbruch.
+ * @param laenge Länge der Zeile.
+ */
+static void ProtokollAnhaengen(char const *const zeile, size_t const laenge)
+{
+    static int fd = -1;
+    static size_t groesse = 0;
+
+    if (fd >= 0 && groesse + laenge > JSON_PROTOKOLL_GROESSE)
+    {
+        close(fd);
+        fd = -1;
+        rename(JSON_PROTOKOLL, JSON_PROTOKOLL ".1");
+    }
+    if (fd < 0)
+    {
+        fd = open(JSON_PROTOKOLL, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) return;
+        off_t const ende = lseek(fd, 0, SEEK_END);
+        groesse = ende > 0 ? (size_t) ende : 0;
+    }
+    /* eine Zeile wird mit einem einzigen write angehängt, Leser sehen daher nie eine halbe Zeile zwischen zwei ganzen */
+    ssize_t const geschrieben = write(fd, zeile, laenge);
+    if (geschrieben > 0) groesse += geschrieben;
+}
+
+void ErzeugeJSON(s10daten const *const p, int32_t const *const zusatz, int64_t const zeit)
+{
+    /* nur der Ausgabe-Thread der ersten Anlage schreibt, der Puffer wird daher nur einmal angelegt */
+    static char json[LEN_JSON_ZUSATZ];
+    size_t laenge = JSONFormatieren(json, p, -1);
+    if (NULL != zusatz && 0 != zusatzregister) laenge = JSONZusatzAnhaengen(json, laenge, sizeof(json), zusatz);
+
+    /* in eine temporäre Datei schreiben und diese dann atomar an die Stelle der alten setzen, Leser sehen so immer eine vollständige Datei */
+    int const fd = open(JSON_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0)
+    {
+        bool const vollstaendig = (ssize_t) laenge == write(fd, json, laenge);
+        if (0 == close(fd) && vollstaendig) rename(JSON_FILE ".tmp", JSON_FILE);
+    }
+
+    if (sizeof(JSON_PROTOKOLL) > 1 && zeit >= 0)
+    {
+        /* das Protokoll trägt zusätzlich den Erfassungszeitpunkt: {"zeit":...,"Ppv":...} */
+        static char zeile[LEN_JSON_ZUSATZ + 32];
+        size_t zeilenlaenge = JSONFormatieren(zeile, p, zeit);
+        if (NULL != zusatz && 0 != zusatzregister) zeilenlaenge = JSONZusatzAnhaengen(zeile, zeilenlaenge, sizeof(zeile) - 1, zusatz);
+        zeile[zeilenlaenge++] = '\n';
+        ProtokollAnhaengen(zeile, zeilenlaenge);
+    }
+}
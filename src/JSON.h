@@ -0,0 +1,59 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+#include "S10daten.h" /* für s10daten */
+
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int64_t */
+
+/* Max-Länge eines Messwerts im JSON-Format worst case: 437 Zeichen (mit 19-stelligem Zeitpunkt) */
+#define LEN_JSON            512
+/* Platz für einen Messwert samt der zusätzlichen Register, was darüber hinausgeht, wird nicht ausgegeben */
+#define LEN_JSON_ZUSATZ     4096
+
+/**
+ * formatiert die Leistungsdaten als JSON-Objekt.
+ * @param Zielpuffer mit mindestens LEN_JSON Zeichen.
+ * @param die Leistungsdaten, welche formatiert werden sollen.
+ * @param Erfassungszeitpunkt in Millisekunden seit 1.1.1970 (UTC), der als "zeit" vorangestellt wird, negativ: ohne Zeitpunkt.
+ * @return Länge des JSON-Objekts ohne abschließende Null.
+ */
+size_t JSONFormatieren(char* const, s10daten const* const, int64_t const);
+
+/**
+ * hängt die zusätzlichen Register an ein mit JSONFormatieren() erzeugtes Objekt an, solange sie in den Puffer passen.
+ * @param das Objekt, die schließende Klammer wird ersetzt.
+ * @param Länge des Objekts.
+ * @param Größe des Puffers, z.B. LEN_JSON_ZUSATZ.
+ * @param Werte der zusätzlichen Register (S10_ZUSATZREGISTER).
+ * @return neue Länge des Objekts.
+ */
+size_t JSONZusatzAnhaengen(char* const, size_t const, size_t const, int32_t const* const);
+
+/**
+ * Speichert die Leistungsdaten als Datei im JSON-Format. Die Datei wird über eine temporäre Datei und rename() ersetzt, Leser sehen
+ * daher immer eine vollständige Datei. Mit JSON_PROTOKOLL wird der Messwert zusätzlich als Zeile an das NDJSON-Protokoll angehängt.
+ * Nur aus einem Thread aufrufen, die Puffer werden wiederverwendet.
+ * @param die Leistungsdaten der aktuellen Sekunde, welche als JSON-Datei ausgegeben werden sollen.
+ * @param Werte der zusätzlichen Register (S10_ZUSATZREGISTER), die mit ihrem Namen angehängt werden, NULL = ohne.
+ * @param Erfassungszeitpunkt in Millisekunden seit 1.1.1970 (UTC) für das Protokoll, negativ: nicht protokollieren.
+ */
+void ErzeugeJSON(s10daten const* const, int32_t const* const, int64_t const);
@@ -0,0 +1,356 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Journal.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <fcntl.h> /* open() und Konsorten */
+#include <pthread.h> /* Sperre zwischen Erfassung und Schreib-Thread */
+#include <stdbool.h> /* für bool */
+#include <stdio.h> /* für rename() und Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* String-Operationen */
+#include <sys/stat.h> /* Dateigröße */
+#include <unistd.h> /* write(), ftruncate() und Konsorten */
+
+/**
+ * Stand einer Anlage im Journal.
+ */
+typedef struct
+{
+    time_t letzte; /* Zeitpunkt des zuletzt angehängten Messwerts */
+    time_t bestaetigt; /* alle Messwerte bis einschließlich dieses Zeitpunkts stehen in der Datenbank */
+    size_t offen; /* Messwerte nach bestaetigt im Journal */
+} journalstand;
+
+static int journal = -1; /* Dateideskriptor des Journals */
+static journalstand *stand = NULL; /* Stand je Anlage, wächst mit der höchsten vorkommenden Anlagennummer */
+static size_t anlagen = 0; /* Anzahl der Einträge in stand */
+static size_t datensaetze = 0; /* Messwerte und Marken im Journal */
+static size_t erledigt = 0; /* davon bestätigte Messwerte und Marken, beim Einkürzen entfallen sie */
+/* schützt journal, stand und die Zähler; die Erfassung hält sie nur für das Anhängen, Lesen und Einkürzen arbeiten ohne sie */
+static pthread_mutex_t sperre = PTHREAD_MUTEX_INITIALIZER;
+/* reiht Lesen, Bestätigen und Einkürzen hintereinander, nur unter beiden Sperren wird das Journal geleert oder ausgetauscht */
+static pthread_mutex_t umbausperre = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * gibt den Stand einer Anlage zurück und legt ihn bei Bedarf an, nur unter der Sperre aufrufen.
+ * @param anlage Nummer des Hauskraftwerks in der Anlagenliste.
+ * @return der Stand der Anlage oder NULL falls kein Speicher verfügbar ist.
+ */
+static journalstand *Stand(uint32_t const anlage)
+{
+    if (anlage >= anlagen)
+    {
+        journalstand *const neu = (journalstand*) realloc(stand, (anlage + 1) * sizeof(journalstand));
+        if (NULL == neu) return NULL;
+        memset(neu + anlagen, 0, (anlage + 1 - anlagen) * sizeof(journalstand));
+        stand = neu;
+        anlagen = anlage + 1;
+    }
+    return stand + anlage;
+}
+
+/**
+ * liest das Journal bis zur aktuellen Größe in den Speicher, nur unter der Umbausperre aufrufen. Was währenddessen angehängt wird, fehlt
+ * im Ergebnis oder wird als unvollständiger Datensatz am Ende ignoriert.
+ * @param anzahl wird auf die Anzahl der gelesenen Datensätze gesetzt.
+ * @return mit malloc angelegtes Array aller Datensätze oder NULL falls das Journal leer oder nicht lesbar ist.
+ */
+static journaleintrag *JournalKomplettLesen(size_t *const anzahl)
+{
+    struct stat info;
+    *anzahl = 0;
+    if (journal < 0 || 0 != fstat(journal, &info) || info.st_size < (off_t) sizeof(journaleintrag)) return NULL;
+
+    journaleintrag *const eintraege = (journaleintrag*) malloc(info.st_size);
+    if (NULL == eintraege) return NULL;
+    ssize_t const gelesen = pread(journal, eintraege, info.st_size, 0);
+    if (gelesen < (ssize_t) sizeof(journaleintrag))
+    {
+        free(eintraege);
+        return NULL;
+    }
+    /* ein unvollständiger Datensatz am Ende (Absturz während write) wird ignoriert */
+    *anzahl = gelesen / sizeof(journaleintrag);
+    return eintraege;
+}
+
+/**
+ * kürzt das Journal auf ganze Datensätze. Ein unvollständiger Datensatz am Ende (Absturz oder volles Dateisystem während write) würde
+ * sonst alle folgenden, mit O_APPEND angehängten Datensätze verschieben.
+ */
+static void JournalAusrichten(void)
+{
+    struct stat info;
+    if (journal >= 0 && 0 == fstat(journal, &info) && 0 != info.st_size % sizeof(journaleintrag)
+        && 0 != ftruncate(journal, info.st_size - info.st_size % sizeof(journaleintrag)))
+        fprintf(stderr, "S10auslesen: unvollständiger Datensatz im Journal %s kann nicht entfernt werden\n", JOURNAL_FILE);
+}
+
+/**
+ * sortiert Journaleinträge nach Anlage und dann zeitlich aufsteigend.
+ */
+static int JournalVergleich(void const *const a, void const *const b)
+{
+    journaleintrag const *const ea = (journaleintrag const*) a;
+    journaleintrag const *const eb = (journaleintrag const*) b;
+    if (ea->anlage != eb->anlage) return (ea->anlage > eb->anlage) - (ea->anlage < eb->anlage);
+    return (ea->zeit > eb->zeit) - (ea->zeit < eb->zeit);
+}
+
+/**
+ * übernimmt die offenen Messwerte in ein neues Journal und setzt dieses atomar an die Stelle des alten, nur unter der Umbausperre aufrufen.
+ * Gelesen und geschrieben wird ohne die Sperre, die Erfassung hängt währenddessen weiter an das alte Journal an. Erst für diesen Rest,
+ * der seit dem Lesen hinzugekommen ist, und das Austauschen wird die Sperre gehalten.
+ */
+static void JournalEinkuerzen(void)
+{
+    /* der Bestätigungsstand ändert sich nur unter der Umbausperre, die Erfassung legt höchstens neue Anlagen an */
+    pthread_mutex_lock(&sperre);
+    size_t const bekannt = anlagen;
+    time_t *const grenze = (time_t*) malloc(bekannt * sizeof(time_t));
+    for (size_t i = 0; i < bekannt && NULL != grenze; i++)
+        grenze[i] = stand[i].bestaetigt;
+    pthread_mutex_unlock(&sperre);
+    size_t *const offen = (size_t*) calloc(bekannt, sizeof(size_t));
+
+    size_t anzahl = 0;
+    journaleintrag *const eintraege = NULL != grenze && NULL != offen ? JournalKomplettLesen(&anzahl) : NULL;
+    int const neu = NULL != eintraege ? open(JOURNAL_FILE ".neu", O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0640) : -1;
+    bool ok = neu >= 0;
+    size_t behalten = 0;
+    for (size_t i = 0; i < anzahl && ok; i++)
+        if (eintraege[i].zeit > 0 && eintraege[i].anlage < bekannt && eintraege[i].zeit > grenze[eintraege[i].anlage])
+        {
+            ok = sizeof(journaleintrag) == write(neu, eintraege + i, sizeof(journaleintrag));
+            offen[eintraege[i].anlage]++;
+            behalten++;
+        }
+    ok = ok && 0 == fdatasync(neu);
+    free(eintraege);
+    free(grenze);
+
+    if (ok)
+    {
+        pthread_mutex_lock(&sperre);
+        /* den seit dem Lesen angehängten Rest (wenige Messwerte, Marken schreibt nur JournalBestaetigen) unverändert übernehmen */
+        struct stat info;
+        off_t const gelesen = (off_t) anzahl * sizeof(journaleintrag);
+        ok = 0 == fstat(journal, &info) && info.st_size >= gelesen;
+        size_t const rest = ok ? (info.st_size - gelesen) / sizeof(journaleintrag) : 0;
+        journaleintrag *const neue = rest > 0 ? (journaleintrag*) malloc(rest * sizeof(journaleintrag)) : NULL;
+        if (rest > 0)
+            ok = NULL != neue && (ssize_t) (rest * sizeof(journaleintrag)) == pread(journal, neue, rest * sizeof(journaleintrag), gelesen)
+                && (ssize_t) (rest * sizeof(journaleintrag)) == write(neu, neue, rest * sizeof(journaleintrag));
+#if JOURNAL_SYNC
+        ok = ok && 0 == fdatasync(neu);
+#endif
+        if (ok && 0 == rename(JOURNAL_FILE ".neu", JOURNAL_FILE))
+        {
+            close(journal);
+            journal = neu;
+            for (size_t i = 0; i < anlagen; i++)
+                stand[i].offen = i < bekannt ? offen[i] : 0;
+            for (size_t i = 0; i < rest; i++)
+                if (neue[i].anlage < anlagen) stand[neue[i].anlage].offen++;
+            datensaetze = behalten + rest;
+            erledigt = 0;
+        }
+        else
+            ok = false;
+        pthread_mutex_unlock(&sperre);
+        free(neue);
+    }
+    if (!ok && neu >= 0)
+    {
+        close(neu);
+        fprintf(stderr, "S10auslesen: Journal %s kann nicht eingekürzt werden\n", JOURNAL_FILE);
+    }
+    free(offen);
+}
+
+int_fast8_t JournalOeffnen(void)
+{
+    journal = open(JOURNAL_FILE, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+    if (journal < 0)
+    {
+        fprintf(stderr, "S10auslesen: Journal %s kann nicht geöffnet werden\n", JOURNAL_FILE);
+        return EXIT_FAILURE;
+    }
+
+    size_t anzahl;
+    pthread_mutex_lock(&umbausperre);
+    pthread_mutex_lock(&sperre);
+    JournalAusrichten();
+    journaleintrag *const eintraege = JournalKomplettLesen(&anzahl);
+    for (size_t i = 0; i < anzahl; i++)
+    {
+        journalstand *const s = Stand(eintraege[i].anlage);
+        if (NULL == s) continue;
+        if (eintraege[i].zeit > s->letzte) s->letzte = eintraege[i].zeit;
+        if (-eintraege[i].zeit > s->bestaetigt) s->bestaetigt = -eintraege[i].zeit;
+    }
+    datensaetze = anzahl;
+    erledigt = anzahl;
+    for (size_t i = 0; i < anzahl; i++)
+        if (eintraege[i].anlage < anlagen && eintraege[i].zeit > stand[eintraege[i].anlage].bestaetigt)
+        {
+            stand[eintraege[i].anlage].offen++;
+            erledigt--;
+        }
+    pthread_mutex_unlock(&sperre);
+    pthread_mutex_unlock(&umbausperre);
+    free(eintraege);
+    return EXIT_SUCCESS;
+}
+
+void JournalAnhaengen(uint32_t const anlage, time_t const zeit, s10daten const *const daten)
+{
+    journaleintrag const eintrag = { zeit, anlage, *daten };
+
+    pthread_mutex_lock(&sperre);
+    journalstand *const s = Stand(anlage);
+    if (journal >= 0 && NULL != s)
+    {
+        if (sizeof(eintrag) == write(journal, &eintrag, sizeof(eintrag)))
+        {
+            s->letzte = zeit;
+            s->offen++;
+            datensaetze++;
+#if JOURNAL_SYNC
+            fdatasync(journal);
+#endif
+        }
+        else
+        {
+            fprintf(stderr, "S10auslesen: Messwert kann nicht ins Journal %s geschrieben werden\n", JOURNAL_FILE);
+            JournalAusrichten();
+        }
+    }
+    pthread_mutex_unlock(&sperre);
+}
+
+void JournalBestaetigen(uint32_t const anlage, time_t const bis)
+{
+    bool einkuerzen = false;
+
+    pthread_mutex_lock(&umbausperre);
+    pthread_mutex_lock(&sperre);
+    journalstand *const s = journal >= 0 ? Stand(anlage) : NULL;
+    if (NULL != s)
+    {
+        if (bis > s->bestaetigt)
+        {
+            /* je Anlage und Sekunde höchstens ein Messwert, die Schätzung ist also eher zu hoch, das Einkürzen zählt neu */
+            size_t const neu = (uint64_t) (bis - s->bestaetigt) < s->offen ? (size_t) (bis - s->bestaetigt) : s->offen;
+            s->offen -= neu;
+            erledigt += neu;
+            s->bestaetigt = bis;
+        }
+        bool alles = true;
+        for (size_t i = 0; i < anlagen && alles; i++)
+            alles = stand[i].letzte <= stand[i].bestaetigt;
+
+        if (alles)
+        {
+            /* alles in der Datenbank -> Journal leeren, O_APPEND schreibt danach wieder ab Dateianfang */
+            if (0 == ftruncate(journal, 0))
+            {
+                for (size_t i = 0; i < anlagen; i++)
+                    stand[i].offen = 0;
+                datensaetze = 0;
+                erledigt = 0;
+            }
+            else
+                fprintf(stderr, "S10auslesen: Journal %s kann nicht geleert werden\n", JOURNAL_FILE);
+        }
+        else
+        {
+            journaleintrag const marke = { -(int64_t) bis, anlage };
+            if (sizeof(marke) == write(journal, &marke, sizeof(marke)))
+            {
+                datensaetze++;
+                erledigt++;
+            }
+            else
+            {
+                fprintf(stderr, "S10auslesen: Bestätigung kann nicht ins Journal %s geschrieben werden\n", JOURNAL_FILE);
+                JournalAusrichten();
+            }
+            /* erst ab JOURNAL_MAX und wenn mindestens die Hälfte erledigt ist, so bezahlt jedes Einkürzen mit dem Platz, den es freigibt */
+            einkuerzen = datensaetze * sizeof(journaleintrag) > JOURNAL_MAX && 2 * erledigt >= datensaetze;
+        }
+    }
+    pthread_mutex_unlock(&sperre);
+    if (einkuerzen) JournalEinkuerzen();
+    pthread_mutex_unlock(&umbausperre);
+}
+
+size_t JournalLesen(journaleintrag **const offen)
+{
+    size_t anzahl;
+    size_t offene = 0;
+
+    pthread_mutex_lock(&umbausperre);
+    journaleintrag *const eintraege = JournalKomplettLesen(&anzahl);
+    pthread_mutex_unlock(&umbausperre);
+    *offen = eintraege;
+    if (NULL == eintraege) return 0;
+
+    /* Bestätigungsstand je Anlage aus den Marken bestimmen */
+    uint32_t hoechste = 0;
+    for (size_t i = 0; i < anzahl; i++)
+        if (eintraege[i].anlage > hoechste) hoechste = eintraege[i].anlage;
+    int64_t *const bestaetigt = (int64_t*) calloc((size_t) hoechste + 1, sizeof(int64_t));
+    if (NULL == bestaetigt)
+    {
+        free(eintraege);
+        *offen = NULL;
+        return 0;
+    }
+    for (size_t i = 0; i < anzahl; i++)
+        if (-eintraege[i].zeit > bestaetigt[eintraege[i].anlage]) bestaetigt[eintraege[i].anlage] = -eintraege[i].zeit;
+
+    /* offene Messwerte an den Anfang des Arrays verschieben, Marken und bestätigte Messwerte fallen dabei heraus */
+    for (size_t i = 0; i < anzahl; i++)
+        if (eintraege[i].zeit > 0 && eintraege[i].zeit > bestaetigt[eintraege[i].anlage])
+        {
+            if (i != offene) memcpy(eintraege + offene, eintraege + i, sizeof(journaleintrag));
+            offene++;
+        }
+    free(bestaetigt);
+    qsort(eintraege, offene, sizeof(journaleintrag), JournalVergleich);
+    return offene;
+}
+
+void JournalSchliessen(void)
+{
+    pthread_mutex_lock(&umbausperre);
+    pthread_mutex_lock(&sperre);
+    if (journal >= 0) close(journal);
+    journal = -1;
+    free(stand);
+    stand = NULL;
+    anlagen = 0;
+    datensaetze = 0;
+    erledigt = 0;
+    pthread_mutex_unlock(&sperre);
+    pthread_mutex_unlock(&umbausperre);
+}
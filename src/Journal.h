@@ -0,0 +1,70 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+#include "S10daten.h" /* für s10daten */
+
+#include <stdint.h> /* für int64_t und Konsorten */
+#include <time.h> /* für time_t */
+
+/**
+ * ein Datensatz im Journal: ein Messwert mit seinem Zeitstempel oder eine Bestätigungsmarke.
+ */
+typedef struct
+{
+    int64_t const zeit; /* Sekunden seit 1.1.1970 (UTC), negativ: alle Messwerte der Anlage bis einschließlich -zeit stehen in der Datenbank */
+    uint32_t const anlage; /* Nummer des Hauskraftwerks in der Anlagenliste, 0 = S10_ADRESSE */
+    s10daten const daten;
+} journaleintrag;
+
+/**
+ * öffnet das Journal zum Anhängen und legt es ggfs. neu an.
+ * @return EXIT_SUCCESS wenn das Journal geöffnet werden konnte, sonst EXIT_FAILURE.
+ */
+int_fast8_t JournalOeffnen(void);
+
+/**
+ * hängt einen Messwert an das Journal an. Darf parallel zu JournalBestaetigen() und aus mehreren Threads aufgerufen werden.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param Zeitpunkt des Messwerts in Sekunden seit 1.1.1970 (UTC).
+ * @param der Messwert.
+ */
+void JournalAnhaengen(uint32_t const, time_t const, s10daten const* const);
+
+/**
+ * vermerkt im Journal, dass alle Messwerte einer Anlage bis einschließlich des übergebenen Zeitpunkts in der Datenbank stehen.
+ * Sind damit alle Messwerte aller Anlagen bestätigt, wird das Journal geleert, ansonsten ab JOURNAL_MAX auf die offenen Messwerte eingekürzt,
+ * sobald mindestens die Hälfte seiner Datensätze bestätigt ist. Die Erfassung wird dabei nur für den Austausch der Datei aufgehalten.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param Zeitpunkt in Sekunden seit 1.1.1970 (UTC), bis zu dem die Messwerte eingetragen sind.
+ */
+void JournalBestaetigen(uint32_t const, time_t const);
+
+/**
+ * liest alle noch nicht bestätigten Messwerte aus dem Journal, z.B. nach einem Absturz oder Neustart, ohne JournalAnhaengen() aufzuhalten.
+ * @param Zeiger, der auf das mit malloc angelegte, nach Anlage und dann zeitlich aufsteigend sortierte Array gesetzt wird, welches der Aufrufer freigeben muss.
+ * @return Anzahl der offenen Messwerte im Array.
+ */
+size_t JournalLesen(journaleintrag** const);
+
+/**
+ * schließt das Journal.
+ */
+void JournalSchliessen(void);
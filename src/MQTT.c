@@ -0,0 +1,609 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "MQTT.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+#include "JSON.h" /* Formatierung der Messwerte */
+#include "Metriken.h" /* für gesendete und ersetzte Messwerte */
+#include "Register.h" /* für die Anzahl der zusätzlichen Register */
+
+#include <errno.h> /* für EAGAIN und EINPROGRESS */
+#include <netdb.h> /* für getaddrinfo */
+#include <netinet/in.h> /* für IPPROTO_TCP */
+#include <netinet/tcp.h> /* für TCP_NODELAY */
+#include <pthread.h> /* für den MQTT-Thread */
+#include <stdatomic.h> /* für das Beenden des Threads */
+#include <stdbool.h> /* für bool */
+#include <stdio.h> /* für String-Formatierung und Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* String-Operationen */
+#include <sys/epoll.h> /* für epoll */
+#include <sys/eventfd.h> /* Benachrichtigung durch die Ausgabe-Threads */
+#include <sys/socket.h> /* für den Socket */
+#include <time.h> /* für clock_gettime */
+#include <unistd.h> /* für read(), write() und close() */
+
+/* Größe des Sendepuffers, ein Messwert mit allen Feldern unter eigenen Topics belegt etwa 2 kB */
+#define LEN_MQTT_AUSGANG    65536
+/* Größe des Empfangspuffers, vom Broker kommen nur kurze Bestätigungen */
+#define LEN_MQTT_EINGANG    256
+/* Max-Länge eines Topics */
+#define LEN_TOPIC           128
+/* gelingt das Verbinden nicht, wird der Abstand der Versuche bis auf so viele Sekunden verdoppelt */
+#define MQTT_WARTEZEIT_MAX  30
+
+/* Pakettypen im ersten Byte des festen Kopfs (MQTT 3.1.1, Abschnitt 2.2.1) */
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH        0x30
+#define MQTT_PUBACK         0x40
+#define MQTT_PINGREQ        0xc0
+#define MQTT_DISCONNECT     0xe0
+
+/* QoS 2 braucht einen Zustand je Nachricht über vier Pakete, für einen ohnehin jede Sekunde ersetzten Messwert lohnt das nicht */
+#if MQTT_QOS < 0 || MQTT_QOS > 1
+#error MQTT_QOS muss 0 oder 1 sein
+#endif
+/* MQTT 3.1.1 verbietet ein Passwort ohne Benutzernamen (MQTT-3.1.2-22), der Broker würde jede Verbindung abweisen */
+_Static_assert(sizeof(MQTT_BENUTZER) > 1 || sizeof(MQTT_PASSWORT) <= 1, "MQTT_PASSWORT braucht einen MQTT_BENUTZER");
+
+typedef enum
+{
+    GETRENNT, /* keine Verbindung, der nächste Versuch folgt ab naechsterVersuch */
+    VERBINDEN, /* TCP-Verbindung wird nicht-blockierend aufgebaut */
+    ANMELDEN, /* CONNECT ist gesendet, CONNACK steht aus */
+    VERBUNDEN /* Messwerte werden veröffentlicht */
+} mqttzustand;
+
+/**
+ * neuester Messwert einer Anlage.
+ */
+typedef struct
+{
+    char praefix[LEN_TOPIC]; /* MQTT_PRAEFIX[/Name] */
+    s10daten daten;
+    int64_t zeit; /* Erfassungszeitpunkt in Millisekunden */
+    uint64_t nummer; /* zählt die übergebenen Messwerte */
+    uint64_t gesendet; /* Nummer des zuletzt in den Sendepuffer übernommenen Messwerts */
+} mqttanlage;
+
+static mqttanlage *anlagen = NULL;
+static int32_t *zusatzwerte = NULL; /* je Anlage zusatzregister Werte */
+static int32_t *zusatzkopie = NULL; /* Werte der Anlage, die gerade kodiert wird */
+static size_t anzahl = 0;
+static pthread_mutex_t sperre = PTHREAD_MUTEX_INITIALIZER; /* schützt anlagen und zusatzwerte */
+static int sock = -1; /* Verbindung zum Broker */
+static int ereignis = -1; /* eventfd, über das die Ausgabe-Threads neue Messwerte melden */
+static int epollfd = -1;
+static atomic_bool anhalten = false;
+static pthread_t thread;
+static char statustopic[LEN_TOPIC]; /* MQTT_PRAEFIX/status */
+
+/* die folgenden Variablen verwendet nur der MQTT-Thread */
+static mqttzustand zustand = GETRENNT;
+static bool schreibbereit = false; /* EPOLLOUT ist angemeldet */
+static char ausgang[LEN_MQTT_AUSGANG];
+static size_t ausgangStart = 0; /* erstes noch nicht gesendetes Zeichen */
+static size_t ausgangEnde = 0;
+static uint8_t eingang[LEN_MQTT_EINGANG];
+static size_t eingangLaenge = 0;
+static uint16_t paketnummer = 0;
+static size_t unbestaetigt = 0; /* QoS 1: gesendete PUBLISH ohne PUBACK */
+static bool pingOffen = false; /* PINGREQ ist gesendet, seitdem kam nichts vom Broker */
+static time_t letzterEmpfang = 0; /* in Sekunden von CLOCK_MONOTONIC */
+static time_t naechsterVersuch = 0;
+static uint32_t wartezeit = 1; /* Abstand zum nächsten Verbindungsversuch, falls dieser scheitert */
+static unsigned int zufall; /* für rand_r() */
+
+/**
+ * @return Sekunden von CLOCK_MONOTONIC, unabhängig vom Stellen der Uhr.
+ */
+static time_t Sekunden(void)
+{
+    struct timespec jetzt;
+    clock_gettime(CLOCK_MONOTONIC, &jetzt);
+    return jetzt.tv_sec;
+}
+
+/**
+ * trennt die Verbindung zum Broker, verwirft den Sendepuffer und plant den nächsten Versuch mit wachsendem, zufällig verkürztem Abstand.
+ */
+static void Trennen(void)
+{
+    if (sock >= 0)
+    {
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, sock, NULL);
+        close(sock);
+    }
+    sock = -1;
+    zustand = GETRENNT;
+    ausgangStart = ausgangEnde = eingangLaenge = 0;
+    unbestaetigt = 0;
+    pingOffen = false;
+    naechsterVersuch = Sekunden() + wartezeit - rand_r(&zufall) % (wartezeit / 2 + 1);
+    wartezeit = 2 * wartezeit < MQTT_WARTEZEIT_MAX ? 2 * wartezeit : MQTT_WARTEZEIT_MAX;
+}
+
+/**
+ * schreibt die Restlänge eines Pakets (1 bis 4 Bytes zu je 7 Bit).
+ * @param ziel hier beginnt die Restlänge.
+ * @param laenge die Restlänge.
+ * @return Position hinter der Restlänge.
+ */
+static uint8_t *LaengeSchreiben(uint8_t *ziel, size_t laenge)
+{
+    do
+    {
+        *ziel = laenge & 0x7f;
+        laenge >>= 7;
+        if (laenge > 0) *ziel |= 0x80;
+        ziel++;
+    } while (laenge > 0);
+    return ziel;
+}
+
+/**
+ * schreibt eine Zeichenkette mit vorangestellter 16-Bit-Länge.
+ * @param ziel hier beginnt die Zeichenkette.
+ * @param text die Zeichenkette.
+ * @param laenge ihre Länge.
+ * @return Position hinter der Zeichenkette.
+ */
+static uint8_t *TextSchreiben(uint8_t *ziel, char const *const text, size_t const laenge)
+{
+    *ziel++ = laenge >> 8;
+    *ziel++ = laenge & 0xff;
+    memcpy(ziel, text, laenge);
+    return ziel + laenge;
+}
+
+/**
+ * hängt ein PUBLISH an den Sendepuffer an.
+ * @param topic das Topic.
+ * @param topiclaenge Länge des Topics.
+ * @param nutzlast die Nutzlast.
+ * @param nutzlaenge Länge der Nutzlast.
+ * @param retain true = der Broker hält die Nachricht für neue Abonnenten vor.
+ * @return false wenn der Sendepuffer zu voll ist.
+ */
+static bool PublishAnhaengen(char const *const topic, size_t const topiclaenge, char const *const nutzlast, size_t const nutzlaenge,
+                             bool const retain)
+{
+    size_t const rest = 2 + topiclaenge + (MQTT_QOS > 0 ? 2 : 0) + nutzlaenge;
+    if (LEN_MQTT_AUSGANG - ausgangEnde < 5 + rest) return false;
+
+    uint8_t *z = (uint8_t*) ausgang + ausgangEnde;
+    *z++ = MQTT_PUBLISH | MQTT_QOS << 1 | (retain ? 1 : 0);
+    z = TextSchreiben(LaengeSchreiben(z, rest), topic, topiclaenge);
+    if (MQTT_QOS > 0)
+    {
+        if (0 == ++paketnummer) paketnummer = 1; /* 0 ist keine gültige Paketnummer */
+        *z++ = paketnummer >> 8;
+        *z++ = paketnummer & 0xff;
+        unbestaetigt++;
+    }
+    memcpy(z, nutzlast, nutzlaenge);
+    ausgangEnde = (char*) z + nutzlaenge - ausgang;
+    return true;
+}
+
+/**
+ * hängt ein PUBLISH unter PRAEFIX/name an den Sendepuffer an.
+ * @param praefix Anfang des Topics.
+ * @param name Ende des Topics.
+ * @param namenslaenge Länge des Endes.
+ * @param nutzlast die Nutzlast.
+ * @param nutzlaenge Länge der Nutzlast.
+ * @return false wenn der Sendepuffer zu voll ist.
+ */
+static bool TopicAnhaengen(char const *const praefix, char const *const name, size_t const namenslaenge, char const *const nutzlast,
+                           size_t const nutzlaenge)
+{
+    char topic[LEN_TOPIC];
+    int const topiclaenge = snprintf(topic, sizeof(topic), "%s/%.*s", praefix, (int) namenslaenge, name);
+    if (topiclaenge < 0 || (size_t) topiclaenge >= sizeof(topic)) return true; /* zu langes Topic: das Feld wird übergangen */
+    return PublishAnhaengen(topic, topiclaenge, nutzlast, nutzlaenge, MQTT_RETAIN);
+}
+
+/**
+ * übernimmt die neuen Messwerte aller Anlagen in den Sendepuffer, je Messwert PRAEFIX/json und mit MQTT_FELDER jedes Feld einzeln.
+ * Passt ein Messwert nicht mehr in den Sendepuffer, bleibt er für den nächsten Durchlauf stehen.
+ */
+static void MesswerteAnhaengen(void)
+{
+    char json[LEN_JSON_ZUSATZ];
+    s10daten daten;
+    for (size_t a = 0; a < anzahl; a++)
+    {
+        mqttanlage *const anlage = anlagen + a;
+        pthread_mutex_lock(&sperre);
+        uint64_t const nummer = anlage->nummer;
+        int64_t const zeit = anlage->zeit;
+        if (nummer != anlage->gesendet)
+        {
+            memcpy(&daten, &anlage->daten, sizeof(s10daten));
+            memcpy(zusatzkopie, zusatzwerte + a * zusatzregister, zusatzregister * sizeof(int32_t));
+        }
+        pthread_mutex_unlock(&sperre);
+        if (nummer == anlage->gesendet) continue;
+
+        size_t laenge = JSONFormatieren(json, &daten, zeit);
+        if (0 != zusatzregister) laenge = JSONZusatzAnhaengen(json, laenge, sizeof(json), zusatzkopie);
+
+        size_t const ende = ausgangEnde;
+        size_t const offen = unbestaetigt;
+        bool passt = TopicAnhaengen(anlage->praefix, "json", 4, json, laenge);
+        /* die Felder werden direkt aus dem JSON-Objekt {"name":wert,...} genommen, so stimmen Namen und Werte mit ihm überein */
+        for (char const *p = json + 1; MQTT_FELDER && passt && '"' == *p;)
+        {
+            char const *const name = p + 1;
+            char const *const nameEnde = strchr(name, '"');
+            char const *const wert = nameEnde + 2;
+            size_t const wertlaenge = strcspn(wert, ",}");
+            if (4 != nameEnde - name || 0 != memcmp(name, "zeit", 4)) passt = TopicAnhaengen(anlage->praefix, name, nameEnde - name, wert, wertlaenge);
+            p = wert + wertlaenge;
+            if (',' == *p) p++;
+        }
+        if (!passt)
+        {
+            ausgangEnde = ende;
+            unbestaetigt = offen;
+            break;
+        }
+
+        pthread_mutex_lock(&sperre);
+        anlage->gesendet = nummer;
+        pthread_mutex_unlock(&sperre);
+        MetrikMQTT(a, true);
+    }
+}
+
+/**
+ * sendet den Sendepuffer, soweit der Socket ihn annimmt, und meldet für den Rest EPOLLOUT an.
+ */
+static void AusgangSenden(void)
+{
+    while (ausgangStart < ausgangEnde)
+    {
+        ssize_t const gesendet = send(sock, ausgang + ausgangStart, ausgangEnde - ausgangStart, MSG_NOSIGNAL);
+        if (gesendet > 0)
+            ausgangStart += gesendet;
+        else if (gesendet < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+            break;
+        else
+        {
+            Trennen();
+            return;
+        }
+    }
+    if (ausgangStart == ausgangEnde) ausgangStart = ausgangEnde = 0;
+
+    bool const rest = ausgangEnde > 0;
+    if (rest != schreibbereit)
+    {
+        struct epoll_event anmeldung = { .events = EPOLLIN | EPOLLRDHUP | (rest ? EPOLLOUT : 0), .data.ptr = &sock };
+        epoll_ctl(epollfd, EPOLL_CTL_MOD, sock, &anmeldung);
+        schreibbereit = rest;
+    }
+}
+
+/**
+ * hängt das CONNECT mit sauberer Sitzung, Keep-Alive, Testament (PRAEFIX/status offline) und ggfs. Benutzer und Passwort an.
+ */
+static void ConnectAnhaengen(void)
+{
+    char kennung[32];
+    int const kennungslaenge = snprintf(kennung, sizeof(kennung), "S10auslesen-%d", (int) getpid());
+    size_t const statuslaenge = strlen(statustopic);
+    size_t const rest = 10 + 2 + kennungslaenge + 2 + statuslaenge + 2 + 7 + (sizeof(MQTT_BENUTZER) > 1 ? 2 + sizeof(MQTT_BENUTZER) - 1 : 0)
+                        + (sizeof(MQTT_PASSWORT) > 1 ? 2 + sizeof(MQTT_PASSWORT) - 1 : 0);
+    if (LEN_MQTT_AUSGANG - ausgangEnde < 5 + rest) return;
+
+    uint8_t *z = (uint8_t*) ausgang + ausgangEnde;
+    *z++ = MQTT_CONNECT;
+    z = TextSchreiben(LaengeSchreiben(z, rest), "MQTT", 4);
+    *z++ = 4; /* Protokollstufe 3.1.1 */
+    /* saubere Sitzung, Testament mit QoS MQTT_QOS und retained, Benutzer und Passwort */
+    *z++ = 0x02 | 0x04 | MQTT_QOS << 3 | 0x20 | (sizeof(MQTT_BENUTZER) > 1 ? 0x80 : 0) | (sizeof(MQTT_PASSWORT) > 1 ? 0x40 : 0);
+    *z++ = MQTT_KEEPALIVE >> 8;
+    *z++ = MQTT_KEEPALIVE & 0xff;
+    z = TextSchreiben(z, kennung, kennungslaenge);
+    z = TextSchreiben(z, statustopic, statuslaenge);
+    z = TextSchreiben(z, "offline", 7);
+    if (sizeof(MQTT_BENUTZER) > 1) z = TextSchreiben(z, MQTT_BENUTZER, sizeof(MQTT_BENUTZER) - 1);
+    if (sizeof(MQTT_PASSWORT) > 1) z = TextSchreiben(z, MQTT_PASSWORT, sizeof(MQTT_PASSWORT) - 1);
+    ausgangEnde = (char*) z - ausgang;
+}
+
+/**
+ * wertet die vollständig empfangenen Pakete des Brokers aus: CONNACK, PUBACK und PINGRESP.
+ */
+static void PaketeAuswerten(void)
+{
+    size_t position = 0;
+    while (eingangLaenge - position >= 2)
+    {
+        /* Restlänge lesen, sie kann noch unvollständig sein */
+        size_t rest = 0, kopf = 1;
+        bool vollstaendig = false;
+        for (uint_fast8_t stelle = 0; stelle < 4 && position + kopf < eingangLaenge; stelle++)
+        {
+            uint8_t const byte = eingang[position + kopf++];
+            rest |= (size_t) (byte & 0x7f) << 7 * stelle;
+            if (0 == (byte & 0x80))
+            {
+                vollstaendig = true;
+                break;
+            }
+        }
+        if (!vollstaendig && kopf < 5) break;
+        if (!vollstaendig || kopf + rest > sizeof(eingang))
+        {
+            Trennen(); /* ein so großes Paket erwartet S10auslesen nicht */
+            return;
+        }
+        if (eingangLaenge - position < kopf + rest) break;
+
+        uint8_t const typ = eingang[position] & 0xf0;
+        uint8_t const *const inhalt = eingang + position + kopf;
+        if (MQTT_CONNACK == typ)
+        {
+            if (ANMELDEN != zustand || rest < 2 || 0 != inhalt[1])
+            {
+                fprintf(stderr, "S10auslesen: MQTT-Broker %s lehnt die Verbindung ab (%u)\n", MQTT_ADRESSE, rest >= 2 ? inhalt[1] : 255u);
+                Trennen();
+                return;
+            }
+            zustand = VERBUNDEN;
+            wartezeit = 1;
+            PublishAnhaengen(statustopic, strlen(statustopic), "online", 6, true);
+        }
+        else if (MQTT_PUBACK == typ && unbestaetigt > 0)
+            unbestaetigt--;
+        position += kopf + rest;
+    }
+    memmove(eingang, eingang + position, eingangLaenge - position);
+    eingangLaenge -= position;
+}
+
+/**
+ * liest alles, was der Broker gesendet hat.
+ */
+static void EingangLesen(void)
+{
+    for (;;)
+    {
+        ssize_t const gelesen = recv(sock, eingang + eingangLaenge, sizeof(eingang) - eingangLaenge, 0);
+        if (gelesen > 0)
+        {
+            eingangLaenge += gelesen;
+            letzterEmpfang = Sekunden();
+            pingOffen = false;
+            PaketeAuswerten();
+            if (sock < 0) return;
+        }
+        else if (gelesen < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+            return;
+        else
+        {
+            Trennen(); /* vom Broker getrennt */
+            return;
+        }
+    }
+}
+
+/**
+ * beginnt den nicht-blockierenden Aufbau der TCP-Verbindung zum Broker.
+ */
+static void VerbindenStarten(void)
+{
+    struct addrinfo const hinweis = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *adressen = NULL;
+    char port[8];
+    snprintf(port, sizeof(port), "%d", MQTT_PORT);
+    if (0 != getaddrinfo(MQTT_ADRESSE, port, &hinweis, &adressen))
+    {
+        Trennen();
+        return;
+    }
+
+    sock = socket(adressen->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct epoll_event anmeldung = { .events = EPOLLIN | EPOLLRDHUP | EPOLLOUT, .data.ptr = &sock };
+    if (sock >= 0 && (0 == connect(sock, adressen->ai_addr, adressen->ai_addrlen) || EINPROGRESS == errno)
+        && 0 == epoll_ctl(epollfd, EPOLL_CTL_ADD, sock, &anmeldung))
+    {
+        int const ja = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &ja, sizeof(ja));
+        zustand = VERBINDEN;
+        schreibbereit = true;
+        letzterEmpfang = Sekunden();
+    }
+    else
+        Trennen();
+    freeaddrinfo(adressen);
+}
+
+/**
+ * schließt den Aufbau der TCP-Verbindung ab und meldet sich mit CONNECT beim Broker an.
+ */
+static void Verbunden(void)
+{
+    int fehler = 0;
+    socklen_t laenge = sizeof(fehler);
+    if (0 != getsockopt(sock, SOL_SOCKET, SO_ERROR, &fehler, &laenge) || 0 != fehler)
+    {
+        Trennen();
+        return;
+    }
+    zustand = ANMELDEN;
+    ConnectAnhaengen();
+    AusgangSenden();
+}
+
+/**
+ * Hauptschleife des MQTT-Threads: verbindet sich mit dem Broker, veröffentlicht die neuesten Messwerte, sobald der vorherige Messwert
+ * abgenommen ist, und hält die Verbindung mit PINGREQ am Leben. Zum Ende werden die letzten Messwerte und der Status offline gesendet.
+ * @param arg unbenutzt.
+ * @return NULL
+ */
+static void *MQTTThread(void *const arg)
+{
+    (void) arg;
+    struct epoll_event ereignisse[4];
+
+    while (!atomic_load(&anhalten))
+    {
+        time_t const jetzt = Sekunden();
+        if (GETRENNT == zustand && jetzt >= naechsterVersuch) VerbindenStarten();
+        /* ohne jede Antwort des Brokers innerhalb des Keep-Alive gilt die Verbindung als verloren */
+        if (GETRENNT != zustand && jetzt - letzterEmpfang > MQTT_KEEPALIVE)
+            Trennen();
+        else if (VERBUNDEN == zustand && !pingOffen && jetzt - letzterEmpfang >= MQTT_KEEPALIVE / 2 && LEN_MQTT_AUSGANG - ausgangEnde >= 2)
+        {
+            ausgang[ausgangEnde++] = (char) MQTT_PINGREQ;
+            ausgang[ausgangEnde++] = 0;
+            pingOffen = true;
+            AusgangSenden();
+        }
+
+        int const anzahlEreignisse = epoll_wait(epollfd, ereignisse, sizeof(ereignisse) / sizeof(ereignisse[0]), 1000);
+        for (int i = 0; i < anzahlEreignisse; i++)
+        {
+            if (&ereignis == ereignisse[i].data.ptr)
+            {
+                uint64_t zaehler;
+                if (sizeof(zaehler) != read(ereignis, &zaehler, sizeof(zaehler))) continue;
+            }
+            else if (sock >= 0)
+            {
+                if (ereignisse[i].events & (EPOLLERR | EPOLLHUP))
+                    Trennen();
+                else if (VERBINDEN == zustand)
+                {
+                    if (ereignisse[i].events & EPOLLOUT) Verbunden();
+                }
+                else
+                {
+                    if (ereignisse[i].events & (EPOLLIN | EPOLLRDHUP)) EingangLesen();
+                    if (sock >= 0 && (ereignisse[i].events & EPOLLOUT)) AusgangSenden();
+                }
+            }
+        }
+
+        /* erst wenn der Broker den vorherigen Messwert abgenommen hat, sonst ersetzen neue Messwerte den wartenden */
+        if (VERBUNDEN == zustand)
+        {
+            if (0 == ausgangEnde && 0 == unbestaetigt) MesswerteAnhaengen();
+            AusgangSenden();
+        }
+    }
+
+    if (VERBUNDEN == zustand)
+    {
+        if (0 == ausgangEnde && 0 == unbestaetigt) MesswerteAnhaengen();
+        PublishAnhaengen(statustopic, strlen(statustopic), "offline", 7, true);
+        if (LEN_MQTT_AUSGANG - ausgangEnde >= 2)
+        {
+            ausgang[ausgangEnde++] = (char) MQTT_DISCONNECT;
+            ausgang[ausgangEnde++] = 0;
+        }
+        /* höchstens eine Sekunde auf einen langsamen Broker warten */
+        for (uint_fast8_t versuch = 0; versuch < 10 && sock >= 0 && ausgangEnde > 0; versuch++)
+        {
+            AusgangSenden();
+            if (sock >= 0 && ausgangEnde > 0) epoll_wait(epollfd, ereignisse, sizeof(ereignisse) / sizeof(ereignisse[0]), 100);
+        }
+    }
+    if (sock >= 0) close(sock);
+    sock = -1;
+    return NULL;
+}
+
+int_fast8_t MQTTStarten(char const *const *const namen, size_t const anlagenzahl)
+{
+    if (sizeof(MQTT_ADRESSE) <= 1) return EXIT_SUCCESS;
+
+    anlagen = (mqttanlage*) calloc(anlagenzahl, sizeof(mqttanlage));
+    zusatzwerte = (int32_t*) calloc(anlagenzahl * zusatzregister + 1, sizeof(int32_t));
+    zusatzkopie = (int32_t*) calloc(zusatzregister + 1, sizeof(int32_t));
+    ereignis = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (NULL != anlagen)
+        for (size_t a = 0; a < anlagenzahl; a++)
+            snprintf(anlagen[a].praefix, sizeof(anlagen[a].praefix), "%s%s%s", MQTT_PRAEFIX, '\0' == *namen[a] ? "" : "/", namen[a]);
+    snprintf(statustopic, sizeof(statustopic), "%s/status", MQTT_PRAEFIX);
+    zufall = (unsigned int) getpid() ^ (unsigned int) time(NULL);
+
+    /* vor dem Start des Threads, pthread_create() macht den Wert dann auch für ihn sichtbar */
+    anzahl = anlagenzahl;
+    struct epoll_event anmeldungEreignis = { .events = EPOLLIN, .data.ptr = &ereignis };
+    if (NULL != anlagen && NULL != zusatzwerte && NULL != zusatzkopie && ereignis >= 0 && epollfd >= 0
+        && 0 == epoll_ctl(epollfd, EPOLL_CTL_ADD, ereignis, &anmeldungEreignis) && 0 == pthread_create(&thread, NULL, MQTTThread, NULL))
+        return EXIT_SUCCESS;
+
+    fprintf(stderr, "S10auslesen: MQTT-Ausgabe kann nicht gestartet werden\n");
+    anzahl = 0;
+    if (ereignis >= 0) close(ereignis);
+    if (epollfd >= 0) close(epollfd);
+    free(zusatzkopie);
+    free(zusatzwerte);
+    free(anlagen);
+    ereignis = epollfd = -1;
+    zusatzkopie = zusatzwerte = NULL;
+    anlagen = NULL;
+    return EXIT_FAILURE;
+}
+
+void MQTTVeroeffentlichen(uint32_t const anlage, s10daten const *const daten, int32_t const *const zusatz, int64_t const zeit)
+{
+    if (anlage >= anzahl) return;
+
+    mqttanlage *const ziel = anlagen + anlage;
+    pthread_mutex_lock(&sperre);
+    bool const ersetzt = ziel->nummer != ziel->gesendet;
+    memcpy(&ziel->daten, daten, sizeof(s10daten));
+    if (NULL != zusatz) memcpy(zusatzwerte + anlage * zusatzregister, zusatz, zusatzregister * sizeof(int32_t));
+    ziel->zeit = zeit;
+    ziel->nummer++;
+    pthread_mutex_unlock(&sperre);
+    if (ersetzt) MetrikMQTT(anlage, false);
+
+    uint64_t const eins = 1;
+    if (sizeof(eins) != write(ereignis, &eins, sizeof(eins))) return; /* Zähler voll: der MQTT-Thread ist ohnehin schon geweckt */
+}
+
+void MQTTBeenden(void)
+{
+    if (NULL == anlagen) return;
+
+    atomic_store(&anhalten, true);
+    uint64_t const eins = 1;
+    if (sizeof(eins) != write(ereignis, &eins, sizeof(eins))) fprintf(stderr, "S10auslesen: MQTT-Thread nicht geweckt\n");
+    pthread_join(thread, NULL);
+
+    anzahl = 0;
+    close(ereignis);
+    close(epollfd);
+    free(zusatzkopie);
+    free(zusatzwerte);
+    free(anlagen);
+    ereignis = epollfd = -1;
+    zusatzkopie = zusatzwerte = NULL;
+    anlagen = NULL;
+}
@@ -0,0 +1,57 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * MQTT-Ausgabe (MQTT 3.1.1) der Messwerte aller Anlagen. Ein eigener Thread hält die Verbindung zum Broker nicht-blockierend über epoll,
+ * die Ausgabe-Threads legen jeden Messwert nur als neuesten Wert ihrer Anlage ab und wecken ihn über ein eventfd.
+ *   PRAEFIX[/Name]/json       der ganze Messwert als JSON-Objekt samt Erfassungszeitpunkt "zeit" in Millisekunden
+ *   PRAEFIX[/Name]/Ppv usw.   jedes Feld einzeln (MQTT_FELDER), Namen wie in der JSON-Datei
+ *   PRAEFIX/status            online bzw. offline, auch als Testament bei Verbindungsabbruch
+ * Alle Topics eines Messwerts gehen in einem Stück hinaus. Solange der Broker den vorherigen Messwert noch nicht abgenommen (bzw. mit
+ * QoS 1 bestätigt) hat, werden neue Messwerte nicht eingereiht, sondern ersetzen den wartenden, gesendet wird immer der neueste.
+ */
+
+#include "S10daten.h" /* für s10daten */
+
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int_fast8_t */
+
+/**
+ * startet den MQTT-Thread, der sich mit dem Broker verbindet und bei Verbindungsverlust selbst neu verbindet.
+ * @param Namen der Hauskraftwerke, die nach MQTT_PRAEFIX in die Topics eingefügt werden, "" = ohne Namen.
+ * @param Anzahl der Hauskraftwerke.
+ * @return EXIT_SUCCESS wenn der MQTT-Thread läuft oder MQTT abgeschaltet ist, sonst EXIT_FAILURE.
+ */
+int_fast8_t MQTTStarten(char const* const* const, size_t const);
+
+/**
+ * übergibt einen Messwert zum Veröffentlichen, ein noch nicht gesendeter Messwert derselben Anlage wird dabei ersetzt.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param der Messwert.
+ * @param Werte der zusätzlichen Register (S10_ZUSATZREGISTER).
+ * @param Erfassungszeitpunkt in Millisekunden seit 1.1.1970 (UTC).
+ */
+void MQTTVeroeffentlichen(uint32_t const, s10daten const* const, int32_t const* const, int64_t const);
+
+/**
+ * sendet die letzten Messwerte und den Status offline, trennt die Verbindung und wartet auf das Ende des MQTT-Threads.
+ */
+void MQTTBeenden(void);
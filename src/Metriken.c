@@ -0,0 +1,309 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Metriken.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <inttypes.h> /* für PRIuFAST64 */
+#include <stdarg.h> /* für va_list */
+#include <stdatomic.h> /* für die Zähler */
+#include <stddef.h> /* für offsetof */
+#include <stdio.h> /* für String-Formatierung und Dateioperation */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* für strlen */
+
+/* Obergrenzen der Histogramm-Eimer in Mikrosekunden, darüber zählt nur noch +Inf */
+static int64_t const eimergrenzen[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000 };
+#define EIMER               (sizeof(eimergrenzen) / sizeof(eimergrenzen[0]))
+/* Reserve beim Anlegen des Metriken-Puffers für Zähler, die bis zum Formatieren noch um eine Stelle wachsen */
+#define RESERVE_METRIKEN    1024
+
+/**
+ * Histogramm einer Dauer, die Eimer zählen einzeln und werden erst beim Formatieren aufsummiert.
+ */
+typedef struct
+{
+    atomic_uint_fast64_t eimer[EIMER + 1]; /* der letzte Eimer zählt alles über der größten Grenze */
+    atomic_uint_fast64_t summe; /* in Mikrosekunden */
+} histogramm;
+
+/**
+ * Metriken eines Hauskraftwerks.
+ */
+typedef struct
+{
+    atomic_uint_fast64_t abfragen;
+    atomic_uint_fast64_t lesefehler;
+    atomic_uint_fast64_t verbindungen;
+    atomic_uint_fast64_t verbindungsfehler;
+    atomic_uint_fast64_t ausgelassen;
+    atomic_uint_fast64_t verworfen;
+    atomic_uint_fast64_t mqttGesendet;
+    atomic_uint_fast64_t mqttZusammengefasst;
+    histogramm latenz;
+    histogramm ausgabe;
+} anlagenmetriken;
+
+static anlagenmetriken *anlagen = NULL; /* je Hauskraftwerk */
+static size_t anzahlAnlagen = 0;
+static histogramm json;
+static histogramm sql;
+static atomic_uint_fast64_t sqlZeilen;
+static atomic_uint_fast64_t sqlFehler;
+
+/**
+ * sortiert eine Dauer in ein Histogramm ein.
+ * @param h das Histogramm.
+ * @param dauer Dauer in Mikrosekunden.
+ */
+static void Einsortieren(histogramm *const h, int64_t const dauer)
+{
+    size_t i = 0;
+    while (i < EIMER && dauer > eimergrenzen[i])
+        i++;
+    atomic_fetch_add_explicit(h->eimer + i, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->summe, dauer > 0 ? dauer : 0, memory_order_relaxed);
+}
+
+/**
+ * liefert die Metriken eines Hauskraftwerks.
+ * @param anlage Nummer des Hauskraftwerks in der Anlagenliste.
+ * @return die Metriken oder NULL, wenn keine angelegt sind.
+ */
+static anlagenmetriken *Anlage(uint32_t const anlage)
+{
+    return anlage < anzahlAnlagen ? anlagen + anlage : NULL;
+}
+
+/**
+ * hängt Text an, solange der Zielpuffer reicht, und zählt auch darüber hinaus die benötigte Länge.
+ * @param ziel Zielpuffer.
+ * @param groesse Größe des Zielpuffers.
+ * @param laenge bisherige Länge, wird um die Länge des Texts erhöht.
+ * @param format printf-Format des Texts.
+ */
+static void Anhaengen(char *const ziel, size_t const groesse, size_t *const laenge, char const *const format, ...)
+    __attribute__((format(printf, 4, 5)));
+static void Anhaengen(char *const ziel, size_t const groesse, size_t *const laenge, char const *const format, ...)
+{
+    va_list argumente;
+    va_start(argumente, format);
+    int const n = vsnprintf(*laenge < groesse ? ziel + *laenge : NULL, *laenge < groesse ? groesse - *laenge : 0, format, argumente);
+    va_end(argumente);
+    if (n > 0) *laenge += n;
+}
+
+/**
+ * formatiert ein Histogramm mit aufsummierten Eimern.
+ * @param ziel Zielpuffer.
+ * @param groesse Größe des Zielpuffers.
+ * @param laenge bisherige Länge, wird fortgeschrieben.
+ * @param name Name der Metrik.
+ * @param label Label samt Komma, z.B. "anlage=\"0\",", oder "".
+ * @param h das Histogramm.
+ */
+static void HistogrammFormatieren(char *const ziel, size_t const groesse, size_t *const laenge, char const *const name, char const *const label,
+                                  histogramm const *const h)
+{
+    uint_fast64_t anzahl = 0;
+    for (size_t i = 0; i <= EIMER; i++)
+    {
+        anzahl += atomic_load_explicit(h->eimer + i, memory_order_relaxed);
+        if (i < EIMER)
+            Anhaengen(ziel, groesse, laenge, "%s_bucket{%sle=\"%g\"} %" PRIuFAST64 "\n", name, label, eimergrenzen[i] / 1e6, anzahl);
+        else
+            Anhaengen(ziel, groesse, laenge, "%s_bucket{%sle=\"+Inf\"} %" PRIuFAST64 "\n", name, label, anzahl);
+    }
+    /* ohne Label entfallen die geschweiften Klammern */
+    char klammer[64] = "";
+    if ('\0' != *label) snprintf(klammer, sizeof(klammer), "{%.*s}", (int) strlen(label) - 1, label);
+    Anhaengen(ziel, groesse, laenge, "%s_sum%s %.6f\n%s_count%s %" PRIuFAST64 "\n", name, klammer,
+              atomic_load_explicit(&h->summe, memory_order_relaxed) / 1e6, name, klammer, anzahl);
+}
+
+int_fast8_t MetrikenAnlegen(size_t const anzahl)
+{
+    anlagen = (anlagenmetriken*) calloc(anzahl, sizeof(anlagenmetriken));
+    if (NULL == anlagen) return EXIT_FAILURE;
+    anzahlAnlagen = anzahl;
+    return EXIT_SUCCESS;
+}
+
+void MetrikModbusAbfrage(uint32_t const anlage, bool const erfolg, int64_t const latenz)
+{
+    anlagenmetriken *const m = Anlage(anlage);
+    if (NULL == m) return;
+    atomic_fetch_add_explicit(&m->abfragen, 1, memory_order_relaxed);
+    if (erfolg)
+        Einsortieren(&m->latenz, latenz);
+    else
+        atomic_fetch_add_explicit(&m->lesefehler, 1, memory_order_relaxed);
+}
+
+void MetrikModbusVerbindung(uint32_t const anlage, bool const erfolg)
+{
+    anlagenmetriken *const m = Anlage(anlage);
+    if (NULL == m) return;
+    atomic_fetch_add_explicit(&m->verbindungen, 1, memory_order_relaxed);
+    if (!erfolg) atomic_fetch_add_explicit(&m->verbindungsfehler, 1, memory_order_relaxed);
+}
+
+void MetrikAusgelassen(uint32_t const anlage, size_t const sekunden)
+{
+    anlagenmetriken *const m = Anlage(anlage);
+    if (NULL != m && sekunden > 0) atomic_fetch_add_explicit(&m->ausgelassen, sekunden, memory_order_relaxed);
+}
+
+void MetrikAusgabe(uint32_t const anlage, int64_t const verzug)
+{
+    anlagenmetriken *const m = Anlage(anlage);
+    if (NULL != m) Einsortieren(&m->ausgabe, verzug);
+}
+
+void MetrikAusgabeVerworfen(uint32_t const anlage)
+{
+    anlagenmetriken *const m = Anlage(anlage);
+    if (NULL != m) atomic_fetch_add_explicit(&m->verworfen, 1, memory_order_relaxed);
+}
+
+void MetrikMQTT(uint32_t const anlage, bool const gesendet)
+{
+    anlagenmetriken *const m = Anlage(anlage);
+    if (NULL != m) atomic_fetch_add_explicit(gesendet ? &m->mqttGesendet : &m->mqttZusammengefasst, 1, memory_order_relaxed);
+}
+
+void MetrikJSON(int64_t const dauer)
+{
+    Einsortieren(&json, dauer);
+}
+
+void MetrikSQL(bool const erfolg, size_t const zeilen, int64_t const dauer)
+{
+    Einsortieren(&sql, dauer);
+    atomic_fetch_add_explicit(&sqlZeilen, zeilen, memory_order_relaxed);
+    if (!erfolg) atomic_fetch_add_explicit(&sqlFehler, 1, memory_order_relaxed);
+}
+
+size_t MetrikenFormatieren(char *const ziel, size_t const groesse)
+{
+    static struct
+    {
+        char const *name;
+        char const *hilfe;
+        size_t feld;
+    } const zaehler[] = {
+        { "s10_modbus_abfragen_total", "Modbus-Abfragen der Leistungsregister", offsetof(anlagenmetriken, abfragen) },
+        { "s10_modbus_lesefehler_total", "fehlgeschlagene Modbus-Abfragen", offsetof(anlagenmetriken, lesefehler) },
+        { "s10_modbus_verbindungen_total", "Verbindungsversuche zum Hauskraftwerk", offsetof(anlagenmetriken, verbindungen) },
+        { "s10_modbus_verbindungsfehler_total", "gescheiterte Verbindungsversuche", offsetof(anlagenmetriken, verbindungsfehler) },
+        { "s10_sekunden_ausgelassen_total", "Sekunden ohne Abfrage, weil die vorherige zu lange gedauert hat", offsetof(anlagenmetriken, ausgelassen) },
+        { "s10_ausgabe_verworfen_total", "Messwerte ohne Ausgabe, weil die Warteschlange der Ausgabe-Threads voll war", offsetof(anlagenmetriken, verworfen) },
+        { "s10_mqtt_gesendet_total", "Messwerte an den MQTT-Broker übergeben", offsetof(anlagenmetriken, mqttGesendet) },
+        { "s10_mqtt_zusammengefasst_total", "Messwerte, die wegen eines langsamen Brokers durch den nächsten ersetzt wurden",
+          offsetof(anlagenmetriken, mqttZusammengefasst) }
+    };
+
+    size_t laenge = 0;
+    if (groesse > 0) *ziel = '\0';
+    for (size_t z = 0; z < sizeof(zaehler) / sizeof(zaehler[0]); z++)
+    {
+        Anhaengen(ziel, groesse, &laenge, "# HELP %s %s\n# TYPE %s counter\n", zaehler[z].name, zaehler[z].hilfe, zaehler[z].name);
+        for (size_t a = 0; a < anzahlAnlagen; a++)
+            Anhaengen(ziel, groesse, &laenge, "%s{anlage=\"%zu\"} %" PRIuFAST64 "\n", zaehler[z].name, a,
+                      atomic_load_explicit((atomic_uint_fast64_t*) ((char*) (anlagen + a) + zaehler[z].feld), memory_order_relaxed));
+    }
+
+    Anhaengen(ziel, groesse, &laenge, "# HELP s10_modbus_latenz_sekunden Dauer erfolgreicher Modbus-Abfragen\n"
+              "# TYPE s10_modbus_latenz_sekunden histogram\n");
+    for (size_t a = 0; a < anzahlAnlagen; a++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "anlage=\"%zu\",", a);
+        HistogrammFormatieren(ziel, groesse, &laenge, "s10_modbus_latenz_sekunden", label, &anlagen[a].latenz);
+    }
+    Anhaengen(ziel, groesse, &laenge, "# HELP s10_ausgabe_verzug_sekunden Zeit vom Erfassen bis zum Ende der Ausgabe eines Messwerts\n"
+              "# TYPE s10_ausgabe_verzug_sekunden histogram\n");
+    for (size_t a = 0; a < anzahlAnlagen; a++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "anlage=\"%zu\",", a);
+        HistogrammFormatieren(ziel, groesse, &laenge, "s10_ausgabe_verzug_sekunden", label, &anlagen[a].ausgabe);
+    }
+    Anhaengen(ziel, groesse, &laenge, "# HELP s10_json_dauer_sekunden Dauer der JSON-Dateiausgabe\n# TYPE s10_json_dauer_sekunden histogram\n");
+    HistogrammFormatieren(ziel, groesse, &laenge, "s10_json_dauer_sekunden", "", &json);
+    Anhaengen(ziel, groesse, &laenge, "# HELP s10_sql_dauer_sekunden Dauer der SQL-Transaktionen mit Messwerten\n"
+              "# TYPE s10_sql_dauer_sekunden histogram\n");
+    HistogrammFormatieren(ziel, groesse, &laenge, "s10_sql_dauer_sekunden", "", &sql);
+    Anhaengen(ziel, groesse, &laenge, "# HELP s10_sql_zeilen_total eingetragene Messwerte\n# TYPE s10_sql_zeilen_total counter\n"
+              "s10_sql_zeilen_total %" PRIuFAST64 "\n", atomic_load_explicit(&sqlZeilen, memory_order_relaxed));
+    Anhaengen(ziel, groesse, &laenge, "# HELP s10_sql_fehler_total gescheiterte SQL-Transaktionen\n# TYPE s10_sql_fehler_total counter\n"
+              "s10_sql_fehler_total %" PRIuFAST64 "\n", atomic_load_explicit(&sqlFehler, memory_order_relaxed));
+    return laenge;
+}
+
+char *MetrikenText(char const *const kopf, size_t *const laenge)
+{
+    size_t const kopflaenge = strlen(kopf);
+    size_t groesse = kopflaenge + MetrikenFormatieren(NULL, 0) + RESERVE_METRIKEN;
+    for (uint_fast8_t versuch = 0; versuch < 3; versuch++)
+    {
+        char *const text = (char*) malloc(groesse * sizeof(char));
+        if (NULL == text)
+        {
+            fprintf(stderr, "S10auslesen: kein Speicher für %zu Zeichen Metriken\n", groesse);
+            return NULL;
+        }
+        memcpy(text, kopf, kopflaenge);
+        size_t const benoetigt = kopflaenge + MetrikenFormatieren(text + kopflaenge, groesse - kopflaenge);
+        if (benoetigt < groesse)
+        {
+            *laenge = benoetigt;
+            return text;
+        }
+        free(text); /* zwischen Messen und Formatieren gewachsen, mit der neuen Länge wiederholen */
+        groesse = benoetigt + RESERVE_METRIKEN;
+    }
+    fprintf(stderr, "S10auslesen: Metriken abgeschnitten, zuletzt %zu Zeichen benötigt\n", groesse);
+    return NULL;
+}
+
+void MetrikenSchreiben(void)
+{
+    if (sizeof(METRIK_DATEI) <= 1 || NULL == anlagen) return;
+
+    size_t laenge;
+    char *const text = MetrikenText("", &laenge);
+    if (NULL != text)
+    {
+        FILE *const f = fopen(METRIK_DATEI ".tmp", "w");
+        if (NULL != f)
+        {
+            bool const ok = laenge == fwrite(text, sizeof(char), laenge, f);
+            if (0 == fclose(f) && ok) rename(METRIK_DATEI ".tmp", METRIK_DATEI);
+        }
+        free(text);
+    }
+}
+
+void MetrikenFreigeben(void)
+{
+    anzahlAnlagen = 0;
+    free(anlagen);
+    anlagen = NULL;
+}
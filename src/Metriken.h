@@ -0,0 +1,120 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Laufzeitmetriken von S10auslesen im Textformat von Prometheus. Die Zähler und Histogramme werden aus der Erfassung und dem
+ * Schreib-Thread nur mit einzelnen atomaren Additionen ohne Sperre fortgeschrieben, das Formatieren übernimmt der Webserver
+ * (GET /metrics) bzw. der Schreib-Thread für die Textdatei des node_exporter (METRIK_DATEI).
+ */
+
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int64_t und Konsorten */
+
+/**
+ * legt die Metriken für die angegebene Anzahl von Anlagen an. Vorher und bei fehlendem Speicher bleiben alle Aufrufe wirkungslos.
+ * @param Anzahl der Hauskraftwerke.
+ * @return EXIT_SUCCESS wenn die Metriken angelegt werden konnten, sonst EXIT_FAILURE.
+ */
+int_fast8_t MetrikenAnlegen(size_t const);
+
+/**
+ * zählt eine Modbus-Abfrage der Leistungsregister.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param true wenn die Abfrage erfolgreich war.
+ * @param Dauer der Abfrage in Mikrosekunden, nur bei Erfolg verwendet.
+ */
+void MetrikModbusAbfrage(uint32_t const, bool const, int64_t const);
+
+/**
+ * zählt einen Verbindungsversuch zu einem Hauskraftwerk.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param true wenn die Verbindung aufgebaut wurde.
+ */
+void MetrikModbusVerbindung(uint32_t const, bool const);
+
+/**
+ * zählt Sekunden, die die Erfassung auslassen musste.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param Anzahl der ausgelassenen Sekunden.
+ */
+void MetrikAusgelassen(uint32_t const, size_t const);
+
+/**
+ * erfasst einen von einem Ausgabe-Thread ausgegebenen Messwert.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param Zeit vom Erfassen bis zum Ende der Ausgabe in Mikrosekunden.
+ */
+void MetrikAusgabe(uint32_t const, int64_t const);
+
+/**
+ * zählt einen Messwert, der wegen voller Warteschlange nicht ausgegeben wurde.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ */
+void MetrikAusgabeVerworfen(uint32_t const);
+
+/**
+ * zählt einen Messwert der MQTT-Ausgabe.
+ * @param Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param true = an den Broker übergeben, false = vor dem Senden durch den nächsten Messwert ersetzt.
+ */
+void MetrikMQTT(uint32_t const, bool const);
+
+/**
+ * erfasst die Dauer einer JSON-Ausgabe.
+ * @param Dauer in Mikrosekunden.
+ */
+void MetrikJSON(int64_t const);
+
+/**
+ * erfasst eine SQL-Transaktion mit den Messwerten einer Stunde.
+ * @param true wenn die Transaktion abgeschlossen wurde.
+ * @param Anzahl der eingetragenen Zeilen.
+ * @param Dauer in Mikrosekunden.
+ */
+void MetrikSQL(bool const, size_t const, int64_t const);
+
+/**
+ * formatiert alle Metriken im Textformat von Prometheus.
+ * @param Zielpuffer.
+ * @param Größe des Zielpuffers.
+ * @return benötigte Länge ohne abschließende Null, ist sie nicht kleiner als der Zielpuffer, wurde abgeschnitten.
+ */
+size_t MetrikenFormatieren(char* const, size_t const);
+
+/**
+ * formatiert alle Metriken hinter einen Kopf in einen passend großen, mit malloc angelegten Puffer.
+ * Die Größe richtet sich nach der Anzahl der Anlagen, wachsen die Zähler währenddessen, wird mit der neuen Länge wiederholt.
+ * @param der Kopf, der vor die Metriken kommt, z. B. die HTTP-Kopfzeilen.
+ * @param die Länge von Kopf und Metriken ohne abschließende Null.
+ * @return der Puffer, vom Aufrufer mit free() freizugeben, oder NULL mit Meldung auf stderr.
+ */
+char *MetrikenText(char const* const, size_t* const);
+
+/**
+ * schreibt alle Metriken nach METRIK_DATEI, über eine temporäre Datei und rename(), damit der node_exporter nie eine halbe Datei liest.
+ */
+void MetrikenSchreiben(void);
+
+/**
+ * gibt die Metriken wieder frei.
+ */
+void MetrikenFreigeben(void);
@@ -0,0 +1,351 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Register.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <endian.h> /* Umwandlung E3/DC Big Endian zum Format des Host-Rechners */
+#include <errno.h> /* für ETIMEDOUT */
+#include <inttypes.h> /* für PRId32 */
+#include <stdio.h> /* für Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* für memcpy */
+#include <time.h> /* für clock_gettime */
+
+/* ein Feld von s10daten, das an der angegebenen Adresse beginnt und alle periode Sekunden gelesen wird */
+#define FELD(feld, adresse, bits, versatz, vorzeichen, periode) { #feld, adresse, bits, versatz, vorzeichen, false, 1, periode, offsetof(s10daten, feld) }
+
+s10register const registerkarte[] = {
+    FELD(P_pv, 67, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(P_bat, 69, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(P_haus, 71, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(P_netz, 73, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(P_ext, 75, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(P_wall, 77, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(P_pvwall, 79, 32, 0, true, REGISTER_TAKT_LEISTUNG),
+    FELD(eigen, 81, 8, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(autarkie, 81, 8, 8, false, REGISTER_TAKT_LEISTUNG),
+    FELD(soc, 82, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(notstr, 83, 16, 0, false, REGISTER_TAKT_STATUS),
+    FELD(ems, 84, 16, 0, false, REGISTER_TAKT_STATUS),
+    FELD(emsrc, 85, 16, 0, true, REGISTER_TAKT_STATUS),
+    FELD(emsctrl, 86, 16, 0, false, REGISTER_TAKT_STATUS),
+    FELD(wall1, 87, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall2, 88, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall3, 89, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall4, 90, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall5, 91, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall6, 92, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall7, 93, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(wall8, 94, 16, 0, false, REGISTER_TAKT_WALLBOX),
+    FELD(Vdc1, 95, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Vdc2, 96, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Vdc3, 97, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Idc1, 98, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Idc2, 99, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Idc3, 100, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Pdc1, 101, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Pdc2, 102, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    FELD(Pdc3, 103, 16, 0, false, REGISTER_TAKT_LEISTUNG),
+    S10_ZUSATZREGISTER
+};
+#define FELDER (sizeof(registerkarte) / sizeof(registerkarte[0]))
+/* die Felder von s10daten, die zusätzlichen Register folgen dahinter */
+#define LEISTUNGSFELDER     31
+size_t const leistungsfelder = LEISTUNGSFELDER;
+size_t const zusatzregister = FELDER - LEISTUNGSFELDER;
+
+/**
+ * eine zusammengefasste Modbus-Abfrage.
+ */
+typedef struct
+{
+    uint16_t adresse; /* erstes Register */
+    uint16_t anzahl; /* Anzahl der Register, höchstens REGISTER_MAX */
+} leseblock;
+
+/**
+ * die Abfragen für eine Kombination fälliger Gruppen.
+ */
+typedef struct
+{
+    leseblock const *bloecke;
+    size_t anzahl;
+} leseplan;
+
+/**
+ * Vorschrift, wie ein Feld aus dem Rohpuffer zusammengesetzt wird: ((hi << 16 | lo) >> versatz & maske), mit vorzeichen erweitert.
+ */
+typedef struct
+{
+    uint32_t lo; /* Index des niederwertigen Worts */
+    uint32_t hi; /* Index des höherwertigen Worts, bei 8 und 16 Bit das Nullwort am Ende des Rohpuffers */
+    uint8_t versatz;
+    uint8_t bereich; /* 0 = s10daten, 1 = zusätzliche Register */
+    uint8_t groesse; /* Größe des Ziels in Bytes */
+    uint16_t ziel; /* Position im Ziel in Bytes */
+    uint32_t maske;
+    uint32_t vorzeichen; /* Vorzeichenbit, 0 = ohne Vorzeichen */
+} dekodierer;
+
+static leseblock *bloecke = NULL; /* die Abfragen aller Pläne hintereinander */
+static leseplan *plaene = NULL; /* je Bitmaske der fälligen Gruppen ein Plan */
+static uint16_t perioden[REGISTER_GRUPPEN]; /* Periode jeder Gruppe in Sekunden */
+static size_t gruppen = 0;
+static dekodierer *dekodierliste = NULL; /* FELDER Einträge */
+static uint16_t basis = 0; /* Adresse des ersten Registers im Rohpuffer */
+static size_t rohwerte = 0; /* Register von basis bis zum letzten Feld, dahinter folgt das Nullwort */
+
+/**
+ * vergleicht zwei Felder nach ihrer Adresse für qsort.
+ * @param a Index des einen Felds.
+ * @param b Index des anderen Felds.
+ * @return negativ, 0 oder positiv.
+ */
+static int AdresseVergleichen(void const *const a, void const *const b)
+{
+    return (int) registerkarte[*(size_t const*) a].adresse - (int) registerkarte[*(size_t const*) b].adresse;
+}
+
+/**
+ * ermittelt die Gruppe eines Felds und legt sie ggfs. an.
+ * @param periode Periode des Felds in Sekunden, 0 wird wie 1 behandelt.
+ * @return Nummer der Gruppe oder REGISTER_GRUPPEN, wenn bereits alle Gruppen belegt sind.
+ */
+static size_t GruppeFinden(uint16_t const periode)
+{
+    uint16_t const sekunden = 0 == periode ? 1 : periode;
+    size_t gruppe = 0;
+    while (gruppe < gruppen && perioden[gruppe] != sekunden)
+        gruppe++;
+    if (gruppe == gruppen && gruppen < REGISTER_GRUPPEN) perioden[gruppen++] = sekunden;
+    return gruppe;
+}
+
+int_fast8_t RegisterPlanen(void)
+{
+    int_fast8_t result = EXIT_FAILURE;
+    size_t *const reihenfolge = (size_t*) malloc(FELDER * sizeof(size_t));
+    uint8_t *const gruppe = (uint8_t*) malloc(FELDER * sizeof(uint8_t));
+    bloecke = (leseblock*) calloc(FELDER << REGISTER_GRUPPEN, sizeof(leseblock));
+    plaene = (leseplan*) calloc(1u << REGISTER_GRUPPEN, sizeof(leseplan));
+    dekodierliste = (dekodierer*) calloc(FELDER, sizeof(dekodierer));
+    if (NULL != reihenfolge && NULL != gruppe && NULL != bloecke && NULL != plaene && NULL != dekodierliste)
+    {
+        /* 1) Felder nach Adresse ordnen, ihre Gruppen bestimmen und den Rohpuffer von der ersten bis zur letzten Adresse anlegen */
+        gruppen = 0;
+        result = EXIT_SUCCESS;
+        bool zuVielePerioden = false;
+        for (size_t i = 0; i < FELDER; i++)
+        {
+            reihenfolge[i] = i;
+            gruppe[i] = GruppeFinden(registerkarte[i].periode);
+            if (REGISTER_GRUPPEN == gruppe[i]) zuVielePerioden = true;
+            if (registerkarte[i].skala <= 0)
+            {
+                /* als Teiler ergäbe 0 inf oder nan im JSON, ein negativer Teiler kehrt still das Vorzeichen um */
+                fprintf(stderr, "S10auslesen: Register %s hat die ungültige Skala %" PRId32 "\n", registerkarte[i].name, registerkarte[i].skala);
+                result = EXIT_FAILURE;
+            }
+        }
+        qsort(reihenfolge, FELDER, sizeof(size_t), AdresseVergleichen);
+        basis = registerkarte[reihenfolge[0]].adresse;
+        rohwerte = 0;
+        for (size_t i = 0; i < FELDER; i++)
+        {
+            size_t const ende = registerkarte[i].adresse + (32 == registerkarte[i].bits ? 2 : 1) - basis;
+            if (ende > rohwerte) rohwerte = ende;
+        }
+        if (zuVielePerioden)
+        {
+            fprintf(stderr, "S10auslesen: die Registerkarte hat mehr als %d verschiedene Perioden\n", REGISTER_GRUPPEN);
+            result = EXIT_FAILURE;
+        }
+
+        /* 2) je Kombination fälliger Gruppen kommt ein Feld in die laufende Abfrage, solange die Lücke davor höchstens REGISTER_LUECKE
+         *    Register beträgt und die Abfrage nicht mehr als REGISTER_MAX Register umfasst, sonst beginnt eine neue Abfrage */
+        leseblock *naechster = bloecke;
+        for (size_t maske = 1; maske < (size_t) 1 << gruppen && EXIT_SUCCESS == result; maske++)
+        {
+            leseblock *block = NULL;
+            plaene[maske].bloecke = naechster;
+            for (size_t i = 0; i < FELDER; i++)
+            {
+                if (0 == (maske >> gruppe[reihenfolge[i]] & 1)) continue;
+                s10register const *const feld = registerkarte + reihenfolge[i];
+                uint_fast32_t const ende = feld->adresse + (32 == feld->bits ? 2 : 1);
+                if (NULL == block || feld->adresse > block->adresse + block->anzahl + REGISTER_LUECKE || ende - block->adresse > REGISTER_MAX)
+                {
+                    block = naechster++;
+                    block->adresse = feld->adresse;
+                }
+                if (ende - block->adresse > block->anzahl) block->anzahl = ende - block->adresse;
+            }
+            plaene[maske].anzahl = naechster - plaene[maske].bloecke;
+        }
+
+        /* 3) die Vorschrift für jedes Feld festlegen, jedes Register hat seinen festen Platz im Rohpuffer */
+        for (size_t i = 0; i < FELDER; i++)
+        {
+            s10register const *const feld = registerkarte + i;
+            dekodierer *const d = dekodierliste + i;
+            uint32_t const erstes = feld->adresse - basis;
+            bool const zusatz = i >= leistungsfelder;
+            d->lo = 32 == feld->bits && feld->hochwortZuerst ? erstes + 1 : erstes;
+            d->hi = 32 == feld->bits ? (feld->hochwortZuerst ? erstes : erstes + 1) : rohwerte; /* Nullwort */
+            d->versatz = feld->versatz;
+            d->bereich = zusatz;
+            d->groesse = zusatz ? sizeof(int32_t) : feld->bits / 8;
+            d->ziel = zusatz ? (i - leistungsfelder) * sizeof(int32_t) : feld->ziel;
+            d->maske = 32 == feld->bits ? UINT32_MAX : (UINT32_C(1) << feld->bits) - 1;
+            d->vorzeichen = feld->vorzeichen ? UINT32_C(1) << (feld->bits - 1) : 0;
+        }
+    }
+    if (EXIT_SUCCESS != result) RegisterFreigeben();
+    free(gruppe);
+    free(reihenfolge);
+    return result;
+}
+
+size_t RegisterRohwerte(void)
+{
+    return rohwerte + 1;
+}
+
+bool ModbusWartezeit(modbus_t *const modbus, uint32_t const millisekunden)
+{
+#if LIBMODBUS_VERSION_CHECK(3, 1, 0)
+    return 0 == modbus_set_response_timeout(modbus, 0, millisekunden * 1000) && 0 == modbus_set_byte_timeout(modbus, 0, 0);
+#else
+    struct timeval wartezeit = { 0, millisekunden * 1000 };
+    modbus_set_response_timeout(modbus, &wartezeit);
+    modbus_set_byte_timeout(modbus, &wartezeit);
+    return true;
+#endif
+}
+
+int_fast8_t RegisterLesen(modbus_t *const modbus, uint16_t *const roh, s10registertakt *const takt, time_t const zeit)
+{
+    size_t maske = 0;
+    for (size_t gruppe = 0; gruppe < gruppen; gruppe++)
+        if (zeit >= takt->naechste[gruppe]) maske |= (size_t) 1 << gruppe;
+
+    /* alle Abfragen dieser Sekunde teilen sich MODBUS_ANTWORTZEIT, jede wartet nur noch auf den Rest davon */
+    leseplan const *const plan = plaene + maske;
+    struct timespec start, jetzt;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int_fast8_t result = EXIT_SUCCESS;
+    uint32_t wartezeit = MODBUS_ANTWORTZEIT;
+    for (size_t i = 0; i < plan->anzahl && EXIT_SUCCESS == result; i++)
+    {
+        if (i > 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &jetzt);
+            int64_t const vergangen = (jetzt.tv_sec - start.tv_sec) * 1000 + (jetzt.tv_nsec - start.tv_nsec) / 1000000;
+            if (vergangen >= MODBUS_ANTWORTZEIT)
+            {
+                errno = ETIMEDOUT;
+                result = EXIT_FAILURE;
+                continue;
+            }
+            wartezeit = MODBUS_ANTWORTZEIT - vergangen;
+            ModbusWartezeit(modbus, wartezeit);
+        }
+        if (plan->bloecke[i].anzahl != modbus_read_registers(modbus, plan->bloecke[i].adresse, plan->bloecke[i].anzahl,
+                                                              roh + plan->bloecke[i].adresse - basis))
+            result = EXIT_FAILURE;
+    }
+    if (MODBUS_ANTWORTZEIT != wartezeit)
+    {
+        int const lesefehler = errno; /* für die Meldung des Aufrufers */
+        ModbusWartezeit(modbus, MODBUS_ANTWORTZEIT);
+        errno = lesefehler;
+    }
+    if (EXIT_SUCCESS != result) return EXIT_FAILURE;
+    roh[rohwerte] = 0;
+
+    /* erst nach dem erfolgreichen Lesen, sonst bleiben die Gruppen für den nächsten Versuch fällig */
+    for (size_t gruppe = 0; gruppe < gruppen; gruppe++)
+        if (maske >> gruppe & 1) takt->naechste[gruppe] = (zeit / perioden[gruppe] + 1) * perioden[gruppe];
+    return EXIT_SUCCESS;
+}
+
+void RegisterDekodieren(uint16_t const *const roh, s10daten *const daten, int32_t *const zusatz)
+{
+    unsigned char *const ziele[2] = { (unsigned char*) daten, (unsigned char*) zusatz };
+    for (size_t i = 0; i < FELDER; i++)
+    {
+        dekodierer const *const d = dekodierliste + i;
+        uint32_t const wert = ((uint32_t) roh[d->hi] << 16 | roh[d->lo]) >> d->versatz & d->maske;
+        int32_t const ergebnis = (int32_t) ((wert ^ d->vorzeichen) - d->vorzeichen);
+        /* wie bisher beim Kopieren der Register: das Ziel ist little-endian, die niederwertigen Bytes stehen vorne */
+        memcpy(ziele[d->bereich] + d->ziel, &ergebnis, d->groesse);
+    }
+}
+
+size_t RegisterAdressen(uint16_t *const adressen)
+{
+    size_t anzahl = 0;
+    uint16_t letzte = 0;
+    /* je Durchlauf die kleinste Adresse oberhalb der zuletzt gefundenen, die Registerkarte ist klein */
+    for (;;)
+    {
+        bool gefunden = false;
+        uint16_t kleinste = UINT16_MAX;
+        for (size_t i = 0; i < FELDER; i++)
+            for (uint_fast8_t wort = 0; wort < (32 == registerkarte[i].bits ? 2 : 1); wort++)
+            {
+                uint16_t const adresse = registerkarte[i].adresse + wort;
+                if ((0 == anzahl || adresse > letzte) && adresse <= kleinste)
+                {
+                    kleinste = adresse;
+                    gefunden = true;
+                }
+            }
+        if (!gefunden) return anzahl;
+        if (NULL != adressen) adressen[anzahl] = kleinste;
+        letzte = kleinste;
+        anzahl++;
+    }
+}
+
+size_t RegisterRohindex(uint16_t const adresse)
+{
+    return adresse >= basis && (size_t) (adresse - basis) < rohwerte ? (size_t) (adresse - basis) : SIZE_MAX;
+}
+
+void RegisterIdentifikation(uint16_t const *const roh, s10konstanten *const konstanten)
+{
+    uint16_t woerter[sizeof(s10konstanten) / sizeof(uint16_t)];
+    for (size_t i = 0; i < sizeof(woerter) / sizeof(woerter[0]); i++)
+        woerter[i] = i < 3 ? roh[i] : be16toh(roh[i]);
+    /* die Reihenfolge der Bytes in woerter entspricht jetzt s10konstanten */
+    memcpy(konstanten, woerter, sizeof(s10konstanten));
+}
+
+void RegisterFreigeben(void)
+{
+    free(bloecke);
+    free(plaene);
+    free(dekodierliste);
+    bloecke = NULL;
+    plaene = NULL;
+    dekodierliste = NULL;
+    gruppen = 0;
+}
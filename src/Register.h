@@ -0,0 +1,153 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Registerkarte des S10: jedes Feld ist mit Adresse, Breite, Vorzeichen, Wortfolge und Skalierung beschrieben, statt die Register
+ * als Block auf s10daten zu kopieren. RegisterPlanen() fasst alle Felder einmalig zu möglichst wenigen Abfragen mit höchstens
+ * REGISTER_MAX Registern zusammen und legt für jedes Feld fest, aus welchen Wörtern des Rohpuffers es zusammengesetzt wird.
+ * Das Dekodieren ist danach für jedes Feld dieselbe verzweigungsfreie Rechnung aus Verschieben, Maskieren und Vorzeichenerweitern.
+ *
+ * Jedes Feld wird nur alle periode Sekunden gelesen, Felder mit gleicher Periode bilden eine Gruppe. Für jede Kombination gleichzeitig
+ * fälliger Gruppen plant RegisterPlanen() eigene Abfragen, sodass auch die Felder verschiedener Gruppen einer Sekunde zusammengefasst
+ * werden. Der Rohpuffer hat für jede Adresse einen festen Platz und behält die Werte der gerade nicht gelesenen Felder, dekodiert wird
+ * daher immer der zuletzt gelesene Wert jedes Felds.
+ *
+ * Auf die Felder von s10daten folgen die zusätzlichen Register aus S10_ZUSATZREGISTER, die in denselben Abfragen mitgelesen
+ * werden und als int32_t in der Reihenfolge ihrer Angabe vorliegen. Adressen zählen wie bei libmodbus ab 0 (= Register 40001).
+ */
+
+#include "S10daten.h" /* für s10daten */
+
+#include <modbus/modbus-tcp.h> /* für die Modbus-Verbindung */
+
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int32_t und Konsorten */
+#include <time.h> /* für time_t */
+
+/* höchstens so viele Register liefert eine einzelne Modbus-Abfrage */
+#define REGISTER_MAX        125
+/* höchstens so viele verschiedene Perioden können die Felder haben */
+#define REGISTER_GRUPPEN    6
+
+/**
+ * ein Feld der Registerkarte.
+ */
+typedef struct
+{
+    char const *name; /* Feldname, für zusätzliche Register auch der Name in der JSON-Ausgabe */
+    uint16_t adresse; /* erstes Register des Felds */
+    uint8_t bits; /* 8, 16 oder 32 */
+    uint8_t versatz; /* Bitversatz innerhalb des Registers, 8 = höherwertiges Byte eines 8-Bit-Felds */
+    bool vorzeichen; /* Zweierkomplement */
+    bool hochwortZuerst; /* Wortfolge bei 32 Bit, das S10 legt das niederwertige Wort zuerst ab */
+    int32_t skala; /* Teiler für die Ausgabe, z.B. 10 für Zehntel, 1 = Rohwert */
+    uint16_t periode; /* das Feld wird alle so viele Sekunden gelesen */
+    size_t ziel; /* Position in s10daten, für zusätzliche Register ohne Bedeutung */
+} s10register;
+
+/* Felder für S10_ZUSATZREGISTER: Name, Adresse ab 0, Breite, Vorzeichen, Teiler für die Ausgabe und Periode in Sekunden */
+#define REGISTER(name, adresse, bits, vorzeichen, skala, periode) { name, adresse, bits, 0, vorzeichen, false, skala, periode, 0 }
+/* wie REGISTER, aber mit den Leistungswerten gelesen */
+#define REGISTER_U16(name, adresse, skala) REGISTER(name, adresse, 16, false, skala, REGISTER_TAKT_LEISTUNG)
+#define REGISTER_S16(name, adresse, skala) REGISTER(name, adresse, 16, true, skala, REGISTER_TAKT_LEISTUNG)
+#define REGISTER_U32(name, adresse, skala) REGISTER(name, adresse, 32, false, skala, REGISTER_TAKT_LEISTUNG)
+#define REGISTER_S32(name, adresse, skala) REGISTER(name, adresse, 32, true, skala, REGISTER_TAKT_LEISTUNG)
+
+/**
+ * Lesezeitpunkte der Gruppen für eine Verbindung, mit 0 angelegt werden beim nächsten Lesen alle Gruppen gelesen.
+ */
+typedef struct
+{
+    time_t naechste[REGISTER_GRUPPEN]; /* je Gruppe die Sekunde, ab der sie wieder fällig ist */
+} s10registertakt;
+
+/* die Registerkarte: erst die Felder von s10daten, dann die zusätzlichen Register */
+extern s10register const registerkarte[];
+/* Anzahl der Felder von s10daten in der Registerkarte */
+extern size_t const leistungsfelder;
+/* Anzahl der zusätzlichen Register */
+extern size_t const zusatzregister;
+
+/**
+ * fasst die Felder der Registerkarte für jede Kombination fälliger Gruppen zu Abfragen zusammen, einmalig vor dem ersten Auslesen.
+ * @return EXIT_SUCCESS wenn die Abfragen geplant werden konnten, sonst EXIT_FAILURE (auch bei mehr als REGISTER_GRUPPEN Perioden).
+ */
+int_fast8_t RegisterPlanen(void);
+
+/**
+ * liefert die Größe des Rohpuffers für RegisterLesen().
+ * @return Anzahl der Wörter.
+ */
+size_t RegisterRohwerte(void);
+
+/**
+ * setzt die Wartezeit auf eine Antwort, ab libmodbus 3.1 gilt sie ohne eigene Wartezeit zwischen den Zeichen für die ganze Antwort.
+ * @param die Modbus-Verbindung.
+ * @param Wartezeit in Millisekunden, unter 1000.
+ * @return true wenn die Wartezeit gesetzt wurde.
+ */
+bool ModbusWartezeit(modbus_t* const, uint32_t const);
+
+/**
+ * liest die Abfragen der Gruppen, die in dieser Sekunde fällig sind, und plant deren nächstes Lesen auf das nächste Vielfache ihrer Periode.
+ * @param offene Modbus-Verbindung zum S10.
+ * @param Rohpuffer mit RegisterRohwerte() Wörtern, behält zwischen den Aufrufen die Werte der nicht gelesenen Gruppen.
+ * @param Lesezeitpunkte der Gruppen, nach einer gescheiterten Abfrage bleiben die Gruppen fällig.
+ * @param aktuelle Sekunde seit 1.1.1970 (UTC).
+ * @return EXIT_SUCCESS wenn alle Abfragen erfolgreich waren, sonst EXIT_FAILURE (auch wenn MODBUS_ANTWORTZEIT verbraucht ist, errno ETIMEDOUT).
+ */
+int_fast8_t RegisterLesen(modbus_t* const, uint16_t* const, s10registertakt* const, time_t const);
+
+/**
+ * setzt die Felder aus dem Rohpuffer zusammen.
+ * @param der mit RegisterLesen() gefüllte Rohpuffer.
+ * @param Leistungsdaten, die gefüllt werden.
+ * @param Werte der zusätzlichen Register, zusatzregister Stück.
+ */
+void RegisterDekodieren(uint16_t const* const, s10daten* const, int32_t* const);
+
+/**
+ * liefert die Adressen aller Register, aus denen die Felder der Registerkarte zusammengesetzt werden, aufsteigend und ohne Doppelte.
+ * @param Ziel mit Platz für zwei Adressen je Feld, NULL = nur zählen.
+ * @return Anzahl der Adressen.
+ */
+size_t RegisterAdressen(uint16_t* const);
+
+/**
+ * liefert den Platz eines Registers im Rohpuffer, erst nach RegisterPlanen().
+ * @param Adresse des Registers.
+ * @return Index im Rohpuffer oder SIZE_MAX, wenn das Register außerhalb des Rohpuffers liegt.
+ */
+size_t RegisterRohindex(uint16_t const);
+
+/**
+ * setzt die Identifikationsdaten aus den Registern 0 bis IDENTIFIKREGISTER - 1 zusammen. Die Zeichenketten ab Register 3 liefert das S10
+ * mit dem ersten Zeichen im höherwertigen Byte, sie werden daher Wort für Wort in die Bytefolge des Speichers gedreht.
+ * @param die gelesenen Register.
+ * @param Identifikationsdaten, die gefüllt werden.
+ */
+void RegisterIdentifikation(uint16_t const* const, s10konstanten* const);
+
+/**
+ * gibt die geplanten Abfragen wieder frei.
+ */
+void RegisterFreigeben(void);
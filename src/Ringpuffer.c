@@ -0,0 +1,83 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Ringpuffer.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+
+#include <stdio.h> /* für Fehlermeldungen */
+#include <stdlib.h> /* Rückgabewerte */
+
+static s10ring *ring = NULL; /* eingeblendetes Segment */
+
+int_fast8_t RingpufferAnlegen(void)
+{
+    size_t const groesse = sizeof(s10ring) + RING_PLAETZE * sizeof(s10ringplatz);
+    int const fd = shm_open(RING_NAME, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "S10auslesen: Shared-Memory-Segment %s kann nicht angelegt werden\n", RING_NAME);
+        return EXIT_FAILURE;
+    }
+
+    struct stat info;
+    bool const vorhanden = 0 == fstat(fd, &info) && (size_t) info.st_size == groesse;
+    if (vorhanden || 0 == ftruncate(fd, groesse))
+    {
+        void *const segment = mmap(NULL, groesse, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED != segment) ring = (s10ring*) segment;
+    }
+    close(fd);
+    if (NULL == ring) return EXIT_FAILURE;
+
+    /* ein Segment des vorherigen Laufs (z.B. stündlicher Neustart) wird samt Messwerten weitergeführt */
+    if (vorhanden && RING_MAGIC == atomic_load(&ring->magic) && RING_VERSION == ring->version && RING_PLAETZE == ring->plaetze
+        && sizeof(s10ringplatz) == ring->platzgroesse) return EXIT_SUCCESS;
+
+    atomic_store(&ring->magic, 0);
+    memset(ring->platz, 0, RING_PLAETZE * sizeof(s10ringplatz));
+    ring->version = RING_VERSION;
+    ring->plaetze = RING_PLAETZE;
+    ring->platzgroesse = sizeof(s10ringplatz);
+    atomic_store(&ring->geschrieben, 0);
+    atomic_store_explicit(&ring->magic, RING_MAGIC, memory_order_release);
+    return EXIT_SUCCESS;
+}
+
+void RingpufferSchreiben(s10daten const *const daten, int64_t const zeit, uint32_t const latenz)
+{
+    if (NULL == ring) return;
+
+    uint32_t const nummer = atomic_load_explicit(&ring->geschrieben, memory_order_relaxed);
+    s10ringmesswert const messwert = { nummer, zeit, latenz, *daten };
+    s10ringplatz *const platz = ring->platz + nummer % RING_PLAETZE;
+
+    /* Seqlock: ungerade Sequenz markiert den Platz als "wird geschrieben", Leser verwerfen ihre Kopie dann */
+    uint32_t const sequenz = atomic_load_explicit(&platz->sequenz, memory_order_relaxed);
+    atomic_store_explicit(&platz->sequenz, sequenz + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&platz->messwert, &messwert, sizeof(s10ringmesswert));
+    atomic_store_explicit(&platz->sequenz, sequenz + 2, memory_order_release);
+    atomic_store_explicit(&ring->geschrieben, nummer + 1, memory_order_release);
+}
+
+void RingpufferSchliessen(void)
+{
+    if (NULL != ring) munmap(ring, sizeof(s10ring) + RING_PLAETZE * sizeof(s10ringplatz));
+    ring = NULL;
+}
@@ -0,0 +1,181 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Shared-Memory-Ringpuffer mit den letzten Messwerten des S10.
+ * S10auslesen schreibt jeden Messwert in den nächsten Platz des Rings, lokale Leser blenden das Segment mit RingpufferVerbinden()
+ * nur lesend ein und lesen danach ohne Systemaufrufe. Jeder Platz ist durch einen eigenen Sequenzzähler (Seqlock) geschützt:
+ * ungerade heißt "wird gerade geschrieben", ändert sich der Zähler während des Kopierens wird erneut gelesen. So sieht ein Leser
+ * niemals einen halb geschriebenen Messwert und bremst den Schreiber trotzdem nicht aus.
+ *
+ * Beispiel für einen Leser (mit -lrt linken):
+ *     s10ring const *const ring = RingpufferVerbinden("/S10auslesen");
+ *     s10ringmesswert messwert;
+ *     if (NULL != ring && RingpufferAktuell(ring, &messwert)) printf("%d W\n", messwert.daten.P_pv);
+ *     RingpufferTrennen(ring);
+ */
+
+#include "S10daten.h" /* für s10daten */
+
+#include <fcntl.h> /* für O_RDONLY */
+#include <stdatomic.h> /* für die Sequenzzähler */
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für NULL und size_t */
+#include <stdint.h> /* für uint32_t und Konsorten */
+#include <string.h> /* für memcpy */
+#include <sys/mman.h> /* für shm_open und mmap */
+#include <sys/stat.h> /* für fstat */
+#include <unistd.h> /* für close */
+
+/* "S10R" */
+#define RING_MAGIC          0x53313052u
+/* wird bei jeder Änderung des Aufbaus erhöht */
+#define RING_VERSION        2u
+
+/**
+ * ein Messwert im Ring mit seiner laufenden Nummer und seinem Erfassungszeitpunkt.
+ */
+typedef struct
+{
+    uint32_t nummer; /* laufende Nummer des Messwerts, der erste Messwert hat die Nummer 0 */
+    int64_t zeit; /* Erfassungszeitpunkt in Nanosekunden seit 1.1.1970 (UTC) */
+    uint32_t latenz; /* Dauer der Modbus-Abfrage in Mikrosekunden */
+    s10daten daten;
+} s10ringmesswert;
+
+/**
+ * ein Platz im Ring, geschützt durch seinen Sequenzzähler.
+ */
+typedef struct
+{
+    _Atomic uint32_t sequenz; /* ungerade während der Messwert geschrieben wird */
+    s10ringmesswert messwert;
+} s10ringplatz;
+
+/**
+ * Aufbau des Shared-Memory-Segments. Es werden bewusst nur 32bit-Atomics verwendet, da diese auch auf 32bit-ARM
+ * (Raspberry Pi) lockfrei und damit prozessübergreifend nutzbar sind.
+ */
+typedef struct
+{
+    _Atomic uint32_t magic; /* RING_MAGIC, wird erst nach vollständiger Initialisierung gesetzt */
+    uint32_t version; /* RING_VERSION */
+    uint32_t plaetze; /* Anzahl der Plätze im Ring */
+    uint32_t platzgroesse; /* sizeof(s10ringplatz) des Schreibers */
+    _Atomic uint32_t geschrieben; /* Anzahl bisher geschriebener Messwerte, der neueste hat die Nummer geschrieben - 1 */
+    s10ringplatz platz[];
+} s10ring;
+
+/**
+ * legt das Shared-Memory-Segment RING_NAME an bzw. übernimmt ein passendes vorhandenes Segment samt seiner Messwerte.
+ * @return EXIT_SUCCESS wenn das Segment bereitsteht, sonst EXIT_FAILURE.
+ */
+int_fast8_t RingpufferAnlegen(void);
+
+/**
+ * schreibt einen Messwert als neuesten Eintrag in den Ring.
+ * @param der Messwert.
+ * @param Erfassungszeitpunkt in Nanosekunden seit 1.1.1970 (UTC).
+ * @param Dauer der Modbus-Abfrage in Mikrosekunden.
+ */
+void RingpufferSchreiben(s10daten const* const, int64_t const, uint32_t const);
+
+/**
+ * blendet das Segment aus. Es bleibt mit dem letzten Messwert für Leser bestehen.
+ */
+void RingpufferSchliessen(void);
+
+/**
+ * blendet den Ring eines laufenden S10auslesen nur lesend ein.
+ * @param name Name des Segments, entspricht RING_NAME aus Einstellungen.h.
+ * @return der eingeblendete Ring oder NULL, falls er nicht existiert oder nicht zu diesem Header passt.
+ */
+static inline s10ring const *RingpufferVerbinden(char const *const name)
+{
+    int const fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    void *ring = MAP_FAILED;
+    if (0 == fstat(fd, &info) && info.st_size >= (off_t) sizeof(s10ring)) ring = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == ring) return NULL;
+
+    s10ring const *const r = (s10ring const*) ring;
+    if (RING_MAGIC != atomic_load_explicit(&r->magic, memory_order_acquire) || RING_VERSION != r->version
+        || sizeof(s10ringplatz) != r->platzgroesse || (off_t) (sizeof(s10ring) + r->plaetze * sizeof(s10ringplatz)) > info.st_size)
+    {
+        munmap(ring, info.st_size);
+        return NULL;
+    }
+    return r;
+}
+
+/**
+ * blendet einen mit RingpufferVerbinden() eingeblendeten Ring wieder aus.
+ * @param ring der Ring, darf NULL sein.
+ */
+static inline void RingpufferTrennen(s10ring const *const ring)
+{
+    if (NULL != ring) munmap((void*) ring, sizeof(s10ring) + ring->plaetze * sizeof(s10ringplatz));
+}
+
+/**
+ * @param ring der Ring.
+ * @return Anzahl der bisher geschriebenen Messwerte, der neueste hat die Nummer Rückgabewert - 1.
+ */
+static inline uint32_t RingpufferAnzahl(s10ring const *const ring)
+{
+    return atomic_load_explicit(&ring->geschrieben, memory_order_acquire);
+}
+
+/**
+ * liest den Messwert mit der angegebenen laufenden Nummer ohne Systemaufruf und ohne den Schreiber zu blockieren.
+ * @param ring der Ring.
+ * @param nummer laufende Nummer des gewünschten Messwerts.
+ * @param ziel wird mit dem Messwert gefüllt.
+ * @return true wenn der Messwert vollständig gelesen wurde, false wenn er noch nicht oder nicht mehr im Ring steht.
+ */
+static inline bool RingpufferLesen(s10ring const *const ring, uint32_t const nummer, s10ringmesswert *const ziel)
+{
+    s10ringplatz const *const platz = ring->platz + nummer % ring->plaetze;
+    for (int_fast8_t versuch = 0; versuch < 64; versuch++)
+    {
+        uint32_t const vorher = atomic_load_explicit(&platz->sequenz, memory_order_acquire);
+        if (vorher & 1u) continue; /* wird gerade geschrieben */
+        memcpy(ziel, &platz->messwert, sizeof(s10ringmesswert));
+        atomic_thread_fence(memory_order_acquire);
+        if (vorher == atomic_load_explicit(&platz->sequenz, memory_order_relaxed)) return nummer == ziel->nummer;
+    }
+    return false;
+}
+
+/**
+ * liest den neuesten Messwert.
+ * @param ring der Ring.
+ * @param ziel wird mit dem Messwert gefüllt.
+ * @return true wenn ein Messwert gelesen wurde, false wenn noch keiner geschrieben wurde.
+ */
+static inline bool RingpufferAktuell(s10ring const *const ring, s10ringmesswert *const ziel)
+{
+    uint32_t const anzahl = RingpufferAnzahl(ring);
+    return anzahl > 0 && RingpufferLesen(ring, anzahl - 1, ziel);
+}
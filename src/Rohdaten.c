@@ -0,0 +1,215 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Rohdaten.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+#include "Register.h" /* für die Adressen und das Dekodieren der Register */
+
+#include <endian.h> /* für die Identifikationsregister */
+#include <stdio.h> /* für Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* für memcpy */
+
+static uint16_t adressen[ROH_REGISTER_MAX]; /* Adressen der abgelegten Register */
+static size_t rohindex[ROH_REGISTER_MAX]; /* Platz jedes abgelegten Registers im Rohpuffer */
+static size_t anzahl = 0; /* Anzahl der abgelegten Register */
+static s10archivspalte spalten[ROH_REGISTER_MAX]; /* je Register eine Spalte mit 16 Bit ohne Vorzeichen */
+
+int_fast8_t RohPlanen(void)
+{
+    anzahl = RegisterAdressen(NULL);
+    if (anzahl > ROH_REGISTER_MAX)
+    {
+        fprintf(stderr, "S10auslesen: die Registerkarte verwendet mehr als %u Register für die Rohdaten\n", ROH_REGISTER_MAX);
+        anzahl = 0;
+        return EXIT_FAILURE;
+    }
+    RegisterAdressen(adressen);
+    for (size_t i = 0; i < anzahl; i++)
+    {
+        rohindex[i] = RegisterRohindex(adressen[i]);
+        spalten[i] = (s10archivspalte) { i * sizeof(uint16_t), sizeof(uint16_t), false };
+    }
+    return EXIT_SUCCESS;
+}
+
+size_t RohRegister(void)
+{
+    return anzahl;
+}
+
+void RohUebernehmen(uint16_t const *const roh, uint16_t *const zeile)
+{
+    for (size_t i = 0; i < anzahl; i++)
+        zeile[i] = roh[rohindex[i]];
+}
+
+/**
+ * legt den Kopf einer neuen Rohdatei an.
+ * @param fd die leere Rohdatei.
+ * @param tag 00:00:00 Uhr des Tages als Sekunden seit 1.1.1970 (UTC).
+ * @param id Identifikationsdaten der Anlage, sie werden wieder in die Form der gelesenen Register gebracht.
+ * @return EXIT_SUCCESS wenn der Kopf geschrieben wurde, sonst EXIT_FAILURE.
+ */
+static int_fast8_t KopfAnlegen(int const fd, time_t const tag, s10konstanten const *const id)
+{
+    s10rohkopf *const kopf = (s10rohkopf*) calloc(1, sizeof(s10rohkopf));
+    if (NULL == kopf) return EXIT_FAILURE;
+    kopf->magic = ROH_MAGIC;
+    kopf->version = ROH_VERSION;
+    kopf->tag = tag;
+    kopf->anzahl = anzahl;
+    atomic_init(&kopf->groesse, sizeof(s10rohkopf));
+    /* die Umkehrung von RegisterIdentifikation(), das Drehen der Bytes ist sein eigenes Gegenstück */
+    memcpy(kopf->identifikation, id, sizeof(s10konstanten));
+    for (size_t i = 3; i < sizeof(kopf->identifikation) / sizeof(uint16_t); i++)
+        kopf->identifikation[i] = htobe16(kopf->identifikation[i]);
+    memcpy(kopf->adressen, adressen, anzahl * sizeof(uint16_t));
+    int_fast8_t const result = sizeof(s10rohkopf) == pwrite(fd, kopf, sizeof(s10rohkopf), 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    free(kopf);
+    return result;
+}
+
+int_fast8_t RohAnhaengen(char const *const name, s10konstanten const *const id, time_t const start, uint16_t const *const zeilen,
+                         s10gueltig const *const gueltig, size_t von, size_t bis)
+{
+    if (sizeof(ROH_VERZEICHNIS) <= 1 || 0 == anzahl || von >= bis) return EXIT_SUCCESS;
+
+    time_t const tag = start - start % ARCHIV_SEKUNDEN;
+    struct tm datum;
+    gmtime_r(&tag, &datum);
+    char pfad[sizeof(ROH_VERZEICHNIS) + LEN_TABELLENAME + 8];
+    snprintf(pfad, sizeof(pfad), "%s/%s%s%04d_%02d_%02d.s10r", ROH_VERZEICHNIS, name, '\0' == *name ? "" : "_", datum.tm_year + 1900,
+             datum.tm_mon + 1, datum.tm_mday);
+
+    int const fd = open(pfad, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "S10auslesen: Rohdatei %s kann nicht geöffnet werden\n", pfad);
+        return EXIT_FAILURE;
+    }
+
+    int_fast8_t result = EXIT_FAILURE;
+    struct stat info;
+    s10rohkopf *kopf = MAP_FAILED;
+    if (0 == fstat(fd, &info) && (info.st_size > 0 || EXIT_SUCCESS == KopfAnlegen(fd, tag, id)))
+        kopf = (s10rohkopf*) mmap(NULL, sizeof(s10rohkopf), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED != kopf)
+    {
+        /* nach einer Änderung der Registerkarte passen die Spalten nicht mehr zu den bereits abgelegten Sekunden des Tages */
+        if (ROH_MAGIC == kopf->magic && ROH_VERSION == kopf->version && tag == kopf->tag && anzahl == kopf->anzahl
+            && 0 == memcmp(kopf->adressen, adressen, anzahl * sizeof(uint16_t)))
+        {
+            uint32_t const sekunde = start - tag;
+            if (sekunde + von < kopf->ende) von = kopf->ende - sekunde;
+            size_t const rohEnde = bis;
+            von = GueltigSuchen(gueltig, von, bis);
+            while (bis > von && !Gueltig(gueltig, bis - 1))
+                bis--;
+
+            result = EXIT_SUCCESS;
+            for (size_t blockStart = von; blockStart < bis && EXIT_SUCCESS == result; blockStart += ARCHIV_BLOCK_MAX)
+            {
+                size_t const sekunden = bis - blockStart < ARCHIV_BLOCK_MAX ? bis - blockStart : ARCHIV_BLOCK_MAX;
+                uint32_t const position = atomic_load(&kopf->groesse);
+                size_t laenge;
+                uint8_t *const block = ArchivBlockKodieren(sekunde + blockStart, zeilen, anzahl * sizeof(uint16_t), spalten, anzahl, gueltig,
+                                                           blockStart, sekunden, &laenge);
+                result = EXIT_FAILURE;
+                if (NULL != block && laenge == (size_t) pwrite(fd, block, laenge, position))
+                {
+#if JOURNAL_SYNC
+                    fdatasync(fd);
+#endif
+                    /* erst jetzt wird der Block für Leser sichtbar */
+                    atomic_store_explicit(&kopf->groesse, position + laenge, memory_order_release);
+                    result = EXIT_SUCCESS;
+                }
+                free(block);
+            }
+            if (EXIT_SUCCESS == result && sekunde + rohEnde > kopf->ende) kopf->ende = sekunde + rohEnde;
+        }
+        else
+            fprintf(stderr, "S10auslesen: %s ist keine passende Rohdatei\n", pfad);
+        munmap(kopf, sizeof(s10rohkopf));
+    }
+    if (EXIT_SUCCESS != result) fprintf(stderr, "S10auslesen: Rohdaten können nicht in %s abgelegt werden\n", pfad);
+    close(fd);
+    return result;
+}
+
+size_t RohDekodieren(s10rohdatei const *const datei, s10daten *const daten, int32_t *const zusatz, s10gueltig *const gueltig)
+{
+    s10rohkopf const *const kopf = datei->kopf;
+    size_t groesse = atomic_load_explicit(&kopf->groesse, memory_order_acquire);
+    if (groesse > datei->laenge) groesse = datei->laenge;
+
+    /* Rohpuffer wie bei der Erfassung, er behält die Werte der vorherigen Sekunde; dazu die Spalten eines Blocks */
+    uint16_t *const roh = (uint16_t*) calloc(RegisterRohwerte(), sizeof(uint16_t));
+    int64_t *const werte = (int64_t*) malloc((size_t) kopf->anzahl * ARCHIV_BLOCK_MAX * sizeof(int64_t));
+    int32_t *const verworfen = (int32_t*) malloc((zusatzregister + 1) * sizeof(int32_t));
+    size_t ziel[ROH_REGISTER_MAX];
+    for (size_t i = 0; i < kopf->anzahl; i++)
+        ziel[i] = RegisterRohindex(kopf->adressen[i]);
+
+    size_t dekodiert = 0;
+    uint8_t const *const inhalt = (uint8_t const*) kopf;
+    for (size_t position = sizeof(s10rohkopf); NULL != roh && NULL != werte && NULL != verworfen && position + sizeof(s10archivblock) <= groesse;)
+    {
+        s10archivblock const *const block = (s10archivblock const*) (inhalt + position);
+        position += sizeof(s10archivblock) + block->laenge;
+        if (position > groesse || block->anzahl > ARCHIV_BLOCK_MAX || block->erste + block->anzahl > ARCHIV_SEKUNDEN) break;
+
+        /* 1) alle Spalten des Blocks am Stück dekodieren */
+        uint8_t const *const bitmap = (uint8_t const*) (block + 1);
+        size_t vorhanden = 0;
+        for (uint32_t i = 0; i < block->anzahl; i++)
+            if (bitmap[i / 8] & (1u << i % 8)) vorhanden++;
+        uint8_t const *pos = bitmap + (block->anzahl + 7) / 8;
+        uint8_t const *const ende = (uint8_t const*) (block + 1) + block->laenge;
+        for (size_t spalte = 0; spalte < kopf->anzahl; spalte++)
+        {
+            uint64_t const laenge = ArchivVarint(&pos, ende);
+            ArchivSpalteDekodieren(pos, pos + laenge, vorhanden, werte + spalte * ARCHIV_BLOCK_MAX);
+            pos += laenge;
+        }
+
+        /* 2) Sekunde für Sekunde den Rohpuffer aktualisieren und mit der Registerkarte dekodieren */
+        for (uint32_t i = 0, k = 0; i < block->anzahl; i++)
+        {
+            if (0 == (bitmap[i / 8] & (1u << i % 8))) continue;
+            for (size_t spalte = 0; spalte < kopf->anzahl; spalte++)
+                if (SIZE_MAX != ziel[spalte]) roh[ziel[spalte]] = (uint16_t) werte[spalte * ARCHIV_BLOCK_MAX + k];
+            uint32_t const sekunde = block->erste + i;
+            RegisterDekodieren(roh, daten + sekunde, NULL == zusatz ? verworfen : zusatz + (size_t) sekunde * zusatzregister);
+            GueltigSetzen(gueltig, sekunde);
+            dekodiert++;
+            k++;
+        }
+    }
+    free(verworfen);
+    free(werte);
+    free(roh);
+    return dekodiert;
+}
+
+void RohIdentifikation(s10rohdatei const *const datei, s10konstanten *const id)
+{
+    RegisterIdentifikation(datei->kopf->identifikation, id);
+}
@@ -0,0 +1,173 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * Rohdaten: die unverarbeiteten Register jeder Sekunde, eine Datei pro Anlage und Tag (ROH_VERZEICHNIS/[Name_]YYYY_MM_DD.s10r).
+ * Abgelegt werden nur die Register, aus denen die Registerkarte ihre Felder zusammensetzt, als 16-Bit-Wörter so wie libmodbus sie liefert.
+ * Die Erfassung kopiert dafür je Sekunde nur diese Wörter, kodiert werden sie im Schreib-Thread und dekodiert erst beim Lesen. Wird die
+ * Registerkarte korrigiert (z.B. Wortfolge oder Vorzeichen eines Felds), lassen sich so auch ältere Tage mit RohDekodieren() neu dekodieren.
+ *
+ * Aufbau einer Datei:
+ *     s10rohkopf            Identifikationsregister wie gelesen sowie Anzahl und Adressen der abgelegten Register
+ *     Block, Block, ...     aufgebaut wie im Archiv (s10archivblock, Bitmap, Spalten), mit einer Spalte je abgelegtem Register
+ *
+ * Beispiel für einen Leser, dekodiert wird mit der Registerkarte des Lesers:
+ *     s10rohdatei datei;
+ *     if (EXIT_SUCCESS == RegisterPlanen() && RohVerbinden("/var/lib/S10auslesen/roh/2024_05_01.s10r", &datei))
+ *         RohDekodieren(&datei, daten, NULL, gueltig);
+ *     RohTrennen(&datei);
+ */
+
+#include "Archiv.h" /* für den Aufbau der Blöcke */
+#include "S10daten.h" /* für s10daten und s10konstanten */
+
+#include <fcntl.h> /* für O_RDONLY */
+#include <stdatomic.h> /* für die gültige Länge */
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für uint32_t und Konsorten */
+#include <sys/mman.h> /* für mmap */
+#include <sys/stat.h> /* für fstat */
+#include <time.h> /* für time_t */
+#include <unistd.h> /* für close */
+
+/* "S10W" */
+#define ROH_MAGIC           0x53313057u
+/* wird bei jeder Änderung des Aufbaus erhöht */
+#define ROH_VERSION         1u
+/* höchstens so viele Register werden je Sekunde abgelegt */
+#define ROH_REGISTER_MAX    256u
+
+/**
+ * Kopf einer Rohdatei.
+ */
+typedef struct
+{
+    uint32_t magic; /* ROH_MAGIC */
+    uint32_t version; /* ROH_VERSION */
+    int64_t tag; /* 00:00:00 Uhr des Tages als Sekunden seit 1.1.1970 (UTC) */
+    uint32_t anzahl; /* Anzahl der abgelegten Register je Sekunde */
+    uint32_t ende; /* erste Sekunde des Tages, die noch nicht abgelegt ist */
+    _Atomic uint32_t groesse; /* gültige Länge der Datei, wird erst nach dem vollständigen Anhängen eines Blocks erhöht */
+    uint16_t identifikation[sizeof(s10konstanten) / sizeof(uint16_t)]; /* Register 0 bis IDENTIFIKREGISTER - 1 wie gelesen */
+    uint16_t adressen[ROH_REGISTER_MAX]; /* Adressen der abgelegten Register in der Reihenfolge der Spalten */
+} s10rohkopf;
+
+/**
+ * eine nur lesend eingeblendete Rohdatei.
+ */
+typedef struct
+{
+    s10rohkopf const *kopf; /* NULL wenn nicht eingeblendet */
+    size_t laenge; /* eingeblendete Länge */
+} s10rohdatei;
+
+/**
+ * legt fest, welche Register je Sekunde abgelegt werden, einmalig nach RegisterPlanen().
+ * @return EXIT_SUCCESS wenn die Register feststehen, sonst EXIT_FAILURE (mehr als ROH_REGISTER_MAX Register).
+ */
+int_fast8_t RohPlanen(void);
+
+/**
+ * @return Anzahl der Wörter, die RohUebernehmen() je Sekunde ablegt.
+ */
+size_t RohRegister(void);
+
+/**
+ * übernimmt die abzulegenden Register aus dem Rohpuffer in die Zeile einer Sekunde.
+ * @param der mit RegisterLesen() gefüllte Rohpuffer.
+ * @param Zeile mit RohRegister() Wörtern.
+ */
+void RohUebernehmen(uint16_t const* const, uint16_t* const);
+
+/**
+ * hängt die Rohdaten eines Ausschnitts einer Stunde als Block an die Rohdatei ihres Tages an und legt diese ggfs. an.
+ * Bereits abgelegte Sekunden werden übersprungen, ein wiederholter Aufruf ist daher unschädlich.
+ * @param Name der Anlage, der dem Dateinamen vorangestellt wird, "" = ohne Namen.
+ * @param Identifikationsdaten der Anlage für den Kopf einer neuen Datei.
+ * @param hh:00:00 Uhr der Stunde als Sekunden seit 1.1.1970 (UTC).
+ * @param Zeilen der Stunde mit je RohRegister() Wörtern.
+ * @param Gültigkeit der Zeilen, fehlende Sekunden werden nicht abgelegt.
+ * @param erste Sekunde der Stunde, die abgelegt wird.
+ * @param erste Sekunde der Stunde, die nicht mehr abgelegt wird.
+ * @return EXIT_SUCCESS wenn der Block angehängt wurde oder nichts zu tun war, sonst EXIT_FAILURE.
+ */
+int_fast8_t RohAnhaengen(char const* const, s10konstanten const* const, time_t const, uint16_t const* const, s10gueltig const* const, size_t const,
+                         size_t const);
+
+/**
+ * dekodiert alle Sekunden einer Rohdatei blockweise mit der Registerkarte des Aufrufers, vorher muss RegisterPlanen() gelaufen sein.
+ * Register der Datei, die die Registerkarte nicht mehr verwendet, werden übergangen, neu hinzugekommene Register bleiben 0.
+ * @param die Rohdatei.
+ * @param Array mit ARCHIV_SEKUNDEN Messwerten, wird für jede abgelegte Sekunde gefüllt.
+ * @param Array mit ARCHIV_SEKUNDEN * zusatzregister Werten der zusätzlichen Register, NULL = nicht benötigt.
+ * @param Gültigkeit mit GUELTIG_WORTE(ARCHIV_SEKUNDEN) Worten, in der jede abgelegte Sekunde gesetzt wird.
+ * @return Anzahl der dekodierten Sekunden.
+ */
+size_t RohDekodieren(s10rohdatei const* const, s10daten* const, int32_t* const, s10gueltig* const);
+
+/**
+ * dekodiert die Identifikationsdaten aus dem Kopf einer Rohdatei.
+ * @param die Rohdatei.
+ * @param Identifikationsdaten, die gefüllt werden.
+ */
+void RohIdentifikation(s10rohdatei const* const, s10konstanten* const);
+
+/**
+ * blendet eine Rohdatei nur lesend ein.
+ * @param pfad Pfad der Rohdatei.
+ * @param datei wird mit der eingeblendeten Datei gefüllt.
+ * @return true wenn die Datei eingeblendet wurde, false wenn sie nicht existiert oder nicht zu diesem Header passt.
+ */
+static inline bool RohVerbinden(char const *const pfad, s10rohdatei *const datei)
+{
+    datei->kopf = NULL;
+    datei->laenge = 0;
+    int const fd = open(pfad, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat info;
+    void *inhalt = MAP_FAILED;
+    if (0 == fstat(fd, &info) && info.st_size >= (off_t) sizeof(s10rohkopf)) inhalt = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == inhalt) return false;
+
+    s10rohkopf const *const kopf = (s10rohkopf const*) inhalt;
+    if (ROH_MAGIC != kopf->magic || ROH_VERSION != kopf->version || kopf->anzahl > ROH_REGISTER_MAX)
+    {
+        munmap(inhalt, info.st_size);
+        return false;
+    }
+    datei->kopf = kopf;
+    datei->laenge = info.st_size;
+    return true;
+}
+
+/**
+ * blendet eine mit RohVerbinden() eingeblendete Datei wieder aus.
+ * @param datei die Rohdatei.
+ */
+static inline void RohTrennen(s10rohdatei *const datei)
+{
+    if (NULL != datei->kopf) munmap((void*) datei->kopf, datei->laenge);
+    datei->kopf = NULL;
+    datei->laenge = 0;
+}
@@ -18,18 +18,62 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "S10auslesen.h" /* zugehöriger Header dieser Datei */
+#include "Aggregat.h" /* Kennzahlen je Zeitfenster */
+#include "Archiv.h" /* kompaktes Archiv als Alternative zur Datenbank */
+#include "Ausgabe.h" /* Ausgabe der Messwerte in eigenen Threads */
+#include "Delta.h" /* Änderungsaufzeichnung */
 #include "Einstellungen.h" /* für die Benutzerdaten */
+#include "JSON.h" /* Ausgabe der Messwerte als JSON-Datei */
+#include "Journal.h" /* Sicherung der Messwerte bis sie in der Datenbank stehen */
+#include "Metriken.h" /* Laufzeitmetriken */
+#include "MQTT.h" /* Veröffentlichung der Messwerte über MQTT */
+#include "Register.h" /* Registerkarte des S10 */
+#include "Ringpuffer.h" /* Shared-Memory-Ausgabe der letzten Messwerte */
+#include "Rohdaten.h" /* unverarbeitete Register jeder Sekunde */
+#include "Webserver.h" /* HTTP-Ausgabe der Messwerte */
 
 #include <mariadb/mysql.h> /* für die SQL-Verbindung */
 #include <modbus/modbus-tcp.h> /* für die Modbus-Verbindung */
 
-#include <endian.h> /* Umwandlung E3/DC Big Endian zum Format des Host-Rechners */
+#include <errno.h> /* für EINTR und die Fehler der Modbus-Verbindung */
+#include <inttypes.h> /* für PRId64 */
+#include <math.h> /* für sqrt */
+#include <pthread.h> /* für den Schreib-Thread */
+#include <signal.h> /* sauberes Beenden bei SIGTERM */
+#include <stdbool.h> /* für bool */
 #include <stdint.h> /* für int32_t und Konsorten */
 #include <stdio.h> /* für Dateioperation und String-Formatierung */
 #include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
 #include <string.h> /* String-Operationen */
 #include <time.h> /* für die Funktionen rund um die Datums- und Zeitberechnungen */
 
+/* wird bei SIGTERM/SIGINT gesetzt, die Erfassung endet dann vorzeitig und die bisherigen Messwerte werden noch eingetragen */
+static volatile sig_atomic_t beenden = 0;
+
+/* die auszulesenden Hauskraftwerke, nur die erste Anlage gibt ihre Messwerte zusätzlich als JSON-Datei, im Ring und über den Webserver aus */
+static s10anlage const anlagen[] = { { "", S10_ADRESSE, S10_PORT }, S10_WEITERE };
+#define ANLAGEN (sizeof(anlagen) / sizeof(anlagen[0]))
+/* ist ein Archivverzeichnis eingestellt? */
+#define ARCHIV_AKTIV (sizeof(ARCHIV_VERZEICHNIS) > 1)
+/* werden die Rohdaten abgelegt? */
+#define ROH_AKTIV (sizeof(ROH_VERZEICHNIS) > 1)
+
+/* ein Lesefehler, das Neuverbinden und das Lesen der Identifikationsdaten müssen zusammen in eine Sekunde passen, RegisterLesen()
+ * begrenzt dafür alle Abfragen einer Sekunde zusammen auf MODBUS_ANTWORTZEIT, unabhängig von der Anzahl der geplanten Abfragen */
+#if 2 * MODBUS_ANTWORTZEIT + MODBUS_VERBINDEN >= 1000
+#error 2 * MODBUS_ANTWORTZEIT + MODBUS_VERBINDEN muss unter 1000 ms bleiben
+#endif
+
+/**
+ * Signalbehandlung für SIGTERM/SIGINT: fordert das Beenden des Programms an.
+ * @param signum das empfangene Signal.
+ */
+static void BeendenAnfordern(int const signum)
+{
+    (void) signum;
+    beenden = 1;
+}
+
 /**
  * gibt die aktuelle - sprich im Moment der Codeausführung vorliegenden - Datum und Zeit zurück.
  * @return gibt Datum und Uhrzeit des aktuellen Zeitpunkts zurück.
@@ -37,385 +81,1350 @@
 static inline struct tm Jetzt(void)
 {
     time_t const uhrzeit = time(NULL);
-    return *gmtime(&uhrzeit);
+    struct tm jetzt;
+    gmtime_r(&uhrzeit, &jetzt);
+    return jetzt;
 }
 
 /**
- * Datum und Zeit (auf die Stunde genau), für welches das die Leistungsdaten des S10 ausgelesen werden.
- * @return das (stundengenaue) Datum und Uhrzeit, für welches die Leistungsdaten ausgelesen werden.
+ * Zeitpunkt (auf die Stunde genau), ab dem die Leistungsdaten des S10 ausgelesen werden.
+ * Gerechnet wird ganz in UTC, eine Normalisierung über die lokale Zeitzone (mktime) entfällt damit.
+ * @return Beginn der nächsten vollen Stunde in Sekunden seit 1.1.1970 (UTC).
  */
-static inline struct tm StartDatum(void)
+static inline time_t StartZeitpunkt(void)
 {
-    struct tm jetzt = Jetzt();
-    jetzt.tm_hour++;
-    /* normalisieren (z.b. aus dem 32.Januar muss der 1.Februar gemacht werden
-	 * Schritt 1: Umwandeln von dd.mm.yyyy -> arithmetisches time_t (= 64bit mit Sekunden seit 1.1.1970) */
-    time_t const start = mktime(&jetzt);
-    /* 2. Schritt: aus dem generischen uhrzeit wird wieder ein Datum ---> zeit enthält das Datum der nächsten Stunde! */
-    return *gmtime(&start);
+    return (time(NULL) / NO_DATEN + 1) * NO_DATEN;
 }
 
 /**
- * legt das Programm schlafen bis die volle Stunde erreicht wird, also bis Minute = 0 und Sekunde = 0 erreicht wird.
+ * legt das Programm mit einem einzigen Weckzeitpunkt schlafen, bis die Uhrzeit den angegebenen Zeitpunkt erreicht.
+ * Da absolut auf CLOCK_REALTIME gewartet wird, verschiebt sich der Weckzeitpunkt mit, falls die Uhr zwischenzeitlich (z.B. per NTP) gestellt wird.
+ * @param zeitpunkt Sekunden seit 1.1.1970 (UTC).
+ * @return true wenn der Zeitpunkt erreicht ist, false wenn das Programm vorher beendet werden soll.
  */
-static inline void SchlafeBisVolleStunde(void)
+static bool SchlafeBis(time_t const zeitpunkt)
 {
-    struct timespec const feinSchlafen = { 0, AUFLOESUNG_WART_NS };
-    int_fast8_t schlafabbruch = 0;
-    struct tm jetzt;
+    struct timespec const termin = { zeitpunkt, 0 };
+    while (!beenden)
+        if (EINTR != clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &termin, NULL)) return true;
+    return false;
+}
 
-    do
-    {
-        jetzt = Jetzt();
-        time_t const wartezeit = 60 * (59 - jetzt.tm_min) + 58 - jetzt.tm_sec; /* Sekunden bis hh:59:58 Uhr */
-        struct timespec const grobSchlafen = { wartezeit < 0 ? 0 : wartezeit, 0 };
-        schlafabbruch = nanosleep(&grobSchlafen, NULL);
-    } while (schlafabbruch);
-    /* es ist jetzt HH:59:58 (2 Sekunden Abstand zur Uhrzeit weil die Nachkommastelle nicht bekannt ist
-	 * falls der nächste Schritt die nächste Sekunde voll macht würde es einen Zeitverzug von einer Stunde ergeben) */
+/**
+ * gibt das Zeitverhalten der Abfragen einer Stunde aus.
+ * @param stunde die Stunde.
+ * @param statistik die gesammelten Werte der Stunde.
+ */
+static void ZeitstatistikAusgeben(s10stunde const *const stunde, s10zeitstatistik const *const statistik)
+{
+    if (0 == statistik->messungen + statistik->ausgelassen + statistik->lesefehler + statistik->getrennt) return;
 
-    do
-    {
-        nanosleep(&feinSchlafen, NULL);
-        jetzt = Jetzt();
-    } while (jetzt.tm_sec > 0 && jetzt.tm_min > 0);
+    double const n = statistik->messungen > 0 ? statistik->messungen : 1;
+    double const verzug = statistik->verzugSumme / n;
+    double const varianz = statistik->verzugQuadratsumme / n - verzug * verzug;
+    printf("S10auslesen: %s %04d-%02d-%02d %02d:00 %zu Messwerte, %zu ausgelassen, %zu Lesefehler, %zu ohne Verbindung, "
+           "Verzug %.0f us (Jitter %.0f us, max %" PRId64 " us), Modbus %.1f ms (max %.1f ms)\n", anlagen[stunde->anlage].adresse,
+           stunde->zeit.tm_year + 1900, stunde->zeit.tm_mon + 1, stunde->zeit.tm_mday, stunde->zeit.tm_hour, statistik->messungen,
+           statistik->ausgelassen, statistik->lesefehler, statistik->getrennt, verzug, varianz > 0 ? sqrt(varianz) : 0, statistik->verzugMax,
+           statistik->latenzSumme / n / 1000, statistik->latenzMax / 1000.0);
+    fflush(stdout);
 }
 
 /**
- * Speichert die Leistungsdaten als Datei im JSON-Format.
- * @param p die Leistungsdaten der aktuellen Sekunde, welche als JSON-Datei ausgegeben werden sollen.
+ * baut eine Modbus-Verbindung zum S10-Hauskraftwerk auf. libmodbus verbindet ab 3.1 nicht blockierend und wartet dabei höchstens seine
+ * Antwortzeit, die daher erst auf MODBUS_VERBINDEN und danach für die Abfragen auf MODBUS_ANTWORTZEIT gesetzt wird. So kehrt auch eine
+ * Abfrage an ein verstummtes S10 rechtzeitig vor der nächsten Sekunde zurück.
+ * @param anlage das Hauskraftwerk.
+ * @return die offene Modbus-Verbindung oder NULL falls keine Verbindung aufgebaut werden konnte.
  */
-static inline void ErzeugeJSON(s10daten *const p)
+static modbus_t *ModbusVerbinden(s10anlage const *const anlage)
 {
-    FILE *const f = fopen(JSON_FILE, "w");
-    if (NULL != f)
+    modbus_t *const modbus = modbus_new_tcp(anlage->adresse, anlage->port);
+    bool const verbunden = NULL != modbus && ModbusWartezeit(modbus, MODBUS_VERBINDEN) && 0 == modbus_connect(modbus)
+        && ModbusWartezeit(modbus, MODBUS_ANTWORTZEIT);
+    MetrikModbusVerbindung(anlage - anlagen, verbunden);
+    if (verbunden) return modbus;
+    if (NULL != modbus)
     {
-        fprintf(f,
-                "{\"Ppv\":%d,\"Pbat\":%d,\"Phaus\":%d,\"Pnetz\":%d,\"Pext\":%d,\"Pwbx\":%d,\"Ppvwb\":%d,\"eigen\":%hhu,\"autark\":%hhu,\"SOC\":%hu,"
-				"\"NOT\":%hu,\"EMS\":%hu,\"Wb1\":%hu,\"Wb2\":%hu,\"Wb3\":%hu,\"Wb4\":%hu,\"Wb5\":%hu,\"Wb6\":%hu,\"Wb7\":%hu,\"Wb8\":%hu,\"Vdc1\":%hu,"
-				"\"Vdc2\":%hu,\"Vdc3\":%hu,\"Idc1\":%hu,\"Idc2\":%hu,\"Idc3\":%hu,\"Pdc1\":%hu,\"Pdc2\":%hu,\"Pdc3\":%hu}",
-                p->P_pv, p->P_bat, p->P_haus, p->P_netz, p->P_ext, p->P_wall, p->P_pvwall, p->eigen, p->autarkie, p->soc, p->notstr, p->ems, p->wall1,
-                p->wall2, p->wall3, p->wall4, p->wall5, p->wall6, p->wall7, p->wall8, p->Vdc1, p->Vdc2, p->Vdc3, p->Idc1, p->Idc2, p->Idc3, p->Pdc1,
-                p->Pdc2, p->Pdc3);
-        fclose(f);
+        modbus_close(modbus);
+        modbus_free(modbus);
     }
+    return NULL;
+}
+
+/**
+ * baut eine Modbus-Verbindung ab, falls sie besteht.
+ * @param modbus Modbus-Verbindung, wird auf NULL gesetzt.
+ */
+static void ModbusTrennen(modbus_t **const modbus)
+{
+    if (NULL == *modbus) return;
+    modbus_close(*modbus);
+    modbus_free(*modbus);
+    *modbus = NULL;
+}
+
+/**
+ * unterscheidet eine abgebrochene Verbindung von einer ausgebliebenen Antwort.
+ * @param fehler errno nach der gescheiterten Abfrage.
+ * @return true wenn die Verbindung nicht mehr besteht und sofort neu aufgebaut werden sollte.
+ */
+static inline bool VerbindungAbgebrochen(int const fehler)
+{
+    return ECONNRESET == fehler || EPIPE == fehler || ENOTCONN == fehler || EBADF == fehler || ECONNREFUSED == fehler;
+}
+
+/**
+ * plant den nächsten Versuch zum Neuverbinden nach einem gescheiterten Versuch.
+ * @param jetzt aktuelle Sekunde seit 1.1.1970 (UTC).
+ * @param wartezeit Abstand zum vorherigen Versuch in Sekunden, wird verdoppelt (höchstens NEUVERBIND_MAX).
+ * @param zufall Zustand für rand_r().
+ * @return Sekunde des nächsten Versuchs, um bis zur Hälfte der Wartezeit zufällig vorgezogen.
+ */
+static time_t NeuverbindenPlanen(time_t const jetzt, uint32_t *const wartezeit, unsigned int *const zufall)
+{
+    uint32_t const abstand = *wartezeit;
+    *wartezeit = 2 * abstand < NEUVERBIND_MAX ? 2 * abstand : NEUVERBIND_MAX;
+    return jetzt + abstand - rand_r(zufall) % (abstand / 2 + 1);
 }
 
 /**
  * liest die Leistungsdaten des S10 in der aktuellen Stunde sekundengenau aus.
- * 1) Stellt eine Modbus-Verbindung mit dem S10-Hauskraftwerk her
- * 2) liest die Leistungsdaten mit den sekundengenauen Messwerten des S10 aus und bereitet sie maschinenlesbar auf.
- * 3) steuert das Aufrufen von Funktionen, welche die Daten sekundengenau als Datei ausgeben.
- * 4) stellt bei Verbindungsverlust eine neue Verbindung her während die zeitliche Reihenfolge der Daten aufrechterhalten wird
- *    indem Nulleinträge für jede Sekunde ohne auslesbare Daten erzeugt werden.
- * @param aktstundenmesswerte Array, in das für die aktuelle Stunde für jede Sekunde die ausgelesenen Leistungsdaten steigend angeordnet eingetragen wird.
+ * 1) liest die Leistungsdaten mit den sekundengenauen Messwerten des S10 samt S10_ZUSATZREGISTER in den mit RegisterPlanen()
+ *    zusammengefassten Abfragen aus und setzt sie nach der Registerkarte zusammen. Jede Sekunde werden nur die fälligen Gruppen gelesen,
+ *    zu Beginn der Stunde und nach jedem Neuverbinden alle. Mit ROH_VERZEICHNIS werden die gelesenen Register zusätzlich unverarbeitet übernommen.
+ * 2) sichert jeden Messwert sofort im Journal und reiht ihn mit AusgabeEinreihen() für MQTT und bei der ersten Anlage für JSON-Datei,
+ *    Shared-Memory-Ring und Webserver ein, zusammen mit dem tatsächlichen Erfassungszeitpunkt und der Dauer der Modbus-Abfrage.
+ *    Ausgegeben wird in den Ausgabe-Threads.
+ * 3) stellt bei abgebrochener Verbindung oder nach LESEFEHLER_AKZEPT Lesefehlern in Folge eine neue Verbindung her und liest danach die
+ *    Identifikationsdaten neu aus. Gescheiterte Versuche werden mit wachsendem, zufällig verkürztem Abstand wiederholt (NEUVERBIND_MIN bis
+ *    NEUVERBIND_MAX), nach NEUVERBIND_AKZEPT Sekunden ohne Verbindung wird abgebrochen. Da Abfragen und Verbindungsaufbau nur begrenzt
+ *    warten, hält kein Ausfall die Erfassung länger als eine Sekunde auf. Die Sekunde wird dabei immer aus der Uhrzeit bestimmt, nur
+ *    ausgelesene Messwerte werden in stunde->gueltig markiert, für Sekunden ohne Messwert wird ihr Grund (ausgelassen, Lesefehler,
+ *    ohne Verbindung) gezählt und mit LUECKEN in stunde->grund vermerkt.
+ * 4) meldet dem Schreib-Thread sekündlich den Fortschritt.
+ * 5) bricht vorzeitig ab, wenn das Programm beendet werden soll.
+ * 6) gibt zum Ende der Stunde auf Wunsch (ZEITSTATISTIK) Weckverzug, Jitter und Modbus-Latenz der Abfragen aus.
+ * @param modbus Modbus-Verbindung zum S10, wird bei Verbindungsverlust neu aufgebaut und darf auch NULL sein.
+ * @param konstanten s10konstanten_t, welches nach einem Neuverbinden mit den neu ausgelesenen Identifikationsdaten gefüllt wird.
+ * @param stunde s10stunde_t, in dessen Array für die aktuelle Stunde für jede Sekunde die ausgelesenen Leistungsdaten steigend angeordnet eingetragen wird.
  * @return EXIT_SUCCESS wenn die Daten erfolgreich gelesen werden konnten, sonst EXIT_FAILURE.
  */
-int_fast8_t LeistungsdatenAuslesenModbus(s10daten *const aktstundenmesswerte)
+int_fast8_t LeistungsdatenAuslesenModbus(modbus_t **const modbus, s10konstanten *const konstanten, s10stunde *const stunde)
 {
     int_fast8_t result = EXIT_FAILURE;
+    s10daten *const aktstundenmesswerte = stunde->daten;
+
+    uint16_t *const modbuslesewert = (uint16_t*) calloc(RegisterRohwerte(), sizeof(uint16_t));
+    int32_t *const zusatzwerte = (int32_t*) calloc(zusatzregister + 1, sizeof(int32_t));
+    if (NULL == modbuslesewert || NULL == zusatzwerte)
+    {
+        free(zusatzwerte);
+        free(modbuslesewert);
+        return result;
+    }
 
-    modbus_t *modbus = modbus_new_tcp(S10_ADRESSE, S10_PORT);
-    if (NULL == modbus) return result;
-    if (0 == modbus_connect(modbus))
+    s10zeitstatistik *const statistik = &stunde->statistik;
+    struct timespec erfassung, abfrageStart, abfrageEnde;
+    size_t sekunden = 0;
+    /* beim Start mitten in der Stunde (Dauerbetrieb) wird mit der nächsten vollen Sekunde begonnen */
+    clock_gettime(CLOCK_REALTIME, &erfassung);
+    if (erfassung.tv_sec > stunde->start) sekunden = erfassung.tv_sec - stunde->start + 1;
+    int_fast16_t fehler = 0;
+    time_t getrenntSeit = 0; /* erste Sekunde ohne Verbindung, 0 = verbunden */
+    time_t naechsterVersuch = 0; /* frühestens dann wird wieder neu verbunden */
+    uint32_t wartezeit = NEUVERBIND_MIN; /* Abstand zum nächsten Versuch, falls dieser scheitert */
+    unsigned int zufall = (unsigned int) erfassung.tv_nsec ^ stunde->anlage;
+    s10registertakt takt = { { 0 } }; /* zu Beginn sind alle Gruppen fällig */
+    /* genau ein Wecken pro Sekunde: es wird absolut bis zur nächsten Sekundengrenze geschlafen, so summiert sich kein Verzug auf */
+    while (sekunden < NO_DATEN && SchlafeBis(stunde->start + sekunden))
     {
-        uint16_t *const modbuslesewert = (uint16_t*) calloc(LEISTUNGSREGISTER, sizeof(uint16_t));
-        if (NULL != modbuslesewert)
+        clock_gettime(CLOCK_REALTIME, &erfassung);
+        /* die Sekunde ergibt sich aus der Uhrzeit, damit auch nach Verzögerungen jeder Messwert an seiner richtigen Stelle steht */
+        size_t const sekunde = erfassung.tv_sec - stunde->start;
+        if (sekunde >= NO_DATEN) break;
+        if (sekunde < sekunden) continue; /* die Uhr wurde soeben zurückgestellt */
+        statistik->ausgelassen += sekunde - sekunden;
+        if (LUECKEN) memset(stunde->grund + sekunden, LUECKE_AUSGELASSEN, sekunde - sekunden);
+        MetrikAusgelassen(stunde->anlage, sekunde - sekunden);
+        sekunden = sekunde;
+
+        clock_gettime(CLOCK_MONOTONIC, &abfrageStart);
+        if (NULL != *modbus && EXIT_SUCCESS == RegisterLesen(*modbus, modbuslesewert, &takt, erfassung.tv_sec))
         {
-            struct timespec zeit;
-            if (0 == clock_gettime(CLOCK_MONOTONIC_COARSE, &zeit))
+            fehler = 0;
+            clock_gettime(CLOCK_MONOTONIC, &abfrageEnde);
+            int64_t const verzug = erfassung.tv_nsec / 1000;
+            int64_t const latenz = (abfrageEnde.tv_sec - abfrageStart.tv_sec) * 1000000 + (abfrageEnde.tv_nsec - abfrageStart.tv_nsec) / 1000;
+            statistik->messungen++;
+            statistik->verzugSumme += verzug;
+            statistik->verzugQuadratsumme += verzug * verzug;
+            if (verzug > statistik->verzugMax) statistik->verzugMax = verzug;
+            statistik->latenzSumme += latenz;
+            if (latenz > statistik->latenzMax) statistik->latenzMax = latenz;
+            MetrikModbusAbfrage(stunde->anlage, true, latenz);
+
+            RegisterDekodieren(modbuslesewert, aktstundenmesswerte + sekunden, zusatzwerte);
+            if (ROH_AKTIV) RohUebernehmen(modbuslesewert, stunde->roh + sekunden * RohRegister());
+            GueltigSetzen(stunde->gueltig, sekunden);
+            if (AGGREGATE) AggregatHinzufuegen(stunde->aggregate, stunde->start, sekunden, aktstundenmesswerte + sekunden);
+            /* das Journal direkt, es darf keinen Messwert verlieren und muss vor dem Fortschritt (erfasst) geschrieben sein */
+            JournalAnhaengen(stunde->anlage, stunde->start + sekunden, aktstundenmesswerte + sekunden);
+            /* JSON-Datei, Ring, Webserver und MQTT übernehmen die Ausgabe-Threads, die Erfassung wartet nie auf sie */
+            AusgabeEinreihen(stunde->anlage, aktstundenmesswerte + sekunden, zusatzwerte,
+                             (int64_t) erfassung.tv_sec * 1000000000 + erfassung.tv_nsec, latenz);
+        }
+        else
+        {
+            int const lesefehler = errno;
+            if (LUECKEN) stunde->grund[sekunden] = NULL != *modbus ? LUECKE_LESEFEHLER : LUECKE_GETRENNT;
+            if (NULL != *modbus)
+            {
+                statistik->lesefehler++;
+                MetrikModbusAbfrage(stunde->anlage, false, 0);
+            }
+            else
+                statistik->getrennt++;
+            /* Fehlerfall modbus_read_registers: eine abgebrochene Verbindung wird sofort ersetzt, ausbleibende Antworten erst nach mehreren */
+            if (NULL != *modbus && (++fehler > LESEFEHLER_AKZEPT || VerbindungAbgebrochen(lesefehler)))
+            {
+                ModbusTrennen(modbus);
+                naechsterVersuch = 0;
+                wartezeit = NEUVERBIND_MIN;
+            }
+            if (NULL == *modbus && 0 == getrenntSeit) getrenntSeit = erfassung.tv_sec;
+            if (NULL == *modbus && erfassung.tv_sec >= naechsterVersuch)
             {
-                struct timespec const feinSchlafen = { 0, AUFLOESUNG_LESE_NS };
-                struct timespec const grobSchlafen = { 1, 0 };
-                time_t const startsek = zeit.tv_sec;
-                size_t sekunden = 0;
-                int_fast16_t fehler = 0;
-                while (sekunden < NO_DATEN)
+                *modbus = ModbusVerbinden(anlagen + stunde->anlage);
+                if (NULL != *modbus)
                 {
-                    clock_gettime(CLOCK_MONOTONIC_COARSE, &zeit); /* kein neuer Check notwendig da durch folgende if-Schleife indirekt abgedeckt */
-                    if (zeit.tv_sec > startsek + sekunden)
-                    {
-                        if (LEISTUNGSREGISTER == modbus_read_registers(modbus, IDENTIFIKREGISTER, LEISTUNGSREGISTER, modbuslesewert))
-                        {
-                            memcpy(aktstundenmesswerte + sekunden, modbuslesewert, LEISTUNGSREGISTER * sizeof(uint16_t));
-                            ErzeugeJSON(aktstundenmesswerte + sekunden);
-                        }
-                        else /* Fehlerfall modbus_read_registers */
-                        {
-                            fehler++;
-                            if (fehler > LESEFEHLER_AKZEPT)
-                            {
-                                modbus_close(modbus);
-                                modbus_free(modbus);
-
-                                int_fast16_t neuverbindzahl = 0; /* # Neuverbindungsversuche (1 pro Sekunde) */
-                                do
-                                {
-                                    if (0 == nanosleep(&grobSchlafen, NULL)) sekunden++;
-                                    modbus = modbus_new_tcp(S10_ADRESSE, S10_PORT);
-                                    neuverbindzahl++;
-                                    if (neuverbindzahl > NEUVERBIND_AKZEPT) goto verbindungverloren;
-                                } while (NULL == modbus);
-
-                                neuverbindzahl = 0;
-                                do
-                                {
-                                    if (0 == nanosleep(&grobSchlafen, NULL)) sekunden++;
-                                    neuverbindzahl++;
-                                    if (neuverbindzahl > NEUVERBIND_AKZEPT) goto verbindungverloren;
-                                } while (0 != modbus_connect(modbus));
-
-                                fehler = 0; /* nach erfolgreichem Neuverbinden wird der Fehlerzähler zurückgesetzt */
-                            }
-                        }
-                        sekunden++;
-                    }
-                    else
-                        nanosleep(&feinSchlafen, NULL);
+                    /* nach erfolgreichem Neuverbinden werden die Zähler zurückgesetzt, das S10 könnte zwischenzeitlich aktualisiert worden sein */
+                    fehler = 0;
+                    getrenntSeit = 0;
+                    wartezeit = NEUVERBIND_MIN;
+                    memset(&takt, 0, sizeof(takt));
+                    IdentifikationsblockAuslesenModbus(*modbus, konstanten);
                 }
-                result = EXIT_SUCCESS;
+                else if (erfassung.tv_sec - getrenntSeit >= NEUVERBIND_AKZEPT)
+                {
+                    /* der Rest der Stunde bleibt ohne Verbindung */
+                    if (LUECKEN) memset(stunde->grund + sekunden + 1, LUECKE_GETRENNT, NO_DATEN - sekunden - 1);
+                    goto verbindungverloren;
+                }
+                else
+                    naechsterVersuch = NeuverbindenPlanen(erfassung.tv_sec, &wartezeit, &zufall);
             }
         }
+        sekunden++;
+        atomic_store_explicit(&stunde->erfasst, sekunden, memory_order_release);
+    }
+    result = EXIT_SUCCESS;
+
 verbindungverloren:
-        free(modbuslesewert);
+    if (ZEITSTATISTIK) ZeitstatistikAusgeben(stunde, statistik);
+    free(zusatzwerte);
+    free(modbuslesewert);
+    return result;
+}
+
+/**
+ * schickt einen mehrzeiligen INSERT-Block an die Datenbank. Scheitert der Block als Ganzes (z.B. wegen eines doppelten Zeitwerts),
+ * wird er auf den Savepoint zurückgerollt und Zeile für Zeile wiederholt, sodass nur die fehlerhaften Zeilen verworfen und gemeldet werden.
+ * @param sqlconnection offene SQL-Verbindung mit laufender Transaktion.
+ * @param block kompletter SQL-String "INSERT INTO tabelle VALUES(...),(...)", wird bei der Einzelwiederholung verändert.
+ * @param laengeKopf Länge des Kopfs "INSERT INTO tabelle VALUES" innerhalb von block.
+ * @param zeilen Startposition jeder Wertezeile innerhalb von block, zeilen[anzahl] zeigt auf das Stringende.
+ * @param anzahl Anzahl der Wertezeilen im Block.
+ * @return Anzahl der Zeilen, die nicht eingetragen werden konnten.
+ */
+static size_t BlockEintragenSQL(MYSQL *const sqlconnection, char *const block, size_t const laengeKopf, size_t const *const zeilen, size_t const anzahl)
+{
+    if (0 == anzahl) return 0;
+
+    mysql_query(sqlconnection, "SAVEPOINT block");
+    if (0 == mysql_real_query(sqlconnection, block, zeilen[anzahl])) return 0;
+
+    /* Block gescheitert --> Einzelwiederholung, dafür wird die jeweilige Wertezeile direkt hinter den Kopf geschoben */
+    mysql_query(sqlconnection, "ROLLBACK TO SAVEPOINT block");
+    size_t fehler = 0;
+    for (size_t i = 0; i < anzahl; i++)
+    {
+        size_t const laenge = zeilen[i + 1] - zeilen[i] - (i + 1 < anzahl ? 1 : 0); /* ohne trennendes Komma */
+        memmove(block + laengeKopf, block + zeilen[i], laenge);
+        if (0 != mysql_real_query(sqlconnection, block, laengeKopf + laenge))
+        {
+            /* der erste Text der Wertezeile ist der Zeitpunkt: ('hh:mm:ss', bzw. mit SQL_ZEITREIHE (anlage,'YYYY-MM-DD hh:mm:ss', */
+            char const *const zeit = (char const*) memchr(block + laengeKopf, '\'', laenge);
+            char const *const zeitende = NULL == zeit ? NULL : (char const*) memchr(zeit + 1, '\'', block + laengeKopf + laenge - zeit - 1);
+            fprintf(stderr, "S10auslesen: Messwert %.*s nicht eingetragen: %s\n", NULL == zeitende ? 0 : (int) (zeitende - zeit - 1),
+                    NULL == zeitende ? "" : zeit + 1, mysql_error(sqlconnection));
+            fehler++;
+        }
+    }
+    return fehler;
+}
+
+/**
+ * stellt eine Verbindung zur MySQL-Datenbank her.
+ * @return die offene SQL-Verbindung, welche mit mysql_close() geschlossen werden muss, oder NULL falls keine Verbindung aufgebaut werden konnte.
+ */
+static MYSQL *SQLVerbinden(void)
+{
+    MYSQL *const sqlconnection = mysql_init(NULL);
+    if (NULL == sqlconnection) return NULL;
+    if (NULL != mysql_real_connect(sqlconnection, SQL_ADRESSE, SQL_USER, SQL_PW, SQL_DB, SQL_PORT, SQL_SOCKET, 0)) return sqlconnection;
+    mysql_close(sqlconnection);
+    return NULL;
+}
+
+/**
+ * bildet den Namen der Tagestabelle einer Anlage.
+ * @param ziel Puffer mit mindestens LEN_TABELLENAME Zeichen.
+ * @param name Name der Anlage, "" = ohne Namen.
+ * @param datum (tagesgenaues) Datum der Tabelle.
+ */
+static void Tabellenname(char *const ziel, char const *const name, struct tm const datum)
+{
+    snprintf(ziel, LEN_TABELLENAME, "%s%s%04d_%02d_%02d", name, '\0' == *name ? "" : "_", datum.tm_year + 1900, datum.tm_mon + 1, datum.tm_mday);
+}
+
+/* mit DELTA_MODUS steht jede Zeile für so viele Sekunden, wie ihre Spalte dauer angibt */
+#if DELTA_MODUS
+#define DAUERSPALTE ",dauer SMALLINT UNSIGNED NOT NULL DEFAULT 1"
+#else
+#define DAUERSPALTE ""
+#endif
+
+/* Spalten der Messwerte, gleich für Tagestabellen und s10messwerte */
+static char const messwertspalten[] = ",Ppv SMALLINT SIGNED NOT NULL,Pbat SMALLINT SIGNED NOT NULL,Phaus SMALLINT SIGNED NOT NULL"
+                                      ",Pnetz SMALLINT SIGNED NOT NULL,Pext SMALLINT SIGNED NOT NULL,Pwall SMALLINT SIGNED NOT NULL"
+                                      ",Ppvwall SMALLINT SIGNED NOT NULL,eigen TINYINT UNSIGNED NOT NULL,autarkie TINYINT UNSIGNED NOT NULL"
+                                      ",soc TINYINT UNSIGNED NOT NULL,notstrom TINYINT UNSIGNED NOT NULL,status TINYINT UNSIGNED NOT NULL"
+                                      ",wall1 SMALLINT UNSIGNED NOT NULL,wall2 SMALLINT UNSIGNED NOT NULL,wall3 SMALLINT UNSIGNED NOT NULL"
+                                      ",wall4 SMALLINT UNSIGNED NOT NULL,wall5 SMALLINT UNSIGNED NOT NULL,wall6 SMALLINT UNSIGNED NOT NULL"
+                                      ",wall7 SMALLINT UNSIGNED NOT NULL,wall8 SMALLINT UNSIGNED NOT NULL,Vdc1 SMALLINT UNSIGNED NOT NULL"
+                                      ",Vdc2 SMALLINT UNSIGNED NOT NULL,Vdc3 SMALLINT UNSIGNED NOT NULL,Idc1 SMALLINT UNSIGNED NOT NULL"
+                                      ",Idc2 SMALLINT UNSIGNED NOT NULL,Idc3 SMALLINT UNSIGNED NOT NULL,Pdc1 SMALLINT UNSIGNED NOT NULL"
+                                      ",Pdc2 SMALLINT UNSIGNED NOT NULL,Pdc3 SMALLINT UNSIGNED NOT NULL" DAUERSPALTE;
+
+/* Spalten einer Lücke, die Namen der Gründe entsprechen s10luecke */
+#define LUECKENSPALTEN ",dauer SMALLINT UNSIGNED NOT NULL,grund ENUM('ausgelassen','lesefehler','getrennt') NOT NULL"
+static char const *const lueckengruende[] = { "", "ausgelassen", "lesefehler", "getrennt" };
+
+/**
+ * hängt die Spalten der Kennzahlen an einen CREATE TABLE an.
+ * @param ziel der bisherige SQL-String.
+ */
+static void KennzahlspaltenAnhaengen(char *const ziel)
+{
+    strcat(ziel, ",dauer SMALLINT UNSIGNED NOT NULL,anzahl SMALLINT UNSIGNED NOT NULL");
+    for (uint_fast8_t feld = 0; feld < AGGREGAT_FELDER; feld++)
+        sprintf(ziel + strlen(ziel), ",%smin INT NOT NULL,%smax INT NOT NULL,%smittel FLOAT NOT NULL,%sWh DOUBLE NOT NULL", aggregatnamen[feld],
+                aggregatnamen[feld], aggregatnamen[feld], aggregatnamen[feld]);
+}
+
+/**
+ * ermittelt die Nummer einer Anlage in s10anlagen und trägt sie dort ggfs. neu ein.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param name Name der Anlage, "" für das erste Hauskraftwerk ohne Namen.
+ * @param anlagenid wird auf die Nummer der Anlage gesetzt.
+ * @return EXIT_SUCCESS wenn die Nummer ermittelt werden konnte, sonst EXIT_FAILURE.
+ */
+static int_fast8_t AnlageEintragenSQL(MYSQL *const sqlconnection, char const *const name, uint16_t *const anlagenid)
+{
+    char sqlquery[LEN_TABELLENAME + 96];
+    /* LAST_INSERT_ID(id) liefert auch für eine bereits vorhandene Anlage deren Nummer über mysql_insert_id() */
+    snprintf(sqlquery, sizeof(sqlquery), "INSERT INTO s10anlagen (name) VALUES('%s') ON DUPLICATE KEY UPDATE id=LAST_INSERT_ID(id)", name);
+    if (0 != mysql_query(sqlconnection, sqlquery)) return EXIT_FAILURE;
+    *anlagenid = mysql_insert_id(sqlconnection);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * legt die Partition von s10messwerte für einen Monat an. Die Monatspartitionen pYYYY_MM sind lückenlos, vor dem ersten Monat wird
+ * die erste Partition aufgeteilt, nach dem letzten die Partition pmax. Es werden daher ggfs. auch die Partitionen dazwischen angelegt.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param monat Monat als Jahr * 12 + Monat (0 bis 11).
+ * @return EXIT_SUCCESS wenn die Partition vorhanden ist, sonst EXIT_FAILURE.
+ */
+static int_fast8_t PartitionAnlegenSQL(MYSQL *const sqlconnection, int const monat)
+{
+    if (0 != mysql_query(sqlconnection, "SELECT MIN(PARTITION_NAME),MAX(PARTITION_NAME) FROM information_schema.PARTITIONS"
+                         " WHERE TABLE_SCHEMA=DATABASE() AND TABLE_NAME='s10messwerte' AND PARTITION_NAME<>'pmax'"))
+        return EXIT_FAILURE;
+    MYSQL_RES *const ergebnis = mysql_store_result(sqlconnection);
+    if (NULL == ergebnis) return EXIT_FAILURE;
+    MYSQL_ROW const zeile = mysql_fetch_row(ergebnis);
+    int jahr, mon, erster = monat, letzter = monat - 1; /* ohne Monatspartitionen wird pmax aufgeteilt */
+    if (NULL != zeile && NULL != zeile[0] && 2 == sscanf(zeile[0], "p%4d_%2d", &jahr, &mon)) erster = jahr * 12 + mon - 1;
+    if (NULL != zeile && NULL != zeile[1] && 2 == sscanf(zeile[1], "p%4d_%2d", &jahr, &mon)) letzter = jahr * 12 + mon - 1;
+    mysql_free_result(ergebnis);
+    if (monat >= erster && monat <= letzter) return EXIT_SUCCESS;
+
+    /* vor dem ersten Monat: die erste Partition in die Monate bis einschließlich ihrem eigenen aufteilen, sonst pmax bis zum Monat */
+    bool const davor = monat < erster;
+    int const von = davor ? monat : letzter + 1;
+    int const bis = davor ? erster : monat;
+    int_fast8_t result = EXIT_FAILURE;
+    char *const sqlquery = (char*) malloc((96 + (bis - von + 2) * 64) * sizeof(char));
+    if (NULL != sqlquery)
+    {
+        char *ende = sqlquery;
+        if (davor)
+            ende += sprintf(ende, "ALTER TABLE s10messwerte REORGANIZE PARTITION p%04d_%02d INTO (", erster / 12, erster % 12 + 1);
+        else
+            ende += sprintf(ende, "ALTER TABLE s10messwerte REORGANIZE PARTITION pmax INTO (");
+        for (int m = von; m <= bis; m++)
+            ende += sprintf(ende, "%sPARTITION p%04d_%02d VALUES LESS THAN ('%04d-%02d-01')", m == von ? "" : ",", m / 12, m % 12 + 1, (m + 1) / 12,
+                            (m + 1) % 12 + 1);
+        sprintf(ende, "%s)", davor ? "" : ",PARTITION pmax VALUES LESS THAN (MAXVALUE)");
+        if (0 == mysql_query(sqlconnection, sqlquery))
+            result = EXIT_SUCCESS;
+        else
+            fprintf(stderr, "S10auslesen: Partition p%04d_%02d nicht angelegt: %s\n", monat / 12, monat % 12 + 1, mysql_error(sqlconnection));
+        free(sqlquery);
     }
-    modbus_close(modbus);
-    modbus_free(modbus);
     return result;
 }
 
 /**
- * schreibt die  Leistungsdaten des S10 in die Datums-abhängige SQL Datenbank
- * 1) stellt eine Verbindung zur MySQL-Datenbank her.
- * 2) schreibt alle Werte der mit dem Array s10daten_t bereitgestellten Leistungsdaten in die Datenbank.
- * 3) überprüft die Datenbank auf Nulleinträge (welche bei Verbindungsabbrüchen entstehen) und löscht diese aus der Datenbank.
- * @param daten Array, umfasst für die aktuelle Stunde für jede Sekunde die ausgelesenen Leistungsdaten sekundengenau
- *        und zeitlich ansteigend geordnet in s10daten_t.
- * @param zeit (stundengenaues) Datum, für welche Stunde innerhalb der entspr. Einzeltages-Tabelle die ausgelesenen Leistungsdaten
- *        in die Datenbank eingetragen werden.
- * @return EXIT_SUCCESS wenn die Daten erfolgreich eingetragen werden konnten, sonst EXIT_FAILURE.
+ * 1) legt die Tabellen s10anlagen, s10geraete, s10messwerte, mit AGGREGATE s10kennzahlen und mit LUECKEN s10luecken an, falls sie noch
+ *    nicht existieren.
+ * 2) legt die Partitionen für den Monat des Datums und den folgenden Monat an, damit der Monatswechsel nicht in pmax landet.
+ * 3) ermittelt die Nummer der Anlage und trägt ihre Identifikationsdaten ein, je Gerät und Firmware mit dem ersten Tag.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param name Name der Anlage, "" für das erste Hauskraftwerk ohne Namen.
+ * @param konstanten s10konstanten_t mit den Identifikationsdaten.
+ * @param datum (tagesgenaues) Datum, ab dem die Identifikationsdaten gelten.
+ * @param anlagenid wird auf die Nummer der Anlage gesetzt, darf NULL sein.
+ * @return EXIT_SUCCESS wenn alles angelegt und eingetragen werden konnte, sonst EXIT_FAILURE.
  */
-int_fast8_t LeistungsdatenEintragenSQL(s10daten *const daten, struct tm const zeit)
+static int_fast8_t ZeitreiheAnlegenSQL(MYSQL *const sqlconnection, char const *const name, s10konstanten const *const konstanten,
+                                       struct tm const datum, uint16_t *const anlagenid)
 {
     int_fast8_t result = EXIT_FAILURE;
-    MYSQL *const sqlconnection = mysql_init(NULL);
-    if (NULL != sqlconnection)
+    char *const sqlquery = (char*) malloc(LEN_TABELLE * sizeof(char));
+    if (NULL != sqlquery)
+    {
+        /* 1) */
+        bool ok = 0 == mysql_query(sqlconnection, "CREATE TABLE IF NOT EXISTS s10anlagen (id SMALLINT UNSIGNED AUTO_INCREMENT PRIMARY KEY"
+                                   ",name VARCHAR(32) NOT NULL UNIQUE)");
+        ok = ok && 0 == mysql_query(sqlconnection, "CREATE TABLE IF NOT EXISTS s10geraete (anlage SMALLINT UNSIGNED NOT NULL,seit DATE NOT NULL"
+                                    ",magic SMALLINT UNSIGNED NOT NULL,modbus VARCHAR(8) NOT NULL,registeranzahl SMALLINT UNSIGNED NOT NULL"
+                                    ",hersteller VARCHAR(32) NOT NULL,modell VARCHAR(32) NOT NULL,seriennr VARCHAR(32) NOT NULL"
+                                    ",firmware VARCHAR(32) NOT NULL,PRIMARY KEY(anlage,seriennr,firmware))");
+        sprintf(sqlquery, "CREATE TABLE IF NOT EXISTS s10messwerte (anlage SMALLINT UNSIGNED NOT NULL,zeit DATETIME NOT NULL%s"
+                ",PRIMARY KEY(anlage,zeit)) PARTITION BY RANGE COLUMNS(zeit) (PARTITION pmax VALUES LESS THAN (MAXVALUE))", messwertspalten);
+        ok = ok && 0 == mysql_query(sqlconnection, sqlquery);
+        if (ok && AGGREGATE)
+        {
+            strcpy(sqlquery, "CREATE TABLE IF NOT EXISTS s10kennzahlen (anlage SMALLINT UNSIGNED NOT NULL,beginn DATETIME NOT NULL");
+            KennzahlspaltenAnhaengen(sqlquery);
+            strcat(sqlquery, ",PRIMARY KEY(anlage,beginn,dauer))");
+            ok = 0 == mysql_query(sqlconnection, sqlquery);
+        }
+        if (ok && LUECKEN)
+            ok = 0 == mysql_query(sqlconnection, "CREATE TABLE IF NOT EXISTS s10luecken (anlage SMALLINT UNSIGNED NOT NULL,beginn DATETIME NOT NULL"
+                                  LUECKENSPALTEN ",PRIMARY KEY(anlage,beginn))");
+
+        /* 2) */
+        int const monat = (datum.tm_year + 1900) * 12 + datum.tm_mon;
+        ok = ok && EXIT_SUCCESS == PartitionAnlegenSQL(sqlconnection, monat) && EXIT_SUCCESS == PartitionAnlegenSQL(sqlconnection, monat + 1);
+
+        /* 3) die Zeichenketten stammen vom S10 und werden daher maskiert */
+        uint16_t id;
+        if (ok && EXIT_SUCCESS == AnlageEintragenSQL(sqlconnection, name, &id))
+        {
+            char texte[4][2 * sizeof(konstanten->hersteller) + 1];
+            char const *const quellen[4] = { konstanten->hersteller, konstanten->modell, konstanten->seriennr, konstanten->firmware };
+            for (uint_fast8_t i = 0; i < 4; i++)
+                mysql_real_escape_string(sqlconnection, texte[i], quellen[i], strnlen(quellen[i], sizeof(konstanten->hersteller)));
+            snprintf(sqlquery, LEN_TABELLE, "INSERT INTO s10geraete VALUES(%u,'%04d-%02d-%02d',%u,'%u.%u',%u,'%s','%s','%s','%s')"
+                     " ON DUPLICATE KEY UPDATE seit=LEAST(seit,VALUES(seit))", id, datum.tm_year + 1900, datum.tm_mon + 1, datum.tm_mday,
+                     konstanten->magic, konstanten->mb_major, konstanten->mb_minor, konstanten->reg, texte[0], texte[1], texte[2], texte[3]);
+            if (0 == mysql_query(sqlconnection, sqlquery))
+            {
+                if (NULL != anlagenid) *anlagenid = id;
+                result = EXIT_SUCCESS;
+            }
+        }
+        if (EXIT_SUCCESS != result) fprintf(stderr, "S10auslesen: Tabellen der Zeitreihe nicht angelegt: %s\n", mysql_error(sqlconnection));
+        free(sqlquery);
+    }
+    return result;
+}
+
+/**
+ * schreibt einen Ausschnitt der Leistungsdaten einer Stunde in einer einzigen Transaktion in die Datums-abhängige SQL Datenbank
+ * bzw. mit SQL_ZEITREIHE in s10messwerte, jeweils SQL_BLOCKZEILEN Messwerte werden dabei als ein mehrzeiliger INSERT übertragen.
+ * Zeilen, die nicht eingetragen werden können, werden einzeln auf stderr gemeldet. Mit DELTA_MODUS wird nur für jede Änderung eine Zeile
+ * samt ihrer Dauer geschrieben, siehe DeltaDauer().
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param name Name der Anlage, der dem Tabellennamen vorangestellt wird, "" = ohne Namen.
+ * @param anlagenid Nummer der Anlage in s10anlagen, wird nur mit SQL_ZEITREIHE verwendet.
+ * @param daten Array, umfasst für die Stunde für jede Sekunde die ausgelesenen Leistungsdaten sekundengenau und zeitlich ansteigend geordnet.
+ * @param gueltig Gültigkeit der Messwerte, fehlende Messwerte werden übersprungen.
+ * @param zeit (stundengenaues) Datum, für welche Stunde innerhalb der entspr. Einzeltages-Tabelle die Leistungsdaten eingetragen werden.
+ * @param von erste Sekunde der Stunde, die eingetragen wird.
+ * @param bis erste Sekunde der Stunde, die nicht mehr eingetragen wird.
+ * @return EXIT_SUCCESS wenn die Transaktion erfolgreich abgeschlossen werden konnte, sonst EXIT_FAILURE.
+ */
+static int_fast8_t MesswerteUebertragenSQL(MYSQL *const sqlconnection, char const *const name, uint16_t const anlagenid,
+                                           s10daten const *const daten, s10gueltig const *const gueltig, struct tm const zeit, size_t const von,
+                                           size_t const bis)
+{
+    int_fast8_t result = EXIT_FAILURE;
+    char *const tabellenname = (char*) malloc(LEN_TABELLENAME * sizeof(char));
+    if (NULL != tabellenname)
     {
-        if (NULL != mysql_real_connect(sqlconnection, SQL_ADRESSE, SQL_USER, SQL_PW, SQL_DB, SQL_PORT, SQL_SOCKET, 0))
+        if (SQL_ZEITREIHE)
+            strcpy(tabellenname, "s10messwerte");
+        else
+            Tabellenname(tabellenname, name, zeit);
+        char *const sqlstring = (char*) malloc((LEN_TABELLENAME + SQL_BLOCKZEILEN * LEN_WERTE) * sizeof(char));
+        if (NULL != sqlstring)
         {
-            char *const tabellenname = (char*) malloc(LEN_TABELLENAME * sizeof(char));
-            if (NULL != tabellenname)
+            size_t *const zeilen = (size_t*) malloc((SQL_BLOCKZEILEN + 1) * sizeof(size_t));
+            if (NULL != zeilen)
             {
-                sprintf(tabellenname, "%04d_%02d_%02d", zeit.tm_year + 1900, zeit.tm_mon + 1, zeit.tm_mday);
-                char *const zeitpunkt = (char*) malloc(LEN_TABELLENAME * sizeof(char));
-                if (NULL != zeitpunkt)
+                if (0 == mysql_autocommit(sqlconnection, 0))
                 {
-                    char *const valstring = (char*) malloc(LEN_WERTE * sizeof(char));
-                    if (NULL != valstring)
+                    struct timespec beginn, dauer;
+                    clock_gettime(CLOCK_MONOTONIC, &beginn);
+                    size_t const laengeKopf = sprintf(sqlstring, "INSERT INTO %s VALUES", tabellenname);
+                    size_t anzahl = 0;
+                    size_t gesamt = 0;
+                    size_t fehler = 0;
+                    char *ende = sqlstring + laengeKopf;
+                    /* fehlende Messwerte werden anhand der Gültigkeit wortweise übersprungen, mit DELTA_MODUS auch die unveränderten */
+                    size_t sekunden = 1; /* so viele Sekunden steht die Zeile */
+                    for (size_t cnt = GueltigSuchen(gueltig, von, bis); cnt < bis; cnt = GueltigSuchen(gueltig, cnt + sekunden, bis))
                     {
-                        char *const sqlstring = (char*) malloc(LEN_WERTE * sizeof(char));
-                        if (NULL != sqlstring)
+                        if (DELTA_MODUS) sekunden = DeltaDauer(daten, gueltig, cnt, bis);
+                        zeilen[anzahl] = ende - sqlstring;
+                        if (0 != anzahl) *ende++ = ',';
+                        if (SQL_ZEITREIHE)
+                            ende += sprintf(ende, "(%u,'%04d-%02d-%02d %02d:%02zu:%02zu',", anlagenid, zeit.tm_year + 1900, zeit.tm_mon + 1,
+                                            zeit.tm_mday, zeit.tm_hour, cnt / 60, cnt % 60);
+                        else
+                            ende += sprintf(ende, "('%02d:%02zu:%02zu',", zeit.tm_hour, cnt / 60, cnt % 60);
+                        ende += sprintf(ende, "%d,%d,%d,%d,%d,%d,%d,%hhu,%hhu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu",
+                                        daten[cnt].P_pv, daten[cnt].P_bat,
+                                        daten[cnt].P_haus, daten[cnt].P_netz, daten[cnt].P_ext, daten[cnt].P_wall, daten[cnt].P_pvwall,
+                                        daten[cnt].eigen, daten[cnt].autarkie, daten[cnt].soc, daten[cnt].notstr, daten[cnt].ems,
+                                        daten[cnt].wall1, daten[cnt].wall2, daten[cnt].wall3, daten[cnt].wall4, daten[cnt].wall5,
+                                        daten[cnt].wall6, daten[cnt].wall7, daten[cnt].wall8, daten[cnt].Vdc1, daten[cnt].Vdc2,
+                                        daten[cnt].Vdc3, daten[cnt].Idc1, daten[cnt].Idc2, daten[cnt].Idc3, daten[cnt].Pdc1,
+                                        daten[cnt].Pdc2, daten[cnt].Pdc3);
+                        if (DELTA_MODUS) ende += sprintf(ende, ",%zu", sekunden);
+                        *ende++ = ')';
+                        /* das trennende Komma gehört zur Vorgängerzeile, damit zeilen[] auf die öffnende Klammer zeigt */
+                        if (0 != anzahl) zeilen[anzahl]++;
+                        anzahl++;
+                        gesamt++;
+
+                        if (SQL_BLOCKZEILEN == anzahl)
                         {
-                            for (size_t cnt = 0; cnt < NO_DATEN; cnt++)
-                            {
-                                /* wenn alle Werte gleich 0 sind, sind das noch die calloc-Init-Werte --> überspringe diesen Datenpunkt */
-                                if (0 == daten[cnt].P_pv && 0 == daten[cnt].P_bat && 0 == daten[cnt].P_haus && 0 == daten[cnt].P_netz
-                                    && 0 == daten[cnt].P_ext && 0 == daten[cnt].P_wall && 0 == daten[cnt].P_pvwall && 0 == daten[cnt].eigen
-                                    && 0 == daten[cnt].autarkie && 0 == daten[cnt].soc && 0 == daten[cnt].notstr && 0 == daten[cnt].ems
-                                    && 0 == daten[cnt].wall1 && 0 == daten[cnt].wall2 && 0 == daten[cnt].wall3 && 0 == daten[cnt].wall4
-                                    && 0 == daten[cnt].wall5 && 0 == daten[cnt].wall6 && 0 == daten[cnt].wall7 && 0 == daten[cnt].wall8
-                                    && 0 == daten[cnt].Vdc1 && 0 == daten[cnt].Vdc2 && 0 == daten[cnt].Vdc3 && 0 == daten[cnt].Idc1
-                                    && 0 == daten[cnt].Idc2 && 0 == daten[cnt].Idc3 && 0 == daten[cnt].Pdc1 && 0 == daten[cnt].Pdc2
-                                    && 0 == daten[cnt].Pdc3) continue;
-
-                                sqlstring[0] = '\0'; /* neuen Stringinhalt anlegen */
-                                strcat(sqlstring, "INSERT ");
-                                strcat(sqlstring, tabellenname);
-                                sprintf(zeitpunkt, "%02d:%02zu:%02zu", zeit.tm_hour, (cnt - (cnt % 60)) / 60, cnt % 60);
-                                sprintf(valstring, " VALUES('%s',"
-                                        "%d,%d,%d,%d,%d,%d,%d,%hhu,%hhu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu);",
-                                        zeitpunkt, daten[cnt].P_pv, daten[cnt].P_bat, daten[cnt].P_haus, daten[cnt].P_netz, daten[cnt].P_ext,
-                                        daten[cnt].P_wall, daten[cnt].P_pvwall, daten[cnt].eigen, daten[cnt].autarkie, daten[cnt].soc,
-                                        daten[cnt].notstr, daten[cnt].ems, daten[cnt].wall1, daten[cnt].wall2, daten[cnt].wall3, daten[cnt].wall4,
-                                        daten[cnt].wall5, daten[cnt].wall6, daten[cnt].wall7, daten[cnt].wall8, daten[cnt].Vdc1, daten[cnt].Vdc2,
-                                        daten[cnt].Vdc3, daten[cnt].Idc1, daten[cnt].Idc2, daten[cnt].Idc3, daten[cnt].Pdc1, daten[cnt].Pdc2,
-                                        daten[cnt].Pdc3);
-                                strcat(sqlstring, valstring);
-                                mysql_query(sqlconnection, sqlstring);
-								/* bei Fehler (z.B. doppelter Zeitwert kann nicht eingefügt werden), gehe einfach zum nächsten Wert über */
-                            }
-
-                            result = EXIT_SUCCESS;
-
-                            sqlstring[0] = '\0'; /* neuen Stringinhalt anlegen */
-                            /* Datenbankpflege -> lösche die Nulleinträge die sich trotzdem eingeschlichen haben */
-                            strcat(sqlstring, "DELETE FROM ");
-                            strcat(sqlstring, tabellenname);
-                            strcat(sqlstring,
-                                   " WHERE Ppv=0 AND Pbat=0 AND Phaus=0 AND Pnetz=0 AND Pext=0 AND Pwall=0 AND Ppvwall=0 AND eigen=0 AND autarkie=0 AND soc=0"
-								   " AND notstrom=0 AND status=0 AND wall1=0 AND wall2=0 AND wall3=0 AND wall4=0 AND wall5=0 AND wall6=0 AND wall7=0"
-								   " AND wall8=0 AND Vdc1=0 AND Vdc2=0 AND Vdc3=0 AND Idc1=0 AND Idc2=0 AND Idc3=0 AND Pdc1=0 AND Pdc2=0 AND Pdc3=0;");
-                            mysql_query(sqlconnection, sqlstring);
-
-                            free(sqlstring);
+                            zeilen[anzahl] = ende - sqlstring;
+                            fehler += BlockEintragenSQL(sqlconnection, sqlstring, laengeKopf, zeilen, anzahl);
+                            anzahl = 0;
+                            ende = sqlstring + laengeKopf;
                         }
-                        free(valstring);
                     }
-                    free(zeitpunkt);
+                    zeilen[anzahl] = ende - sqlstring;
+                    fehler += BlockEintragenSQL(sqlconnection, sqlstring, laengeKopf, zeilen, anzahl);
+
+                    if (0 == mysql_commit(sqlconnection))
+                        result = EXIT_SUCCESS;
+                    else
+                    {
+                        fprintf(stderr, "S10auslesen: Transaktion für %s nicht abgeschlossen: %s\n", tabellenname, mysql_error(sqlconnection));
+                        mysql_rollback(sqlconnection);
+                    }
+                    clock_gettime(CLOCK_MONOTONIC, &dauer);
+                    MetrikSQL(EXIT_SUCCESS == result, EXIT_SUCCESS == result ? gesamt - fehler : 0,
+                              (dauer.tv_sec - beginn.tv_sec) * 1000000 + (dauer.tv_nsec - beginn.tv_nsec) / 1000);
+                    if (fehler > 0)
+                        fprintf(stderr, "S10auslesen: %zu Messwerte der Stunde %02d Uhr nicht in %s eingetragen\n", fehler, zeit.tm_hour, tabellenname);
                 }
-                free(tabellenname);
+                free(zeilen);
             }
+            free(sqlstring);
         }
-        mysql_close(sqlconnection);
+        free(tabellenname);
     }
     return result;
 }
 
 /**
- * 1) Stellt eine Modbus-Verbindung mit dem S10-Hauskraftwerk her
- * 2) liest die Identifikationsdaten (nicht-volatile Register) des S10 aus und bereitet sie maschinenlesbar auf.
- * @param konstanten s10konstanten_t, in welches die Identifikationsdaten eingetragen werden.
- * @return EXIT_SUCCESS wenn die Daten erfolgreich gelesen werden konnten, sonst EXIT_FAILURE.
+ * schreibt abgeschlossene Zeitfenster einer Stufe mit einem einzigen REPLACE in die Aggregattabelle des Tages bzw. mit SQL_ZEITREIHE
+ * in s10kennzahlen, ein wiederholtes Eintragen derselben Fenster ist daher unschädlich. Leere Fenster werden übersprungen.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param name Name der Anlage, der dem Tabellennamen vorangestellt wird, "" = ohne Namen.
+ * @param anlagenid Nummer der Anlage in s10anlagen, wird nur mit SQL_ZEITREIHE verwendet.
+ * @param zeit (stundengenaues) Datum der Fenster.
+ * @param fenster die Fenster.
+ * @param anzahl Anzahl der Fenster.
+ * @return EXIT_SUCCESS wenn die Fenster eingetragen wurden, sonst EXIT_FAILURE.
  */
-int_fast8_t IdentifikationsblockAuslesenModbus(s10konstanten *const konstanten)
+static int_fast8_t AggregateUebertragenSQL(MYSQL *const sqlconnection, char const *const name, uint16_t const anlagenid, struct tm const zeit,
+                                           s10aggregat const *const fenster, size_t const anzahl)
 {
     int_fast8_t result = EXIT_FAILURE;
-    modbus_t *const modbus = modbus_new_tcp(S10_ADRESSE, S10_PORT);
-    if (NULL != modbus)
+    char *const sqlstring = (char*) malloc((LEN_TABELLENAME + 32 + anzahl * LEN_AGGREGAT) * sizeof(char));
+    if (NULL != sqlstring)
+    {
+        char *ende = sqlstring;
+        strcpy(ende, "REPLACE INTO ");
+        ende += strlen(ende);
+        if (SQL_ZEITREIHE)
+            ende += sprintf(ende, "s10kennzahlen VALUES");
+        else
+        {
+            Tabellenname(ende, name, zeit);
+            ende += strlen(ende);
+            ende += sprintf(ende, "_agg VALUES");
+        }
+        char const *const kopfende = ende;
+        for (size_t i = 0; i < anzahl; i++)
+        {
+            if (0 == fenster[i].anzahl) continue;
+            if (kopfende != ende) *ende++ = ',';
+            time_t const sekunde = fenster[i].beginn % 86400;
+            if (SQL_ZEITREIHE)
+            {
+                time_t const tag = fenster[i].beginn;
+                struct tm beginn;
+                gmtime_r(&tag, &beginn);
+                ende += sprintf(ende, "(%u,'%04d-%02d-%02d ", anlagenid, beginn.tm_year + 1900, beginn.tm_mon + 1, beginn.tm_mday);
+            }
+            else
+                *ende++ = '(';
+            ende += sprintf(ende, "%s%02d:%02d:%02d',%u,%u", SQL_ZEITREIHE ? "" : "'", (int) (sekunde / 3600), (int) (sekunde / 60 % 60),
+                            (int) (sekunde % 60), fenster[i].dauer, fenster[i].anzahl);
+            for (uint_fast8_t feld = 0; feld < AGGREGAT_FELDER; feld++)
+                ende += sprintf(ende, ",%d,%d,%.1f,%.3f", fenster[i].min[feld], fenster[i].max[feld],
+                                (double) fenster[i].summe[feld] / fenster[i].anzahl, fenster[i].summe[feld] / 3600.0);
+            *ende++ = ')';
+        }
+        *ende = '\0';
+        if (kopfende == ende || 0 == mysql_real_query(sqlconnection, sqlstring, ende - sqlstring))
+            result = EXIT_SUCCESS;
+        else
+            fprintf(stderr, "S10auslesen: Kennzahlen der Stunde %02d Uhr nicht eingetragen: %s\n", zeit.tm_hour, mysql_error(sqlconnection));
+        free(sqlstring);
+    }
+    return result;
+}
+
+/**
+ * legt alle Zeitfenster einer Stunde ab, die seit dem letzten Aufruf abgeschlossen wurden.
+ * @param sqlconnection offene SQL-Verbindung, wird nur mit SQL_AKTIV verwendet.
+ * @param anlagenid Nummer der Anlage in s10anlagen, wird nur mit SQL_ZEITREIHE verwendet.
+ * @param stunde die Stunde, deren Fenster abgelegt werden.
+ * @param erfasst so viele Sekunden der Stunde sind abgeschlossen.
+ * @param erfassungsende true, wenn die Erfassung der Stunde beendet ist und damit auch alle Fenster abgeschlossen sind.
+ * @return EXIT_SUCCESS wenn alle abgeschlossenen Fenster abgelegt wurden, sonst EXIT_FAILURE.
+ */
+static int_fast8_t AggregateEintragen(MYSQL *const sqlconnection, uint16_t const anlagenid, s10stunde *const stunde, size_t const erfasst,
+                                      bool const erfassungsende)
+{
+    for (uint_fast8_t stufe = 0; stufe < AGGREGAT_STUFEN; stufe++)
+    {
+        s10aggregat const *const fenster = stunde->aggregate + AggregatErstes(stufe);
+        size_t const fertig = erfassungsende ? NO_DATEN / aggregatdauer[stufe] : erfasst / aggregatdauer[stufe];
+        if (fertig <= stunde->aggregiert[stufe]) continue;
+        char const *const name = anlagen[stunde->anlage].name;
+        if (SQL_AKTIV
+            && (NULL == sqlconnection
+                || EXIT_SUCCESS != AggregateUebertragenSQL(sqlconnection, name, anlagenid, stunde->zeit, fenster + stunde->aggregiert[stufe],
+                                                           fertig - stunde->aggregiert[stufe])))
+            return EXIT_FAILURE;
+        if (EXIT_SUCCESS != AggregateSchreiben(name, stunde->start, stufe, fenster, stunde->aggregiert[stufe], fertig)) return EXIT_FAILURE;
+        stunde->aggregiert[stufe] = fertig;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * schreibt die Lücken einer abgeschlossenen Stunde in die Tabelle [Name_]YYYY_MM_DD_luecken bzw. mit SQL_ZEITREIHE in s10luecken.
+ * Zusammenhängende Sekunden ohne Messwert mit demselben Grund bilden eine Zeile, REPLACE macht ein wiederholtes Eintragen unschädlich.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param anlagenid Nummer der Anlage in s10anlagen, wird nur mit SQL_ZEITREIHE verwendet.
+ * @param stunde die Stunde.
+ * @return EXIT_SUCCESS wenn alle Lücken eingetragen wurden, sonst EXIT_FAILURE.
+ */
+static int_fast8_t LueckenUebertragenSQL(MYSQL *const sqlconnection, uint16_t const anlagenid, s10stunde const *const stunde)
+{
+    int_fast8_t result = EXIT_FAILURE;
+    /* höchstens jede zweite Sekunde beginnt eine Lücke */
+    char *const sqlstring = (char*) malloc((LEN_TABELLENAME + 32 + (NO_DATEN / 2 + 1) * LEN_LUECKE) * sizeof(char));
+    if (NULL != sqlstring)
+    {
+        char *ende = sqlstring;
+        strcpy(ende, "REPLACE INTO ");
+        ende += strlen(ende);
+        if (SQL_ZEITREIHE)
+            ende += sprintf(ende, "s10luecken VALUES");
+        else
+        {
+            Tabellenname(ende, anlagen[stunde->anlage].name, stunde->zeit);
+            ende += strlen(ende);
+            ende += sprintf(ende, "_luecken VALUES");
+        }
+        char const *const kopfende = ende;
+        for (size_t sekunde = 0; sekunde < NO_DATEN;)
+        {
+            uint8_t const grund = stunde->grund[sekunde];
+            if (LUECKE_KEINE == grund || Gueltig(stunde->gueltig, sekunde))
+            {
+                sekunde++;
+                continue;
+            }
+            size_t dauer = 1;
+            while (sekunde + dauer < NO_DATEN && grund == stunde->grund[sekunde + dauer] && !Gueltig(stunde->gueltig, sekunde + dauer))
+                dauer++;
+
+            if (kopfende != ende) *ende++ = ',';
+            if (SQL_ZEITREIHE)
+                ende += sprintf(ende, "(%u,'%04d-%02d-%02d ", anlagenid, stunde->zeit.tm_year + 1900, stunde->zeit.tm_mon + 1, stunde->zeit.tm_mday);
+            else
+                ende += sprintf(ende, "('");
+            ende += sprintf(ende, "%02d:%02zu:%02zu',%zu,'%s')", stunde->zeit.tm_hour, sekunde / 60, sekunde % 60, dauer, lueckengruende[grund]);
+            sekunde += dauer;
+        }
+        *ende = '\0';
+        if (kopfende == ende || 0 == mysql_real_query(sqlconnection, sqlstring, ende - sqlstring))
+            result = EXIT_SUCCESS;
+        else
+            fprintf(stderr, "S10auslesen: Lücken der Stunde %02d Uhr nicht eingetragen: %s\n", stunde->zeit.tm_hour, mysql_error(sqlconnection));
+        free(sqlstring);
+    }
+    return result;
+}
+
+/**
+ * legt die Messwerte einer Stunde an.
+ * @param anlage Nummer des Hauskraftwerks in der Anlagenliste.
+ * @param start hh:00:00 Uhr der Stunde als Sekunden seit 1.1.1970 (UTC).
+ * @param konstanten Identifikationsdaten, mit denen ggfs. die Tabelle des Tages angelegt wird.
+ * @return die mit calloc angelegte Stunde oder NULL falls kein Speicher verfügbar ist.
+ */
+static s10stunde *StundeAnlegen(uint32_t const anlage, time_t const start, s10konstanten const *const konstanten)
+{
+    s10stunde *const stunde = (s10stunde*) calloc(1, sizeof(s10stunde));
+    if (NULL == stunde) return NULL;
+    stunde->daten = (s10daten*) calloc(NO_DATEN, sizeof(s10daten));
+    stunde->gueltig = (s10gueltig*) calloc(GUELTIG_WORTE(NO_DATEN), sizeof(s10gueltig));
+    if (AGGREGATE) stunde->aggregate = (s10aggregat*) calloc(AggregatErstes(AGGREGAT_STUFEN), sizeof(s10aggregat));
+    if (ROH_AKTIV) stunde->roh = (uint16_t*) calloc(NO_DATEN * RohRegister(), sizeof(uint16_t));
+    if (LUECKEN) stunde->grund = (uint8_t*) calloc(NO_DATEN, sizeof(uint8_t));
+    if (NULL == stunde->daten || NULL == stunde->gueltig || (AGGREGATE && NULL == stunde->aggregate) || (ROH_AKTIV && NULL == stunde->roh)
+        || (LUECKEN && NULL == stunde->grund))
     {
-        if (0 == modbus_connect(modbus))
+        free(stunde->grund);
+        free(stunde->roh);
+        free(stunde->aggregate);
+        free(stunde->gueltig);
+        free(stunde->daten);
+        free(stunde);
+        return NULL;
+    }
+    memcpy(&stunde->id, konstanten, sizeof(s10konstanten));
+    stunde->anlage = anlage;
+    gmtime_r(&start, &stunde->zeit); /* reentrant, Stunden werden in mehreren Threads gleichzeitig angelegt */
+    stunde->start = start;
+    atomic_init(&stunde->erfasst, 0);
+    return stunde;
+}
+
+/**
+ * gibt eine mit StundeAnlegen() angelegte Stunde frei.
+ * @param stunde die Stunde.
+ */
+static void StundeFreigeben(s10stunde *const stunde)
+{
+    free(stunde->grund);
+    free(stunde->roh);
+    free(stunde->aggregate);
+    free(stunde->gueltig);
+    free(stunde->daten);
+    free(stunde);
+}
+
+/**
+ * schreibt die Leistungsdaten aller Anlagen im Hintergrund in die Datums-abhängige SQL Datenbank und/oder das Archiv
+ * 1) wartet SQL_SCHREIBINTERVALL Sekunden oder bis die Erfassung eine Stunde der Warteschlange abschließt.
+ * 2) legt beim ersten Eintrag eines Tages die Tabelle der Anlage mit deren Identifikationsdaten an.
+ * 3) schreibt je Stunde alle seit dem letzten Durchlauf erfassten Messwerte in einer Transaktion in die Datenbank bzw. in Blöcken von
+ *    mindestens ARCHIV_BLOCK Sekunden in das Archiv und die Rohdatei und bestätigt sie im Journal, sobald Datenbank und Archiv sie enthalten.
+ *    Mit LUECKEN folgen zum Ende der Stunde die Sekunden ohne Messwert samt Grund.
+ *    Mit DELTA_MODUS wird die letzte Zeile erst eingetragen, wenn feststeht, für wie viele Sekunden sie steht.
+ * 4) entfernt eine Stunde aus der Warteschlange, sobald sie abgeschlossen und vollständig eingetragen ist.
+ * 5) baut die SQL-Verbindung bei einem Fehler frühestens nach SQL_WIEDERHOLEN Sekunden neu auf, die Messwerte werden dann mit übertragen.
+ *    Ist das Journal geöffnet, verbleibt eine abgeschlossene, aber nicht eingetragene Stunde darin und wird aus der Warteschlange entfernt.
+ *    Nach dem Beenden-Wunsch wird jede Stunde nur noch einmal versucht, nicht eingetragene Messwerte bleiben im Journal.
+ * 6) trägt im Journal verbliebene Messwerte, auch die früherer Läufe, mit JournalNachtragen() älteste zuerst nach, höchstens
+ *    NACHTRAG_ZEILEN je Durchlauf im Abstand von NACHTRAG_PAUSE Sekunden. Bis dahin werden spätere Stunden derselben Anlage nicht
+ *    sofort in die Datenbank eingetragen, sondern nach ihrem Abschluss ebenfalls nachgetragen, damit das Journal der Reihe nach bestätigt wird.
+ * @param arg s10schreiber_t mit der Warteschlange der einzutragenden Stunden.
+ * @return EXIT_SUCCESS (als Zeiger) wenn alle Stunden vollständig eingetragen werden konnten, sonst EXIT_FAILURE.
+ */
+void *LeistungsdatenSchreibThread(void *const arg)
+{
+    s10schreiber *const schreiber = (s10schreiber*) arg;
+    int_fast8_t result = EXIT_SUCCESS;
+    time_t tabellentag[ANLAGEN]; /* je Anlage der Tag, dessen Tabelle zuletzt angelegt wurde */
+    uint16_t anlagenid[ANLAGEN]; /* je Anlage die Nummer in s10anlagen, nur mit SQL_ZEITREIHE */
+    time_t nachtragen[ANLAGEN]; /* je Anlage die letzte Sekunde, die noch aus dem Journal nachzutragen ist, 0 = nichts nachzutragen */
+    bool fehlgeschlagen = false;
+    /* die Erfassung startet erst nach dem Schreib-Thread, ältere Messwerte im Journal stammen daher aus früheren Läufen */
+    time_t const vorherige = time(NULL) - 1;
+    for (size_t i = 0; i < ANLAGEN; i++)
+    {
+        tabellentag[i] = -1;
+        anlagenid[i] = 0;
+        nachtragen[i] = schreiber->journal ? vorherige : 0;
+    }
+
+    mysql_thread_init();
+    pthread_mutex_lock(&schreiber->sperre);
+    for (;;)
+    {
+        bool nachtrag = false;
+        for (size_t i = 0; i < ANLAGEN; i++)
+            nachtrag = nachtrag || 0 != nachtragen[i];
+        if (NULL == schreiber->erste && (schreiber->beenden || !nachtrag))
+        {
+            if (schreiber->beenden) break;
+            pthread_cond_wait(&schreiber->signal, &schreiber->sperre);
+            continue;
+        }
+
+        bool abgeschlossen = false;
+        for (s10stunde const *stunde = schreiber->erste; NULL != stunde && !abgeschlossen; stunde = stunde->naechste)
+            abgeschlossen = stunde->abgeschlossen;
+        if (fehlgeschlagen || (!abgeschlossen && !schreiber->beenden))
         {
-            uint16_t *const rohwerte = (uint16_t*) calloc(IDENTIFIKREGISTER, sizeof(uint16_t));
-            if (NULL != rohwerte)
+            if (!fehlgeschlagen && !nachtrag && 0 == SQL_SCHREIBINTERVALL)
+                pthread_cond_wait(&schreiber->signal, &schreiber->sperre);
+            else
             {
-                if (IDENTIFIKREGISTER == modbus_read_registers(modbus, 0, IDENTIFIKREGISTER, rohwerte))
+                struct timespec frist;
+                clock_gettime(CLOCK_REALTIME, &frist);
+                frist.tv_sec += fehlgeschlagen ? SQL_WIEDERHOLEN : nachtrag ? NACHTRAG_PAUSE : SQL_SCHREIBINTERVALL;
+                pthread_cond_timedwait(&schreiber->signal, &schreiber->sperre, &frist);
+            }
+        }
+        bool const letzterVersuch = schreiber->beenden;
+        fehlgeschlagen = false;
+        MYSQL *sqlconnection = schreiber->sqlconnection;
+        /* nur der Schreib-Thread entfernt Stunden, die Warteschlange bis zur jetzt letzten Stunde kann daher ohne Sperre durchlaufen werden */
+        s10stunde *const letzte = schreiber->letzte;
+        s10stunde *stunde = schreiber->erste;
+        pthread_mutex_unlock(&schreiber->sperre);
+
+        bool verbinden = true; /* nach einem Fehler wird es erst im nächsten Durchlauf erneut versucht */
+        while (NULL != stunde)
+        {
+            pthread_mutex_lock(&schreiber->sperre);
+            bool const erfassungsende = stunde->abgeschlossen;
+            pthread_mutex_unlock(&schreiber->sperre);
+
+            size_t const erfasst = atomic_load_explicit(&stunde->erfasst, memory_order_acquire);
+            uint32_t const anlage = stunde->anlage;
+            /* ältere Messwerte der Anlage fehlen noch in der Datenbank, die Stunde wird nach ihrem Abschluss ebenfalls nachgetragen */
+            bool const rueckstand = SQL_AKTIV && 0 != nachtragen[anlage];
+            memcpy(schreiber->id + anlage, &stunde->id, sizeof(s10konstanten));
+            bool ok = true, eingetragen = false;
+            /* mit DELTA_MODUS wartet die letzte Zeile auf den nächsten Durchlauf, solange sie noch länger werden kann */
+            size_t const fertig = DELTA_MODUS && !erfassungsende ? DeltaOffen(stunde->daten, stunde->gueltig, stunde->geschrieben, erfasst) : erfasst;
+            if (SQL_AKTIV && !rueckstand && ((SQL_SCHREIBINTERVALL > 0 && fertig > stunde->geschrieben) || erfassungsende))
+            {
+                if (NULL == sqlconnection && verbinden) sqlconnection = SQLVerbinden();
+                if (NULL != sqlconnection && stunde->start / 86400 != tabellentag[anlage]
+                    && EXIT_SUCCESS == IdentifikationsblockEintragenSQL(sqlconnection, anlagen[anlage].name, &stunde->id, stunde->zeit,
+                                                                       anlagenid + anlage))
+                    tabellentag[anlage] = stunde->start / 86400;
+                ok = NULL != sqlconnection && stunde->start / 86400 == tabellentag[anlage]
+                     && EXIT_SUCCESS == MesswerteUebertragenSQL(sqlconnection, anlagen[anlage].name, anlagenid[anlage], stunde->daten,
+                                                                stunde->gueltig, stunde->zeit, stunde->geschrieben, fertig);
+                if (ok)
+                {
+                    stunde->geschrieben = fertig;
+                    eingetragen = true;
+                }
+            }
+            /* das Archiv sammelt mindestens ARCHIV_BLOCK Sekunden je Block, weil längere Blöcke besser komprimieren */
+            if (ok && ARCHIV_AKTIV && (erfasst >= stunde->archiviert + ARCHIV_BLOCK || (erfassungsende && erfasst > stunde->archiviert)))
+            {
+                ok = EXIT_SUCCESS == ArchivAnhaengen(anlagen[anlage].name, &stunde->id, stunde->start, stunde->daten, stunde->gueltig,
+                                                     stunde->archiviert, erfasst);
+                if (ok)
                 {
-                    /* Endianness für Strings korrigieren */
-                    for (int_fast8_t i = 3; i < IDENTIFIKREGISTER; i++)
-                        rohwerte[i] = be16toh(rohwerte[i]);
+                    stunde->archiviert = erfasst;
+                    eingetragen = true;
+                }
+            }
+
+            /* die Rohdaten hängen nicht am Journal, ein Fehler wird im nächsten Durchlauf wiederholt, ohne die übrigen Ziele aufzuhalten */
+            if (ROH_AKTIV && (erfasst >= stunde->rohabgelegt + ARCHIV_BLOCK || (erfassungsende && erfasst > stunde->rohabgelegt))
+                && EXIT_SUCCESS == RohAnhaengen(anlagen[anlage].name, &stunde->id, stunde->start, stunde->roh, stunde->gueltig, stunde->rohabgelegt,
+                                                erfasst))
+                stunde->rohabgelegt = erfasst;
+
+            if (ok && AGGREGATE && !rueckstand)
+                ok = EXIT_SUCCESS == AggregateEintragen(sqlconnection, anlagenid[anlage], stunde, erfasst, erfassungsende);
+
+            /* die Lücken erst mit dem Ende der Stunde, eine laufende Lücke könnte sonst noch wachsen */
+            if (ok && LUECKEN && SQL_AKTIV && !rueckstand && erfassungsende)
+                ok = NULL != sqlconnection && EXIT_SUCCESS == LueckenUebertragenSQL(sqlconnection, anlagenid[anlage], stunde);
 
-                    /* umständliches Casting kann vermieden werden weil die Bitreihenfolge in rohwerte korrekt ist und auf konstanten kopiert werden kann */
-                    memcpy(konstanten, rohwerte, IDENTIFIKREGISTER * sizeof(uint16_t));
-                    result = EXIT_SUCCESS;
+            if (ok)
+            {
+                /* im Journal nur bestätigen, was alle verwendeten Ziele bereits erreicht haben */
+                size_t bestaetigt = SQL_AKTIV ? stunde->geschrieben : erfasst;
+                if (ARCHIV_AKTIV && stunde->archiviert < bestaetigt) bestaetigt = stunde->archiviert;
+                if (eingetragen && bestaetigt > 0 && 0 == nachtragen[anlage]) JournalBestaetigen(anlage, stunde->start + bestaetigt - 1);
+                if (rueckstand && erfassungsende) nachtragen[anlage] = stunde->start + NO_DATEN - 1;
+                stunde->eingetragen = erfassungsende;
+            }
+            else
+            {
+                /* Verbindung verwerfen, beim nächsten Versuch wird neu verbunden und der Ausschnitt wiederholt */
+                if (NULL != sqlconnection) mysql_close(sqlconnection);
+                sqlconnection = NULL;
+                verbinden = false;
+                fehlgeschlagen = !letzterVersuch;
+                /* eine abgeschlossene Stunde steht vollständig im Journal und muss daher nicht im Speicher auf die Datenbank warten */
+                if (letzterVersuch || (schreiber->journal && erfassungsende))
+                {
+                    fprintf(stderr, "S10auslesen: Messwerte der Stunde %02d Uhr von %s verbleiben im Journal%s\n", stunde->zeit.tm_hour,
+                            anlagen[anlage].adresse, letzterVersuch ? "" : " und werden nachgetragen");
+                    if (letzterVersuch) result = EXIT_FAILURE;
+                    nachtragen[anlage] = stunde->start + NO_DATEN - 1;
+                    stunde->eingetragen = true;
                 }
-                free(rohwerte);
             }
+            if (letzte == stunde) break;
+            stunde = stunde->naechste;
+        }
 
-            modbus_close(modbus);
-            modbus_free(modbus);
+        /* 6) */
+        if (nachtrag && verbinden && !letzterVersuch)
+        {
+            if (SQL_AKTIV && NULL == sqlconnection) sqlconnection = SQLVerbinden();
+            if (EXIT_SUCCESS != JournalNachtragen(sqlconnection, schreiber->id, nachtragen))
+            {
+                if (NULL != sqlconnection) mysql_close(sqlconnection);
+                sqlconnection = NULL;
+                fehlgeschlagen = true;
+            }
+        }
+
+        MetrikenSchreiben();
+        pthread_mutex_lock(&schreiber->sperre);
+        schreiber->sqlconnection = sqlconnection;
+        s10stunde *vorige = NULL;
+        for (s10stunde **zeiger = &schreiber->erste; NULL != *zeiger;)
+        {
+            s10stunde *const eingetragen = *zeiger;
+            if (!eingetragen->eingetragen)
+            {
+                vorige = eingetragen;
+                zeiger = &eingetragen->naechste;
+                continue;
+            }
+            *zeiger = eingetragen->naechste;
+            if (schreiber->letzte == eingetragen) schreiber->letzte = vorige;
+            StundeFreigeben(eingetragen);
         }
     }
+    if (NULL != schreiber->sqlconnection) mysql_close(schreiber->sqlconnection);
+    schreiber->sqlconnection = NULL;
+    pthread_mutex_unlock(&schreiber->sperre);
+
+    mysql_thread_end();
+    return (void*) (intptr_t) result;
+}
+
+/**
+ * trägt im Journal verbliebene Messwerte im Hintergrund in die Datums-abhängige SQL Datenbank und/oder das Archiv nach
+ * 1) liest alle nicht bestätigten Messwerte aus dem Journal, je Anlage nur bis einschließlich nachtragen[anlage]. Spätere Messwerte
+ *    gehören zu Stunden, die noch in der Warteschlange des Schreib-Threads stehen.
+ * 2) sortiert sie je Anlage stundenweise, älteste zuerst, in eine eigene Stunde ein und schreibt diese wie der Schreib-Thread in einer
+ *    Transaktion in die Datenbank und in das Archiv (dort werden bereits archivierte Sekunden übersprungen), die Kennzahlen werden aus
+ *    den nachgetragenen Messwerten neu berechnet.
+ * 3) hört nach NACHTRAG_ZEILEN Messwerten auf und bestätigt die eingetragenen Stunden am Ende des Durchlaufs mit einer Marke je Anlage.
+ *    Geht der Lauf vorher verloren, werden sie erneut nachgetragen, doppelte Zeilen überspringen Datenbank und Archiv.
+ * 4) setzt nachtragen[anlage] auf 0, sobald für die Anlage nichts mehr nachzutragen ist.
+ * @param sqlconnection offene SQL-Verbindung, NULL wenn SQL_AKTIV 0 ist.
+ * @param id je Anlage die Identifikationsdaten für neu anzulegende Tabellen und Archivdateien.
+ * @param nachtragen je Anlage die letzte nachzutragende Sekunde, 0 = nichts nachzutragen.
+ * @return EXIT_SUCCESS wenn alle Messwerte dieses Durchlaufs eingetragen werden konnten, sonst EXIT_FAILURE.
+ */
+int_fast8_t JournalNachtragen(MYSQL *const sqlconnection, s10konstanten const *const id, time_t *const nachtragen)
+{
+    /* 1) */
+    journaleintrag *eintraege;
+    size_t const anzahl = JournalLesen(&eintraege);
+    int_fast8_t result = EXIT_SUCCESS;
+    size_t zeilen = 0;
+    bool offen[ANLAGEN] = { false }; /* je Anlage: es bleibt für den nächsten Durchlauf etwas nachzutragen */
+    time_t eingetragen[ANLAGEN] = { 0 }; /* je Anlage die letzte in diesem Durchlauf eingetragene Sekunde, 0 = keine */
+    for (size_t i = 0; i < anzahl && EXIT_SUCCESS == result;)
+    {
+        uint32_t const anlage = eintraege[i].anlage;
+        if (anlage >= ANLAGEN || eintraege[i].zeit > nachtragen[anlage] || zeilen >= NACHTRAG_ZEILEN)
+        {
+            size_t const erster = i;
+            while (i < anzahl && eintraege[i].anlage == anlage)
+                i++;
+            if (anlage >= ANLAGEN)
+            {
+                fprintf(stderr, "S10auslesen: Messwerte der nicht mehr eingestellten Anlage %u werden aus dem Journal verworfen\n", anlage);
+                JournalBestaetigen(anlage, eintraege[i - 1].zeit);
+            }
+            else if (eintraege[erster].zeit <= nachtragen[anlage])
+                offen[anlage] = true;
+            continue;
+        }
+
+        /* 2) */
+        time_t const start = eintraege[i].zeit - eintraege[i].zeit % NO_DATEN;
+        s10stunde *const stunde = StundeAnlegen(anlage, start, id + anlage);
+        if (NULL == stunde)
+        {
+            result = EXIT_FAILURE;
+            break;
+        }
+        size_t const von = eintraege[i].zeit - start;
+        size_t bis = von;
+        for (; i < anzahl && eintraege[i].anlage == anlage && eintraege[i].zeit < start + NO_DATEN && eintraege[i].zeit <= nachtragen[anlage]; i++)
+        {
+            bis = eintraege[i].zeit - start;
+            memcpy(stunde->daten + bis, &eintraege[i].daten, sizeof(s10daten));
+            GueltigSetzen(stunde->gueltig, bis);
+            if (AGGREGATE) AggregatHinzufuegen(stunde->aggregate, start, bis, stunde->daten + bis);
+            bis++;
+            zeilen++;
+        }
+
+        char const *const name = anlagen[anlage].name;
+        uint16_t anlagenid = 0;
+        if (SQL_AKTIV
+            && (NULL == sqlconnection || 0 != IdentifikationsblockEintragenSQL(sqlconnection, name, id + anlage, stunde->zeit, &anlagenid)
+                || EXIT_SUCCESS != MesswerteUebertragenSQL(sqlconnection, name, anlagenid, stunde->daten, stunde->gueltig, stunde->zeit, von, bis)))
+            result = EXIT_FAILURE;
+        if (EXIT_SUCCESS == result && ARCHIV_AKTIV)
+            result = ArchivAnhaengen(name, id + anlage, start, stunde->daten, stunde->gueltig, von, bis);
+        if (EXIT_SUCCESS == result && AGGREGATE)
+        {
+            /* nur die Fenster ab der ersten nachgetragenen Sekunde, die übrigen stammen ggfs. aus einer anderen Erfassung der Stunde */
+            for (uint_fast8_t stufe = 0; stufe < AGGREGAT_STUFEN; stufe++)
+                stunde->aggregiert[stufe] = von / aggregatdauer[stufe];
+            result = AggregateEintragen(sqlconnection, anlagenid, stunde, bis, start + NO_DATEN - 1 <= nachtragen[anlage]);
+        }
+        /* 3) */
+        if (EXIT_SUCCESS == result) eingetragen[anlage] = start + bis - 1;
+        StundeFreigeben(stunde);
+    }
+    free(eintraege);
+    /* einmal je Anlage und Durchlauf bestätigen, auch wenn eine spätere Stunde gescheitert ist */
+    for (size_t anlage = 0; anlage < ANLAGEN; anlage++)
+        if (eingetragen[anlage] > 0) JournalBestaetigen(anlage, eingetragen[anlage]);
+
+    /* 4) */
+    if (EXIT_SUCCESS == result)
+        for (size_t anlage = 0; anlage < ANLAGEN; anlage++)
+            if (!offen[anlage]) nachtragen[anlage] = 0;
     return result;
 }
 
 /**
- * 1) stellt eine Verbindung zur MySQL-Datenbank her.
- * 2) überprüft ob für das aktuelle Datum eine Tabelle existiert und legt diese ggfs. neu an
- * 3) schreibt die Identifikationsdaten aus s10konstanten_t in die Datenbank.
+ * liest die Identifikationsdaten (nicht-volatile Register) des S10 aus und bereitet sie maschinenlesbar auf.
+ * @param modbus offene Modbus-Verbindung zum S10.
+ * @param konstanten s10konstanten_t, in welches die Identifikationsdaten eingetragen werden.
+ * @return EXIT_SUCCESS wenn die Daten erfolgreich gelesen werden konnten, sonst EXIT_FAILURE.
+ */
+int_fast8_t IdentifikationsblockAuslesenModbus(modbus_t *const modbus, s10konstanten *const konstanten)
+{
+    int_fast8_t result = EXIT_FAILURE;
+    uint16_t *const rohwerte = (uint16_t*) calloc(IDENTIFIKREGISTER, sizeof(uint16_t));
+    if (NULL != rohwerte)
+    {
+        if (IDENTIFIKREGISTER == modbus_read_registers(modbus, 0, IDENTIFIKREGISTER, rohwerte))
+        {
+            RegisterIdentifikation(rohwerte, konstanten);
+            result = EXIT_SUCCESS;
+        }
+        free(rohwerte);
+    }
+    return result;
+}
+
+/**
+ * 1) überprüft ob für das aktuelle Datum eine Tabelle existiert und legt diese ggfs. neu an
+ * 2) schreibt die Identifikationsdaten aus s10konstanten_t in die Datenbank.
+ * 3) legt mit AGGREGATE zusätzlich die Tabelle Name_YYYY_MM_DD_agg für die Kennzahlen je Zeitfenster an.
+ * 4) legt mit LUECKEN zusätzlich die Tabelle Name_YYYY_MM_DD_luecken für die Sekunden ohne Messwert an.
+ * Mit SQL_ZEITREIHE werden stattdessen die gemeinsamen Tabellen und die Partitionen des Monats angelegt, siehe ZeitreiheAnlegenSQL().
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param name Name der Anlage, der dem Tabellennamen vorangestellt wird, "" = ohne Namen.
  * @param konstanten s10konstanten_t mit den Identifikationsdaten, welche in die SQL Datenbank geschrieben werden sollen.
  * @param startdatum (tagesgenaues) Datum, für welches in der SQL Datenbank ggfs. eine neue Tabelle erzeugt wird.
- * @return Rückgabewert von mysql_query() falls SQL-Verbindung aufgebaut werden konnte, sonst EXIT_FAILURE.
+ * @param anlagenid wird mit SQL_ZEITREIHE auf die Nummer der Anlage in s10anlagen gesetzt, darf NULL sein.
+ * @return Rückgabewert von mysql_query() falls die Anfrage erstellt werden konnte, sonst EXIT_FAILURE.
  */
-int_fast8_t IdentifikationsblockEintragenSQL(s10konstanten *const konstanten, struct tm const startdatum)
+int_fast8_t IdentifikationsblockEintragenSQL(MYSQL *const sqlconnection, char const *const name, s10konstanten const *const konstanten,
+                                             struct tm const startdatum, uint16_t *const anlagenid)
 {
+    if (SQL_ZEITREIHE) return ZeitreiheAnlegenSQL(sqlconnection, name, konstanten, startdatum, anlagenid);
     int_fast8_t result = EXIT_FAILURE;
 
-    MYSQL *const sqlconnection = mysql_init(NULL);
-    if (NULL == sqlconnection) return result;
-
-    if (NULL != mysql_real_connect(sqlconnection, SQL_ADRESSE, SQL_USER, SQL_PW, SQL_DB, SQL_PORT, SQL_SOCKET, 0))
+    char *const tabellenname = (char*) malloc(LEN_TABELLENAME * sizeof(char));
+    if (NULL != tabellenname)
     {
-        char *const tabellenname = (char*) malloc(LEN_TABELLENAME * sizeof(char));
-        if (NULL != tabellenname)
+        char *const tabellebkommentar = (char*) malloc(LEN_TABKOMMENTAR * sizeof(char));
+        if (NULL != tabellebkommentar)
         {
-            char *const tabellebkommentar = (char*) malloc(LEN_TABKOMMENTAR * sizeof(char));
-            if (NULL != tabellebkommentar)
+            char *const sqlquery = (char*) malloc(LEN_TABELLE * sizeof(char));
+            if (NULL != sqlquery)
             {
-                char *const sqlquery = (char*) malloc(LEN_TABELLE * sizeof(char));
-                if (NULL != sqlquery)
-                {
-                    /* wird nur einmal zu Beginn aufgerufen, hier ist Lesbarkeit und Wartbarkeit wichtiger als Effizienz -> separate strcat */
-                    strcpy(sqlquery, "CREATE TABLE IF NOT EXISTS ");
-                    sprintf(tabellenname, "%04d_%02d_%02d", startdatum.tm_year + 1900, startdatum.tm_mon + 1, startdatum.tm_mday);
-                    strcat(sqlquery, tabellenname);
-                    strcat(sqlquery, " (uhrzeit TIME PRIMARY KEY");
-                    strcat(sqlquery, ",Ppv SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",Pbat SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",Phaus SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",Pnetz SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",Pext SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",Pwall SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",Ppvwall SMALLINT SIGNED NOT NULL");
-                    strcat(sqlquery, ",eigen TINYINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",autarkie TINYINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",soc TINYINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",notstrom TINYINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",status TINYINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall1 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall2 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall3 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall4 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall5 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall6 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall7 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",wall8 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Vdc1 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Vdc2 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Vdc3 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Idc1 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Idc2 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Idc3 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Pdc1 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Pdc2 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ",Pdc3 SMALLINT UNSIGNED NOT NULL");
-                    strcat(sqlquery, ")MAX_ROWS=86400 COMMENT='");
-                    sprintf(tabellebkommentar, "%#X Modbus: %u.%u Register: %u Hersteller: %s Modell: %s No: %s Firmware: %s';", konstanten->magic,
-                            konstanten->mb_major, konstanten->mb_minor, konstanten->reg, konstanten->hersteller, konstanten->modell,
-                            konstanten->seriennr, konstanten->firmware);
-                    strcat(sqlquery, tabellebkommentar);
+                /* wird nur einmal pro Tag aufgerufen, hier ist Lesbarkeit und Wartbarkeit wichtiger als Effizienz -> separate strcat */
+                strcpy(sqlquery, "CREATE TABLE IF NOT EXISTS ");
+                Tabellenname(tabellenname, name, startdatum);
+                strcat(sqlquery, tabellenname);
+                strcat(sqlquery, " (uhrzeit TIME PRIMARY KEY");
+                strcat(sqlquery, messwertspalten);
+                strcat(sqlquery, ")MAX_ROWS=86400 COMMENT='");
+                sprintf(tabellebkommentar, "%#X Modbus: %u.%u Register: %u Hersteller: %s Modell: %s No: %s Firmware: %s';", konstanten->magic,
+                        konstanten->mb_major, konstanten->mb_minor, konstanten->reg, konstanten->hersteller, konstanten->modell,
+                        konstanten->seriennr, konstanten->firmware);
+                strcat(sqlquery, tabellebkommentar);
 
+                result = mysql_query(sqlconnection, sqlquery);
+
+                if (0 == result && AGGREGATE)
+                {
+                    /* Tabelle der Kennzahlen mit einer Zeile je Zeitfenster, worst case 1120 Zeichen */
+                    sprintf(sqlquery, "CREATE TABLE IF NOT EXISTS %s_agg (uhrzeit TIME NOT NULL", tabellenname);
+                    KennzahlspaltenAnhaengen(sqlquery);
+                    strcat(sqlquery, ",PRIMARY KEY(uhrzeit,dauer))");
+                    result = mysql_query(sqlconnection, sqlquery);
+                }
+                if (0 == result && LUECKEN)
+                {
+                    /* Tabelle der Lücken mit einer Zeile je zusammenhängender Folge von Sekunden ohne Messwert */
+                    sprintf(sqlquery, "CREATE TABLE IF NOT EXISTS %s_luecken (uhrzeit TIME PRIMARY KEY" LUECKENSPALTEN ")", tabellenname);
                     result = mysql_query(sqlconnection, sqlquery);
-                    free(sqlquery);
                 }
-                free(tabellebkommentar);
+                free(sqlquery);
             }
-            free(tabellenname);
-            mysql_close(sqlconnection);
+            free(tabellebkommentar);
         }
+        free(tabellenname);
     }
     return result;
 }
 
 /**
- * 1) stellt sofort bei Aufrug eine Verbindung zum S10 Hauskraftwerk her, liest die Identifikationsdaten aus und trägt sie in datumsabhängige SQL-Tabellen ein
- * 2) wartet bis die nächste Stunde anbricht, und liest während der kommenden Stunde die Leistungswerte aus dem S10 aus, stellt sie sekundengenau
- *    als Dateiausgabe bereit und trägt sie nach Vollendung der Stunde in die Datenbank ein.
+ * erfasst die Leistungsdaten einer Anlage Stunde für Stunde
+ * 1) baut außerhalb des DAEMON_MODUS die Modbus-Verbindung zur vollen Stunde neu auf.
+ * 2) reiht jede Stunde in die Warteschlange des Schreib-Threads ein, liest sie sekundengenau aus und meldet ihr Ende dem Schreib-Thread.
+ * 3) liest zum Tageswechsel die Identifikationsdaten für die Tabelle des neuen Tages neu aus.
+ * 4) im DAEMON_MODUS wird weitergemessen, bis das Beenden angefordert wird. Verliert die erste Anlage dauerhaft ihre Verbindung, wird das
+ *    ganze Programm beendet, weitere Anlagen versuchen es dagegen in der nächsten Stunde erneut.
+ * @param arg s10erfassung_t der Anlage.
+ * @return EXIT_SUCCESS (als Zeiger) wenn alle Stunden erfasst werden konnten, sonst EXIT_FAILURE.
+ */
+void *LeistungsdatenErfassungsThread(void *const arg)
+{
+    s10erfassung *const erfassung = (s10erfassung*) arg;
+    s10schreiber *const schreiber = erfassung->schreiber;
+    int_fast8_t result = EXIT_SUCCESS;
+    time_t start = erfassung->start;
+
+#if !DAEMON_MODUS
+    erfassung->modbus = ModbusVerbinden(anlagen + erfassung->anlage);
+#endif
+
+    do
+    {
+        s10stunde *const stunde = StundeAnlegen(erfassung->anlage, start, &erfassung->id);
+        if (NULL == stunde)
+        {
+            result = EXIT_FAILURE;
+            break;
+        }
+        pthread_mutex_lock(&schreiber->sperre);
+        if (NULL == schreiber->letzte)
+            schreiber->erste = stunde;
+        else
+            schreiber->letzte->naechste = stunde;
+        schreiber->letzte = stunde;
+        pthread_mutex_unlock(&schreiber->sperre);
+
+        /* auch nach einem Verbindungsabbruch werden die bis dahin erfassten Messwerte eingetragen */
+        if (LeistungsdatenAuslesenModbus(&erfassung->modbus, &erfassung->id, stunde)) result = EXIT_FAILURE;
+
+        pthread_mutex_lock(&schreiber->sperre);
+        stunde->abgeschlossen = true;
+        pthread_cond_signal(&schreiber->signal);
+        pthread_mutex_unlock(&schreiber->sperre);
+
+        start += NO_DATEN;
+        /* zum Tageswechsel die Identifikationsdaten für die Tabelle des neuen Tages auffrischen */
+        if (0 == start % 86400 && NULL != erfassung->modbus) IdentifikationsblockAuslesenModbus(erfassung->modbus, &erfassung->id);
+    } while (DAEMON_MODUS && (EXIT_SUCCESS == result || 0 != erfassung->anlage) && !beenden);
+
+    ModbusTrennen(&erfassung->modbus);
+    if (DAEMON_MODUS && 0 == erfassung->anlage) beenden = 1; /* ohne die erste Anlage enden auch die übrigen */
+    return (void*) (intptr_t) result;
+}
+
+/**
+ * 1) stellt sofort bei Aufruf eine Verbindung zu den S10 Hauskraftwerken her, liest deren Identifikationsdaten aus und trägt sie in datumsabhängige
+ *    SQL-Tabellen ein. Die erste Anlage muss dabei erreichbar sein, weitere Anlagen verbinden sich bei Bedarf selbst neu.
+ * 2) trägt Messwerte, die ein abgebrochener Lauf im Journal hinterlassen hat, in die Datenbank bzw. das Archiv nach und übergibt die SQL-Verbindung an den Schreib-Thread.
+ * 3) wartet bis die nächste Stunde anbricht, und liest während der kommenden Stunde die Leistungswerte aller Anlagen parallel in je einem eigenen
+ *    Thread aus, stellt die der ersten Anlage sekundengenau als Dateiausgabe bereit und lässt alle SQL_SCHREIBINTERVALL Sekunden bzw. nach
+ *    Vollendung der Stunde in die Datenbank eintragen.
+ * 4) im DAEMON_MODUS wird ohne Warten mit der laufenden Stunde begonnen und Stunde für Stunde mit denselben Verbindungen weitergemessen,
+ *    bei jedem Tageswechsel werden die Identifikationsdaten neu ausgelesen. SIGTERM beendet die Messung, die Messwerte werden noch eingetragen.
  * @return EXIT_SUCCESS wenn alle Programmschritt erfolgreich durchgeführt werden konnten, sonst EXIT_FAILURE.
  */
 int main(void)
 {
-    struct tm const startdatum = StartDatum();
+    int_fast8_t result = EXIT_FAILURE;
+    struct sigaction beendenSignal = { .sa_handler = BeendenAnfordern };
+    sigaction(SIGTERM, &beendenSignal, NULL);
+    sigaction(SIGINT, &beendenSignal, NULL);
+
+#if DAEMON_MODUS
+    time_t start = time(NULL) / NO_DATEN * NO_DATEN; /* die laufende Stunde */
+#else
+    time_t start = StartZeitpunkt(); /* die nächste volle Stunde */
+#endif
+    struct tm startdatum;
+    gmtime_r(&start, &startdatum);
+
+    s10erfassung *const erfassung = (s10erfassung*) calloc(ANLAGEN, sizeof(s10erfassung));
+    if (NULL == erfassung) return EXIT_FAILURE;
+    s10schreiber schreiber = { .sperre = PTHREAD_MUTEX_INITIALIZER, .signal = PTHREAD_COND_INITIALIZER };
+    for (size_t i = 0; i < ANLAGEN; i++)
+    {
+        erfassung[i].anlage = i;
+        erfassung[i].start = start;
+        erfassung[i].schreiber = &schreiber;
+    }
+    /* schon vor dem ersten Verbindungsaufbau, damit auch dieser gezählt wird; ohne Metriken wird ebenfalls gemessen */
+    MetrikenAnlegen(ANLAGEN);
+    if (EXIT_SUCCESS != RegisterPlanen() || (ROH_AKTIV && EXIT_SUCCESS != RohPlanen())) goto idfehler;
 
-    s10konstanten *const id = (s10konstanten*) calloc(1, sizeof(s10konstanten));
-    if (NULL == id) return EXIT_FAILURE;
     /* Das Auslesen und Eintragen des ID-Blocks dient gleichzeitig als Verbindungstest zum S10 und SQL-Server */
-    if (IdentifikationsblockAuslesenModbus(id)) goto idfehler;
-    if (IdentifikationsblockEintragenSQL(id, startdatum)) goto idfehler;
-    free(id);
+    erfassung[0].modbus = ModbusVerbinden(anlagen);
+    if (NULL == erfassung[0].modbus || IdentifikationsblockAuslesenModbus(erfassung[0].modbus, &erfassung[0].id)) goto idfehler;
+    if (SQL_AKTIV)
+    {
+        /* ohne Datenbank wird trotzdem gemessen, der Schreib-Thread verbindet sich später und trägt die Messwerte aus dem Journal nach */
+        schreiber.sqlconnection = SQLVerbinden();
+        if (NULL == schreiber.sqlconnection || IdentifikationsblockEintragenSQL(schreiber.sqlconnection, anlagen[0].name, &erfassung[0].id, startdatum, NULL))
+            fprintf(stderr, "S10auslesen: SQL-Server %s ist nicht erreichbar, die Messwerte werden später eingetragen\n", SQL_ADRESSE);
+    }
+    for (size_t i = 1; i < ANLAGEN; i++)
+    {
+        erfassung[i].modbus = ModbusVerbinden(anlagen + i);
+        if (NULL != erfassung[i].modbus && EXIT_SUCCESS == IdentifikationsblockAuslesenModbus(erfassung[i].modbus, &erfassung[i].id))
+        {
+            if (SQL_AKTIV && NULL != schreiber.sqlconnection)
+                IdentifikationsblockEintragenSQL(schreiber.sqlconnection, anlagen[i].name, &erfassung[i].id, startdatum, NULL);
+        }
+        else
+            fprintf(stderr, "S10auslesen: Hauskraftwerk %s ist nicht erreichbar\n", anlagen[i].adresse);
+    }
+    schreiber.id = (s10konstanten*) calloc(ANLAGEN, sizeof(s10konstanten));
+    if (NULL == schreiber.id) goto idfehler;
+    for (size_t i = 0; i < ANLAGEN; i++)
+        memcpy(schreiber.id + i, &erfassung[i].id, sizeof(s10konstanten));
 
-    s10daten *const daten = (s10daten*) calloc(NO_DATEN, sizeof(s10daten));
-    if (NULL == daten) return EXIT_FAILURE;
-    SchlafeBisVolleStunde();
-    if (LeistungsdatenAuslesenModbus(daten)) goto datfehler;
-    if (LeistungsdatenEintragenSQL(daten, startdatum)) goto datfehler;
-    free(daten);
+    /* ohne Journal wird trotzdem gemessen, es fehlt dann nur die Absicherung gegen Abstürze und Ausfälle der Datenbank.
+     * Offene Messwerte aus dem Journal trägt der Schreib-Thread im Hintergrund nach, die Erfassung beginnt daher sofort */
+    schreiber.journal = EXIT_SUCCESS == JournalOeffnen();
 
-    return EXIT_SUCCESS;
+    /* auch ohne Shared-Memory-Ring wird gemessen, die Ausgabe erfolgt dann nur als JSON-Datei */
+    RingpufferAnlegen();
+
+    /* ohne Ausgabe-Threads gibt die Erfassung selbst aus */
+    AusgabeStarten(ANLAGEN);
+
+    pthread_t schreibThread;
+    if (0 != pthread_create(&schreibThread, NULL, LeistungsdatenSchreibThread, &schreiber)) goto idfehler;
+
+    /* der Webserver ist optional, ohne ihn laufen Erfassung und Datenbank unverändert weiter */
+    WebserverStarten();
+    /* ebenso die MQTT-Ausgabe, ein unerreichbarer Broker hält die Erfassung nicht auf */
+    char const *namen[ANLAGEN];
+    for (size_t i = 0; i < ANLAGEN; i++)
+        namen[i] = anlagen[i].name;
+    MQTTStarten(namen, ANLAGEN);
+
+#if !DAEMON_MODUS
+    /* die Verbindungen nicht bis zur vollen Stunde ungenutzt offen halten */
+    for (size_t i = 0; i < ANLAGEN; i++)
+        ModbusTrennen(&erfassung[i].modbus);
+    SchlafeBis(start);
+#endif
+
+    /* jede Anlage wird in ihrem eigenen Thread ausgelesen, so verzögert ein langsames oder unerreichbares S10 die übrigen nicht */
+    result = EXIT_SUCCESS;
+    size_t gestartet = 0;
+    for (; gestartet < ANLAGEN; gestartet++)
+        if (0 != pthread_create(&erfassung[gestartet].thread, NULL, LeistungsdatenErfassungsThread, erfassung + gestartet))
+        {
+            result = EXIT_FAILURE;
+            beenden = 1;
+            break;
+        }
+    for (size_t i = 0; i < gestartet; i++)
+    {
+        void *erfassungsergebnis;
+        pthread_join(erfassung[i].thread, &erfassungsergebnis);
+        if (EXIT_SUCCESS != (intptr_t) erfassungsergebnis) result = EXIT_FAILURE;
+    }
+    /* die noch eingereihten Messwerte ausgeben, das Journal ist bereits vollständig */
+    AusgabeBeenden();
+
+    pthread_mutex_lock(&schreiber.sperre);
+    schreiber.beenden = true;
+    pthread_cond_signal(&schreiber.signal);
+    pthread_mutex_unlock(&schreiber.sperre);
+
+    void *schreibergebnis;
+    pthread_join(schreibThread, &schreibergebnis);
+    if (EXIT_SUCCESS != (intptr_t) schreibergebnis) result = EXIT_FAILURE;
+
+    WebserverBeenden();
+    MQTTBeenden();
+    for (size_t i = 0; i < ANLAGEN; i++)
+        ModbusTrennen(&erfassung[i].modbus);
+    RingpufferSchliessen();
+    JournalSchliessen();
+    MetrikenFreigeben();
+    RegisterFreigeben();
+    free(schreiber.id);
+    free(erfassung);
+    return result;
 
 idfehler:
-    free(id);
-    return EXIT_FAILURE;
-datfehler:
-    free(daten);
+    AusgabeBeenden();
+    for (size_t i = 0; i < ANLAGEN; i++)
+        ModbusTrennen(&erfassung[i].modbus);
+    if (NULL != schreiber.sqlconnection) mysql_close(schreiber.sqlconnection);
+    JournalSchliessen();
+    MetrikenFreigeben();
+    RegisterFreigeben();
+    free(schreiber.id);
+    free(erfassung);
     return EXIT_FAILURE;
 }
@@ -19,88 +19,160 @@
 
 #pragma once
 
-#include <stdint.h> /* für int32_t und Konsorten */
+#include "Aggregat.h" /* für die Zeitfenster einer Stunde */
+#include "S10daten.h" /* für s10daten und s10konstanten */
+
+#include <mariadb/mysql.h> /* für die SQL-Verbindung */
+#include <modbus/modbus-tcp.h> /* für die Modbus-Verbindung */
+
+#include <pthread.h> /* für die Abstimmung zwischen Erfassung und Schreib-Thread */
+#include <stdatomic.h> /* für den Fortschritt der Erfassung */
+#include <stdbool.h> /* für bool */
+#include <stdint.h> /* für int_fast8_t und Konsorten */
 #include <time.h> /* für struct tm */
 
 /**
- * kapselt und sortiert die Leistungsdaten des S10, also die Register welche sich sekündlich ändern können.
+ * ein S10 Hauskraftwerk, welches ausgelesen wird.
+ */
+typedef struct
+{
+    char const *name; /* wird den Tabellennamen vorangestellt (Name_YYYY_MM_DD), "" = Tabellennamen YYYY_MM_DD */
+    char const *adresse; /* IP-Adresse */
+    int port; /* Modbus-Port */
+} s10anlage;
+
+/**
+ * Grund, aus dem zu einer Sekunde kein Messwert vorliegt.
+ */
+typedef enum
+{
+    LUECKE_KEINE = 0, /* Messwert vorhanden oder Sekunde nicht erfasst (Start mitten in der Stunde, Beenden) */
+    LUECKE_AUSGELASSEN, /* übersprungen, weil eine vorherige Abfrage länger als eine Sekunde gedauert hat */
+    LUECKE_LESEFEHLER, /* die Abfrage ist gescheitert */
+    LUECKE_GETRENNT /* keine Verbindung zum S10 */
+} s10luecke;
+
+/**
+ * Zeitverhalten der Abfragen einer Stunde. Der Verzug ist der Abstand des Erfassungszeitpunkts zur Sekundengrenze,
+ * die Latenz die Dauer der Modbus-Abfrage, beides in Mikrosekunden. Fehlende Messwerte werden nach ihrem Grund gezählt.
+ */
+typedef struct
+{
+    size_t messungen; /* erfolgreiche Abfragen */
+    size_t ausgelassen; /* übersprungene Sekunden, weil eine vorherige Abfrage länger als eine Sekunde gedauert hat */
+    size_t lesefehler; /* Sekunden ohne Messwert, weil die Abfrage gescheitert ist */
+    size_t getrennt; /* Sekunden ohne Messwert, weil keine Verbindung zum S10 bestand */
+    int64_t verzugSumme;
+    int64_t verzugQuadratsumme; /* für die Standardabweichung (Jitter) */
+    int64_t verzugMax;
+    int64_t latenzSumme;
+    int64_t latenzMax;
+} s10zeitstatistik;
+
+/**
+ * kapselt die Messwerte einer Stunde, welche von der Erfassung sekündlich gefüllt und vom Schreib-Thread in die Datenbank übertragen werden.
+ */
+typedef struct s10stunde
+{
+    s10daten *daten; /* NO_DATEN Messwerte, sekundengenau und zeitlich ansteigend geordnet */
+    s10gueltig *gueltig; /* GUELTIG_WORTE(NO_DATEN), je Sekunde ein Bit für einen ausgelesenen Messwert */
+    uint8_t *grund; /* NO_DATEN s10luecke, je Sekunde ohne Messwert der Grund dafür, NULL ohne LUECKEN */
+    uint32_t anlage; /* Nummer des Hauskraftwerks in der Anlagenliste */
+    s10konstanten id; /* Identifikationsdaten für die Tabelle des Tages */
+    struct tm zeit; /* stundengenaues Datum der Messwerte */
+    time_t start; /* hh:00:00 Uhr als Sekunden seit 1.1.1970 (UTC) */
+    atomic_size_t erfasst; /* so viele Sekunden der Stunde sind bereits abgeschlossen */
+    s10zeitstatistik statistik; /* Zeitverhalten der Abfragen, nur von der Erfassung verwendet */
+    bool abgeschlossen; /* die Erfassung der Stunde ist beendet, nur unter der Sperre des Schreibers verwenden */
+    size_t geschrieben; /* so viele Sekunden stehen bereits in der Datenbank, nur vom Schreib-Thread verwendet */
+    size_t archiviert; /* so viele Sekunden stehen bereits im Archiv, nur vom Schreib-Thread verwendet */
+    uint16_t *roh; /* NO_DATEN Zeilen mit je RohRegister() gelesenen Registern, NULL ohne ROH_VERZEICHNIS */
+    size_t rohabgelegt; /* so viele Sekunden stehen bereits in der Rohdatei, nur vom Schreib-Thread verwendet */
+    s10aggregat *aggregate; /* Zeitfenster aller Stufen, wird von der Erfassung mit jedem Messwert fortgeschrieben, NULL ohne AGGREGATE */
+    size_t aggregiert[AGGREGAT_STUFEN]; /* je Stufe so viele Fenster sind bereits abgelegt, nur vom Schreib-Thread verwendet */
+    bool eingetragen; /* abgeschlossen und vollständig eingetragen, wird vom Schreib-Thread aus der Warteschlange entfernt */
+    struct s10stunde *naechste; /* nächste Stunde in der Warteschlange des Schreib-Threads */
+} s10stunde;
+
+/**
+ * Warteschlange der Stunden aller Anlagen, welche der Schreib-Thread der Reihe nach in die Datenbank überträgt.
+ * Alle Felder werden nur unter der Sperre gelesen und geschrieben.
  */
 typedef struct
 {
-    int32_t const P_pv;
-    int32_t const P_bat;
-    int32_t const P_haus;
-    int32_t const P_netz;
-    int32_t const P_ext;
-    int32_t const P_wall;
-    int32_t const P_pvwall;
-    uint8_t const eigen;
-    uint8_t const autarkie;
-    uint16_t const soc;
-    uint16_t const notstr;
-    uint16_t const ems;
-    int16_t const emsrc;
-    uint16_t const emsctrl;
-    uint16_t const wall1;
-    uint16_t const wall2;
-    uint16_t const wall3;
-    uint16_t const wall4;
-    uint16_t const wall5;
-    uint16_t const wall6;
-    uint16_t const wall7;
-    uint16_t const wall8;
-    uint16_t const Vdc1;
-    uint16_t const Vdc2;
-    uint16_t const Vdc3;
-    uint16_t const Idc1;
-    uint16_t const Idc2;
-    uint16_t const Idc3;
-    uint16_t const Pdc1;
-    uint16_t const Pdc2;
-    uint16_t const Pdc3;
-} s10daten;
+    MYSQL *sqlconnection; /* wird vom Schreib-Thread übernommen und bei Bedarf neu aufgebaut, darf NULL sein */
+    s10stunde *erste; /* älteste noch nicht vollständig eingetragene Stunde */
+    s10stunde *letzte; /* zuletzt eingereihte Stunde */
+    bool beenden; /* nach der letzten Stunde beendet sich der Schreib-Thread */
+    bool journal; /* das Journal ist geöffnet, nicht eintragbare Stunden verbleiben darin und werden nachgetragen */
+    s10konstanten *id; /* je Anlage die zuletzt bekannten Identifikationsdaten für nachgetragene Stunden, nur vom Schreib-Thread verwendet */
+    pthread_mutex_t sperre;
+    pthread_cond_t signal; /* weckt den Schreib-Thread beim Abschließen einer Stunde */
+} s10schreiber;
 
 /**
- * kapselt und sortiert die Werte der nicht-volatilen Register des S10, also die Daten welche sich nie oder nur selten ändern.
+ * Zustand der Erfassung eines Hauskraftwerks, jede Anlage wird in ihrem eigenen Thread ausgelesen.
  */
 typedef struct
 {
-    uint16_t const magic;
-    uint8_t const mb_minor;
-    uint8_t const mb_major;
-    uint16_t const reg;
-    char const hersteller[32];
-    char const modell[32];
-    char const seriennr[32];
-    char const firmware[32];
-} s10konstanten;
+    uint32_t anlage; /* Nummer des Hauskraftwerks in der Anlagenliste */
+    modbus_t *modbus; /* Modbus-Verbindung, darf NULL sein */
+    s10konstanten id; /* zuletzt ausgelesene Identifikationsdaten */
+    time_t start; /* Beginn der ersten zu erfassenden Stunde */
+    s10schreiber *schreiber; /* Warteschlange, in welche die erfassten Stunden eingereiht werden */
+    pthread_t thread;
+} s10erfassung;
 
 /**
- * liest die Identifikationsdaten des S10 einmalig aus.
+ * liest die Identifikationsdaten des S10 aus.
+ * @param offene Modbus-Verbindung zum S10.
  * @param s10konstanten_t welches mit den ausgelesenen Werten gefüllt wird.
  * @return EXIT_SUCCESS wenn die Daten erfolgreich gelesen werden konnten, sonst EXIT_FAILURE.
  */
-int_fast8_t IdentifikationsblockAuslesenModbus(s10konstanten* const);
+int_fast8_t IdentifikationsblockAuslesenModbus(modbus_t* const, s10konstanten* const);
 
 /**
- * schreibt die Identifikationsdaten des S10 in die Datums-abhängige SQL Datenbank.
+ * schreibt die Identifikationsdaten des S10 in die Datums-abhängige SQL Datenbank bzw. mit SQL_ZEITREIHE in s10geraete.
+ * @param offene SQL-Verbindung.
+ * @param Name der Anlage, der dem Tabellennamen vorangestellt wird, "" = ohne Namen.
  * @param s10konstanten_t mit den Identifikationsdaten, welche in die SQL Datenbank geschrieben werden sollen.
  * @param (tagesgenaues) Datum, für welches in der SQL Datenbank ggfs. eine neue Tabelle erzeugt wird.
- * @return Rückgabewert von mysql_query() falls SQL-Verbindung aufgebaut werden konnte, sonst EXIT_FAILURE.
+ * @param wird mit SQL_ZEITREIHE auf die Nummer der Anlage in s10anlagen gesetzt, darf NULL sein.
+ * @return Rückgabewert von mysql_query() falls die Anfrage erstellt werden konnte, sonst EXIT_FAILURE.
  */
-int_fast8_t IdentifikationsblockEintragenSQL(s10konstanten* const, struct tm const);
+int_fast8_t IdentifikationsblockEintragenSQL(MYSQL* const, char const* const, s10konstanten const* const, struct tm const, uint16_t* const);
 
 /**
- * liest die Leistungsdaten des S10 in der aktuellen Stunde sekundengenau aus.
- * @param Array s10daten_t, welches sekundengenau und zeitlich geordnet die ausgelesenen Messwerte beinhaltet.
+ * liest die Leistungsdaten des S10 in der aktuellen Stunde sekundengenau aus und sichert jeden Messwert im Journal.
+ * @param Modbus-Verbindung zum S10, wird bei Verbindungsverlust neu aufgebaut und darf auch NULL sein.
+ * @param s10konstanten_t, welches nach einem Neuverbinden mit den neu ausgelesenen Identifikationsdaten gefüllt wird.
+ * @param s10stunde_t, dessen Array sekundengenau und zeitlich geordnet mit den ausgelesenen Messwerten gefüllt wird.
  * @return EXIT_SUCCESS wenn die Daten erfolgreich gelesen werden konnten, sonst EXIT_FAILURE.
  */
-int_fast8_t LeistungsdatenAuslesenModbus(s10daten* const);
+int_fast8_t LeistungsdatenAuslesenModbus(modbus_t** const, s10konstanten* const, s10stunde* const);
+
+/**
+ * erfasst die Leistungsdaten eines S10 Stunde für Stunde und reiht jede Stunde in die Warteschlange des Schreib-Threads ein,
+ * im DAEMON_MODUS bis das Beenden angefordert wird, sonst für eine Stunde. Wird je Anlage als eigener Thread gestartet.
+ * @param s10erfassung_t der Anlage.
+ * @return EXIT_SUCCESS (als Zeiger) wenn alle Stunden erfasst werden konnten, sonst EXIT_FAILURE.
+ */
+void* LeistungsdatenErfassungsThread(void* const);
+
+/**
+ * schreibt die Leistungsdaten des S10 im Hintergrund alle SQL_SCHREIBINTERVALL Sekunden bzw. am Ende jeder Stunde in die Datums-abhängige
+ * SQL Datenbank, bis alle Stunden der Warteschlange eingetragen sind und das Beenden angefordert wurde. Wird als eigener Thread gestartet.
+ * @param s10schreiber_t mit der Warteschlange der einzutragenden Stunden.
+ * @return EXIT_SUCCESS (als Zeiger) wenn alle Stunden vollständig eingetragen werden konnten, sonst EXIT_FAILURE.
+ */
+void* LeistungsdatenSchreibThread(void* const);
 
 /**
- * schreibt die  Leistungsdaten des S10 in die Datums-abhängige SQL Datenbank
- * @param Array s10daten_t, welches alle ausgelesenen Messwerte der letzten beinhaltet, die sekundengenau und zeitlich ansteigend geordnet sind.
- * @param (stundengenaues) Datum, für welche Stunde innerhalb der entspr. Einzeltages-Tabelle die Werte in die Datenbank eingetragen werden.
- * @return EXIT_SUCCESS wenn die Daten erfolgreich eingetragen werden konnten, sonst EXIT_FAILURE.
+ * trägt im Journal verbliebene Messwerte (z.B. nach einem Absturz oder einem Ausfall der Datenbank) in die Datums-abhängige SQL Datenbank
+ * und/oder das Archiv nach, älteste zuerst und höchstens NACHTRAG_ZEILEN Messwerte je Aufruf.
+ * @param offene SQL-Verbindung, NULL wenn SQL_AKTIV 0 ist.
+ * @param je Anlage die Identifikationsdaten für neu anzulegende Tabellen und Archivdateien.
+ * @param je Anlage die letzte nachzutragende Sekunde, wird auf 0 gesetzt, sobald für die Anlage nichts mehr nachzutragen ist.
+ * @return EXIT_SUCCESS wenn alle Messwerte dieses Aufrufs eingetragen werden konnten, sonst EXIT_FAILURE.
  */
-int_fast8_t LeistungsdatenEintragenSQL(s10daten* const, struct tm const);
+int_fast8_t JournalNachtragen(MYSQL* const, s10konstanten const* const, time_t* const);
@@ -0,0 +1,128 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+#include <stdatomic.h> /* für die Gültigkeit der Messwerte */
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für size_t */
+#include <stdint.h> /* für int32_t und Konsorten */
+
+/**
+ * kapselt und sortiert die Leistungsdaten des S10, also die Register welche sich sekündlich ändern können.
+ */
+typedef struct
+{
+    int32_t const P_pv;
+    int32_t const P_bat;
+    int32_t const P_haus;
+    int32_t const P_netz;
+    int32_t const P_ext;
+    int32_t const P_wall;
+    int32_t const P_pvwall;
+    uint8_t const eigen;
+    uint8_t const autarkie;
+    uint16_t const soc;
+    uint16_t const notstr;
+    uint16_t const ems;
+    int16_t const emsrc;
+    uint16_t const emsctrl;
+    uint16_t const wall1;
+    uint16_t const wall2;
+    uint16_t const wall3;
+    uint16_t const wall4;
+    uint16_t const wall5;
+    uint16_t const wall6;
+    uint16_t const wall7;
+    uint16_t const wall8;
+    uint16_t const Vdc1;
+    uint16_t const Vdc2;
+    uint16_t const Vdc3;
+    uint16_t const Idc1;
+    uint16_t const Idc2;
+    uint16_t const Idc3;
+    uint16_t const Pdc1;
+    uint16_t const Pdc2;
+    uint16_t const Pdc3;
+} s10daten;
+
+/**
+ * kapselt und sortiert die Werte der nicht-volatilen Register des S10, also die Daten welche sich nie oder nur selten ändern.
+ */
+typedef struct
+{
+    uint16_t const magic;
+    uint8_t const mb_minor;
+    uint8_t const mb_major;
+    uint16_t const reg;
+    char const hersteller[32];
+    char const modell[32];
+    char const seriennr[32];
+    char const firmware[32];
+} s10konstanten;
+
+/**
+ * Gültigkeit der Messwerte einer Stunde, je Sekunde ein Bit: gesetzt = Messwert wurde ausgelesen, sonst fehlt er.
+ * Die Erfassung setzt die Bits, während der Schreib-Thread die bereits abgeschlossenen Sekunden desselben Worts liest, daher atomar.
+ */
+typedef atomic_uint_fast64_t s10gueltig;
+/* Anzahl der Worte für die angegebene Anzahl von Sekunden */
+#define GUELTIG_WORTE(sekunden) (((sekunden) + 63) / 64)
+
+/**
+ * markiert einen Messwert als gültig.
+ * @param gueltig die Gültigkeit der Stunde.
+ * @param sekunde Sekunde des Messwerts innerhalb der Stunde.
+ */
+static inline void GueltigSetzen(s10gueltig *const gueltig, size_t const sekunde)
+{
+    atomic_fetch_or_explicit(gueltig + sekunde / 64, UINT64_C(1) << sekunde % 64, memory_order_relaxed);
+}
+
+/**
+ * @param gueltig die Gültigkeit der Stunde.
+ * @param sekunde Sekunde des Messwerts innerhalb der Stunde.
+ * @return true wenn der Messwert ausgelesen wurde.
+ */
+static inline bool Gueltig(s10gueltig const *const gueltig, size_t const sekunde)
+{
+    return 0 != (atomic_load_explicit(gueltig + sekunde / 64, memory_order_relaxed) >> sekunde % 64 & 1);
+}
+
+/**
+ * sucht den nächsten gültigen Messwert, fehlende Messwerte werden wortweise übersprungen.
+ * @param gueltig die Gültigkeit der Stunde.
+ * @param von erste Sekunde, die in Frage kommt.
+ * @param bis erste Sekunde, die nicht mehr in Frage kommt.
+ * @return Sekunde des nächsten gültigen Messwerts oder bis, falls keiner mehr folgt.
+ */
+static inline size_t GueltigSuchen(s10gueltig const *const gueltig, size_t von, size_t const bis)
+{
+    while (von < bis)
+    {
+        uint64_t const wort = atomic_load_explicit(gueltig + von / 64, memory_order_relaxed) >> von % 64;
+        if (0 != wort)
+        {
+            von += __builtin_ctzll(wort);
+            return von < bis ? von : bis;
+        }
+        von = (von / 64 + 1) * 64;
+    }
+    return bis;
+}
@@ -0,0 +1,464 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define _GNU_SOURCE /* für accept4 */
+
+#include "Webserver.h" /* zugehöriger Header dieser Datei */
+#include "Einstellungen.h" /* für die Benutzerdaten */
+#include "JSON.h" /* Formatierung der Messwerte */
+#include "Metriken.h" /* für GET /metrics */
+#include "Ringpuffer.h" /* Quelle der Messwerte */
+
+#include <arpa/inet.h> /* für inet_pton */
+#include <errno.h> /* für EAGAIN */
+#include <netinet/in.h> /* für sockaddr_in */
+#include <pthread.h> /* für den Webserver-Thread */
+#include <stdatomic.h> /* für das Beenden des Threads */
+#include <stdbool.h> /* für bool */
+#include <stdio.h> /* für String-Formatierung und Fehlermeldungen */
+#include <stdlib.h> /* Speicherbehandlung und Rückgabewerte */
+#include <string.h> /* String-Operationen */
+#include <strings.h> /* für strncasecmp */
+#include <sys/epoll.h> /* für epoll */
+#include <sys/eventfd.h> /* Benachrichtigung durch die Erfassung */
+#include <sys/socket.h> /* für die Sockets */
+#include <sys/un.h> /* für sockaddr_un */
+#include <unistd.h> /* für read(), write() und close() */
+
+/* Max-Länge einer HTTP-Anfrage samt Headern */
+#define LEN_ANFRAGE         2048
+/* Größe des Sendepuffers je Client, nachgefüllt wird sobald ein Ereignis samt Messwert Platz hat */
+#define LEN_AUSGANG         16384
+/* Max-Länge eines Ereignisses im Ereignisstrom: "id: 4294967295\ndata: " + JSON + "\n\n" */
+#define LEN_EREIGNIS        (LEN_JSON + 32)
+
+typedef enum
+{
+    FREI, /* Platz ist unbenutzt */
+    ANFRAGE, /* HTTP-Anfrage wird gelesen */
+    ANTWORT, /* vollständige Antwort liegt im Sendepuffer, danach wird getrennt */
+    VERLAUF, /* JSON-Array der letzten Messwerte wird stückweise gesendet */
+    STROM /* Server-Sent-Events, jeder neue Messwert wird gesendet */
+} clientzustand;
+
+/**
+ * Zustand einer Client-Verbindung.
+ */
+typedef struct
+{
+    int fd;
+    clientzustand zustand;
+    bool schreibbereit; /* EPOLLOUT ist angemeldet, weil der Sendepuffer nicht vollständig gesendet werden konnte */
+    bool komma; /* Verlauf: vor dem nächsten Messwert steht ein Komma */
+    uint32_t naechste; /* laufende Nummer des nächsten zu sendenden Messwerts */
+    uint32_t ende; /* Verlauf: erste laufende Nummer, die nicht mehr gesendet wird */
+    size_t eingang; /* gelesene Zeichen der Anfrage */
+    size_t ausgangStart; /* erstes noch nicht gesendetes Zeichen im Sendepuffer */
+    size_t ausgangEnde;
+    char *text; /* Antwort, die nicht in den Sendepuffer passt (/metrics), mit malloc angelegt und statt ausgang gesendet, sonst NULL */
+    char anfrage[LEN_ANFRAGE];
+    char ausgang[LEN_AUSGANG];
+} webclient;
+
+static int lauscher = -1; /* Socket, auf dem neue Verbindungen angenommen werden */
+static int ereignis = -1; /* eventfd, über das die Erfassung neue Messwerte meldet */
+static int epollfd = -1;
+static atomic_bool anhalten = false;
+static pthread_t thread;
+static webclient *clients = NULL; /* HTTP_CLIENTS Plätze */
+static s10ring const *ring = NULL; /* Ring, wird vom Webserver-Thread nur lesend eingeblendet */
+
+/**
+ * trennt einen Client und gibt seinen Platz frei.
+ * @param client der Client.
+ */
+static void ClientTrennen(webclient *const client)
+{
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client->text);
+    client->text = NULL;
+    client->zustand = FREI;
+}
+
+/**
+ * hängt Text an den Sendepuffer eines Clients an.
+ * @param client der Client.
+ * @param text anzuhängender Text, muss in den Sendepuffer passen.
+ * @param laenge Länge des Texts.
+ */
+static void AusgangAnhaengen(webclient *const client, char const *const text, size_t const laenge)
+{
+    memcpy(client->ausgang + client->ausgangEnde, text, laenge);
+    client->ausgangEnde += laenge;
+}
+
+/**
+ * füllt den Sendepuffer eines Clients im Verlauf oder Ereignisstrom mit den nächsten Messwerten aus dem Ring.
+ * @param client der Client.
+ */
+static void AusgangFuellen(webclient *const client)
+{
+    if (VERLAUF != client->zustand && STROM != client->zustand) return;
+
+    /* bereits gesendete Zeichen verwerfen, damit hinten Platz entsteht */
+    if (client->ausgangStart > 0)
+    {
+        memmove(client->ausgang, client->ausgang + client->ausgangStart, client->ausgangEnde - client->ausgangStart);
+        client->ausgangEnde -= client->ausgangStart;
+        client->ausgangStart = 0;
+    }
+
+    uint32_t const anzahl = RingpufferAnzahl(ring);
+    if (STROM == client->zustand && anzahl - client->naechste > HTTP_RUECKSTAND) client->naechste = anzahl - 1;
+    if (anzahl - client->naechste > ring->plaetze) client->naechste = anzahl - ring->plaetze; /* schon überschrieben */
+    uint32_t const bis = VERLAUF == client->zustand ? client->ende : anzahl;
+
+    s10ringmesswert messwert;
+    while (client->naechste != bis && LEN_AUSGANG - client->ausgangEnde >= LEN_EREIGNIS)
+    {
+        if (RingpufferLesen(ring, client->naechste, &messwert))
+        {
+            char *const ziel = client->ausgang + client->ausgangEnde;
+            if (STROM == client->zustand)
+            {
+                size_t laenge = sprintf(ziel, "id: %u\ndata: ", messwert.nummer);
+                laenge += JSONFormatieren(ziel + laenge, &messwert.daten, messwert.zeit / 1000000);
+                client->ausgangEnde += laenge + sprintf(ziel + laenge, "\n\n");
+            }
+            else
+            {
+                size_t const komma = client->komma ? sprintf(ziel, ",") : 0;
+                client->ausgangEnde += komma + JSONFormatieren(ziel + komma, &messwert.daten, messwert.zeit / 1000000);
+                client->komma = true;
+            }
+        }
+        client->naechste++;
+    }
+
+    if (VERLAUF == client->zustand && client->naechste == bis && LEN_AUSGANG > client->ausgangEnde)
+    {
+        AusgangAnhaengen(client, "]", 1);
+        client->zustand = ANTWORT;
+    }
+}
+
+/**
+ * sendet so viel vom Sendepuffer eines Clients wie der Socket ohne Blockieren annimmt und füllt dabei Verlauf bzw. Ereignisstrom nach.
+ * Bleibt etwas übrig, wird EPOLLOUT angemeldet, eine vollständig gesendete Antwort trennt den Client.
+ * @param client der Client.
+ */
+static void ClientSenden(webclient *const client)
+{
+    for (;;)
+    {
+        AusgangFuellen(client);
+        if (client->ausgangStart == client->ausgangEnde) break;
+
+        char const *const puffer = NULL != client->text ? client->text : client->ausgang;
+        ssize_t const gesendet = send(client->fd, puffer + client->ausgangStart, client->ausgangEnde - client->ausgangStart,
+                                      MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (gesendet < 0)
+        {
+            if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+            {
+                ClientTrennen(client);
+                return;
+            }
+            break;
+        }
+        client->ausgangStart += gesendet;
+    }
+
+    bool const rest = client->ausgangStart != client->ausgangEnde;
+    if (!rest && ANTWORT == client->zustand)
+    {
+        ClientTrennen(client);
+        return;
+    }
+    if (rest != client->schreibbereit)
+    {
+        struct epoll_event anmeldung = { .events = EPOLLIN | EPOLLRDHUP | (rest ? EPOLLOUT : 0), .data.ptr = client };
+        epoll_ctl(epollfd, EPOLL_CTL_MOD, client->fd, &anmeldung);
+        client->schreibbereit = rest;
+    }
+}
+
+/**
+ * wertet eine vollständig gelesene HTTP-Anfrage aus und bereitet die Antwort vor.
+ * @param client der Client, dessen Anfrage ausgewertet wird.
+ */
+static void AnfrageBearbeiten(webclient *const client)
+{
+    static char const kopf[] = "HTTP/1.1 %s\r\nContent-Type: %s\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\n\r\n";
+    char *const pfad = client->anfrage + 4;
+    char *const pfadende = strchr(pfad, ' ');
+    if (0 != strncmp(client->anfrage, "GET ", 4) || NULL == pfadende)
+    {
+        client->ausgangEnde = sprintf(client->ausgang, kopf, "405 Method Not Allowed", "text/plain", "close");
+        client->zustand = ANTWORT;
+        return;
+    }
+    *pfadende = '\0';
+
+    uint32_t const anzahl = NULL == ring ? 0 : RingpufferAnzahl(ring);
+    if (0 == strcmp(pfad, "/metrics"))
+    {
+        /* die Metriken sind auch ohne Messwerte im Ring abrufbar, gerade dann sind sie zur Fehlersuche interessant */
+        /* die Länge wächst mit der Anzahl der Anlagen, deshalb eigener Puffer statt ausgang */
+        sprintf(client->ausgang, kopf, "200 OK", "text/plain; version=0.0.4", "close");
+        client->text = MetrikenText(client->ausgang, &client->ausgangEnde);
+        if (NULL == client->text) client->ausgangEnde = sprintf(client->ausgang, kopf, "500 Internal Server Error", "text/plain", "close");
+        client->zustand = ANTWORT;
+    }
+    else if (0 == anzahl)
+    {
+        client->ausgangEnde = sprintf(client->ausgang, kopf, "503 Service Unavailable", "text/plain", "close");
+        client->zustand = ANTWORT;
+    }
+    else if (0 == strcmp(pfad, "/aktuell") || 0 == strcmp(pfad, "/"))
+    {
+        /* der neueste Messwert kann gerade überschrieben werden, dann lieber ein Fehler als eine leere Antwort mit 200 */
+        s10ringmesswert messwert;
+        if (RingpufferLesen(ring, anzahl - 1, &messwert))
+        {
+            size_t const laenge = sprintf(client->ausgang, kopf, "200 OK", "application/json", "close");
+            client->ausgangEnde = laenge + JSONFormatieren(client->ausgang + laenge, &messwert.daten, messwert.zeit / 1000000);
+        }
+        else
+        {
+            size_t const laenge = sprintf(client->ausgang, kopf, "503 Service Unavailable", "text/plain", "close");
+            client->ausgangEnde = laenge + sprintf(client->ausgang + laenge, "Messwert nicht lesbar, bitte wiederholen\n");
+        }
+        client->zustand = ANTWORT;
+    }
+    else if (0 == strncmp(pfad, "/verlauf", 8) && ('\0' == pfad[8] || '?' == pfad[8]))
+    {
+        char const *const parameter = strstr(pfad, "n=");
+        unsigned long n = NULL == parameter ? 60 : strtoul(parameter + 2, NULL, 10);
+        if (n < 1) n = 1;
+        if (n > ring->plaetze) n = ring->plaetze;
+        if (n > anzahl) n = anzahl;
+        client->zustand = VERLAUF;
+        client->komma = false;
+        client->naechste = anzahl - n;
+        client->ende = anzahl;
+        client->ausgangEnde = sprintf(client->ausgang, kopf, "200 OK", "application/json", "close");
+        AusgangAnhaengen(client, "[", 1);
+    }
+    else if (0 == strcmp(pfad, "/strom"))
+    {
+        /* nach einem Verbindungsabbruch schickt der Browser die Nummer des letzten Ereignisses mit, ab dort wird nahtlos fortgesetzt */
+        char const *letzte = strstr(pfadende + 1, "\r\n");
+        while (NULL != letzte && 0 != strncasecmp(letzte, "\r\nLast-Event-ID:", 16)) /* Header-Namen ohne Unterscheidung der Groß-/Kleinschreibung */
+            letzte = strstr(letzte + 2, "\r\n");
+        uint32_t const nummer = NULL == letzte ? anzahl - 1 : (uint32_t) strtoul(letzte + 16, NULL, 10) + 1;
+        client->zustand = STROM;
+        client->naechste = anzahl - nummer <= HTTP_RUECKSTAND ? nummer : anzahl - 1;
+        client->ausgangEnde = sprintf(client->ausgang, kopf, "200 OK", "text/event-stream", "keep-alive");
+    }
+    else
+    {
+        client->ausgangEnde = sprintf(client->ausgang, kopf, "404 Not Found", "text/plain", "close");
+        client->zustand = ANTWORT;
+    }
+}
+
+/**
+ * liest von einem Client. Während der Anfrage wird bis zur Leerzeile gesammelt, danach wird nur noch auf das Trennen geachtet.
+ * @param client der Client.
+ */
+static void ClientLesen(webclient *const client)
+{
+    char verwerfen[256];
+    char *const ziel = ANFRAGE == client->zustand ? client->anfrage + client->eingang : verwerfen;
+    size_t const platz = ANFRAGE == client->zustand ? LEN_ANFRAGE - 1 - client->eingang : sizeof(verwerfen);
+
+    ssize_t const gelesen = recv(client->fd, ziel, platz, MSG_DONTWAIT);
+    if (0 == gelesen || (gelesen < 0 && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno))
+    {
+        ClientTrennen(client);
+        return;
+    }
+    if (gelesen < 0 || ANFRAGE != client->zustand) return;
+
+    client->eingang += gelesen;
+    client->anfrage[client->eingang] = '\0';
+    if (NULL != strstr(client->anfrage, "\r\n\r\n"))
+    {
+        AnfrageBearbeiten(client);
+        ClientSenden(client);
+    }
+    else if (LEN_ANFRAGE - 1 == client->eingang)
+        ClientTrennen(client); /* Anfrage zu lang */
+}
+
+/**
+ * nimmt alle wartenden Verbindungen an und weist ihnen einen freien Platz zu, ohne freien Platz wird sofort getrennt.
+ */
+static void VerbindungenAnnehmen(void)
+{
+    int fd;
+    while ((fd = accept4(lauscher, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        webclient *client = NULL;
+        for (size_t i = 0; i < HTTP_CLIENTS && NULL == client; i++)
+            if (FREI == clients[i].zustand) client = clients + i;
+
+        struct epoll_event anmeldung = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = client };
+        if (NULL == client || 0 != epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &anmeldung))
+        {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->zustand = ANFRAGE;
+        client->schreibbereit = false;
+        client->eingang = 0;
+        client->ausgangStart = 0;
+        client->ausgangEnde = 0;
+    }
+}
+
+/**
+ * Hauptschleife des Webservers: wartet mit epoll auf neue Verbindungen, Anfragen, freien Sendepuffer und neue Messwerte.
+ * @param arg unbenutzt.
+ * @return NULL
+ */
+static void *WebserverThread(void *const arg)
+{
+    (void) arg;
+    struct epoll_event ereignisse[32];
+
+    while (!atomic_load(&anhalten))
+    {
+        int const anzahl = epoll_wait(epollfd, ereignisse, sizeof(ereignisse) / sizeof(ereignisse[0]), -1);
+        for (int i = 0; i < anzahl; i++)
+        {
+            if (&lauscher == ereignisse[i].data.ptr)
+                VerbindungenAnnehmen();
+            else if (&ereignis == ereignisse[i].data.ptr)
+            {
+                uint64_t zaehler;
+                if (sizeof(zaehler) != read(ereignis, &zaehler, sizeof(zaehler))) continue;
+                if (NULL == ring) ring = RingpufferVerbinden(RING_NAME);
+                if (NULL == ring) continue;
+                for (size_t k = 0; k < HTTP_CLIENTS; k++)
+                    if (STROM == clients[k].zustand && !clients[k].schreibbereit) ClientSenden(clients + k);
+            }
+            else
+            {
+                webclient *const client = (webclient*) ereignisse[i].data.ptr;
+                if (FREI == client->zustand) continue; /* in dieser Runde bereits getrennt */
+                if (ereignisse[i].events & (EPOLLERR | EPOLLHUP))
+                    ClientTrennen(client);
+                else
+                {
+                    if (ereignisse[i].events & (EPOLLIN | EPOLLRDHUP)) ClientLesen(client);
+                    if (FREI != client->zustand && (ereignisse[i].events & EPOLLOUT)) ClientSenden(client);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * öffnet den nicht-blockierenden Socket, auf dem der Webserver lauscht.
+ * @return der Socket oder -1 bei einem Fehler.
+ */
+static int LauscherOeffnen(void)
+{
+    int fd;
+    if (sizeof(HTTP_SOCKET) > 1)
+    {
+        struct sockaddr_un adresse = { .sun_family = AF_UNIX };
+        strncpy(adresse.sun_path, HTTP_SOCKET, sizeof(adresse.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(HTTP_SOCKET);
+        if (fd >= 0 && 0 == bind(fd, (struct sockaddr*) &adresse, sizeof(adresse)) && 0 == listen(fd, SOMAXCONN)) return fd;
+    }
+    else
+    {
+        struct sockaddr_in adresse = { .sin_family = AF_INET, .sin_port = htons(HTTP_PORT) };
+        int const ja = 1;
+        inet_pton(AF_INET, HTTP_ADRESSE, &adresse.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        /* ohne SO_REUSEPORT: läuft noch ein zweiter Prozess, scheitert bind() sichtbar, statt die Clients auf beide zu verteilen */
+        if (fd >= 0 && 0 == setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &ja, sizeof(ja))
+            && 0 == bind(fd, (struct sockaddr*) &adresse, sizeof(adresse)) && 0 == listen(fd, SOMAXCONN)) return fd;
+    }
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+int_fast8_t WebserverStarten(void)
+{
+    if (0 == HTTP_PORT && sizeof(HTTP_SOCKET) <= 1) return EXIT_SUCCESS;
+
+    clients = (webclient*) calloc(HTTP_CLIENTS, sizeof(webclient));
+    lauscher = LauscherOeffnen();
+    ereignis = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    ring = RingpufferVerbinden(RING_NAME);
+
+    struct epoll_event anmeldungLauscher = { .events = EPOLLIN, .data.ptr = &lauscher };
+    struct epoll_event anmeldungEreignis = { .events = EPOLLIN, .data.ptr = &ereignis };
+    if (NULL != clients && lauscher >= 0 && ereignis >= 0 && epollfd >= 0 && 0 == epoll_ctl(epollfd, EPOLL_CTL_ADD, lauscher, &anmeldungLauscher)
+        && 0 == epoll_ctl(epollfd, EPOLL_CTL_ADD, ereignis, &anmeldungEreignis) && 0 == pthread_create(&thread, NULL, WebserverThread, NULL))
+        return EXIT_SUCCESS;
+
+    fprintf(stderr, "S10auslesen: Webserver kann nicht gestartet werden\n");
+    if (lauscher >= 0) close(lauscher);
+    if (ereignis >= 0) close(ereignis);
+    if (epollfd >= 0) close(epollfd);
+    RingpufferTrennen(ring);
+    free(clients);
+    lauscher = ereignis = epollfd = -1;
+    ring = NULL;
+    clients = NULL;
+    return EXIT_FAILURE;
+}
+
+void WebserverBenachrichtigen(void)
+{
+    uint64_t const eins = 1;
+    if (ereignis >= 0 && sizeof(eins) != write(ereignis, &eins, sizeof(eins))) return; /* Zähler voll: Webserver ist ohnehin schon geweckt */
+}
+
+void WebserverBeenden(void)
+{
+    if (NULL == clients) return;
+
+    atomic_store(&anhalten, true);
+    WebserverBenachrichtigen();
+    pthread_join(thread, NULL);
+
+    for (size_t i = 0; i < HTTP_CLIENTS; i++)
+        if (FREI != clients[i].zustand) ClientTrennen(clients + i);
+    close(lauscher);
+    close(ereignis);
+    close(epollfd);
+    if (sizeof(HTTP_SOCKET) > 1) unlink(HTTP_SOCKET);
+    RingpufferTrennen(ring);
+    free(clients);
+    lauscher = ereignis = epollfd = -1;
+    ring = NULL;
+    clients = NULL;
+}
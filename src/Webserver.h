@@ -0,0 +1,47 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#pragma once
+
+/*
+ * eingebauter Webserver für lokale Abnehmer der Messwerte. Ein eigener Thread bedient alle Clients nicht-blockierend über epoll
+ * und liest die Messwerte aus dem Shared-Memory-Ring, die Erfassung stößt ihn pro Messwert nur über ein eventfd an.
+ *   GET /aktuell          neuester Messwert als JSON-Objekt
+ *   GET /verlauf?n=600    die letzten n Messwerte als JSON-Array (höchstens RING_PLAETZE)
+ *   GET /strom            Server-Sent-Events, ein Ereignis pro Messwert sobald er ausgelesen ist (Last-Event-ID wird berücksichtigt)
+ *   GET /metrics          Laufzeitmetriken im Textformat von Prometheus
+ */
+
+#include <stdint.h> /* für int_fast8_t */
+
+/**
+ * öffnet den Socket des Webservers und startet dessen Thread.
+ * @return EXIT_SUCCESS wenn der Webserver läuft oder abgeschaltet ist, sonst EXIT_FAILURE.
+ */
+int_fast8_t WebserverStarten(void);
+
+/**
+ * teilt dem Webserver mit, dass ein neuer Messwert im Ring steht. Kostet die Erfassung nur einen write() auf ein eventfd.
+ */
+void WebserverBenachrichtigen(void);
+
+/**
+ * beendet den Webserver, trennt alle Clients und wartet auf das Ende seines Threads.
+ */
+void WebserverBeenden(void);
@@ -0,0 +1,553 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * S10analyse wertet die gespeicherten Messwerte beliebig langer Zeiträume aus, ohne SQL über alle Tagestabellen laufen zu lassen.
+ * 1) lädt je Tag nur die benötigten Felder spaltenweise (je Feld ein Array über alle Sekunden des Tages) aus dem Archiv oder mit -s aus der
+ *    Datenbank, mit DELTA_MODUS werden die Zeilen dabei wieder auf jede Sekunde ausgedehnt. Fehlende Sekunden werden als 0 geladen und in
+ *    einer eigenen Gültigkeitsspalte vermerkt, so kommen die Rechenschleifen ohne Verzweigung aus und lassen sich vektorisieren.
+ * 2) summiert je Leistung getrennt die positiven und negativen Werte (Energie in Ws) und zählt die Werte des gewählten Felds in einem
+ *    Histogramm mit 1er-Auflösung. Die Tage werden auf -t Threads verteilt, jeder Thread mit eigenem Histogramm und ggfs. eigener Verbindung.
+ * 3) gibt die Energien, Eigenverbrauchsquote, Autarkie, Batteriezyklen sowie Perzentile und Histogramm des gewählten Felds aus.
+ * S10auslesen.c wird wie beim S10benchmark direkt eingebunden.
+ *
+ * Aufruf: S10analyse [-s] [-a Verzeichnis] [-n Anlage] [-v JJJJ-MM-TT] [-b JJJJ-MM-TT] [-f Feld] [-w Klassenbreite] [-k kWh] [-t Threads] [-d]
+ *   -s aus der Datenbank statt aus dem Archiv lesen
+ *   -a Archivverzeichnis (ARCHIV_VERZEICHNIS)
+ *   -n Name der Anlage aus S10_WEITERE ("" = S10_ADRESSE)
+ *   -v, -b erster und letzter Tag (alle vorhandenen Tage)
+ *   -f Feld von s10daten für Perzentile und Histogramm (P_pv)
+ *   -w Klassenbreite des Histogramms (100)
+ *   -k nutzbare Kapazität der Batterie in kWh für die Zahl der Vollzyklen (keine Angabe = ohne Vollzyklen)
+ *   -t so viele Tage werden gleichzeitig ausgewertet (4)
+ *   -d zusätzlich die Energien jedes Tages ausgeben
+ */
+
+#include <dirent.h> /* für die Suche nach Archivdateien */
+#include <unistd.h> /* für getopt */
+
+#define main S10auslesen
+#include "../src/S10auslesen.c"
+#undef main
+
+/* Anzahl der Leistungen P_pv bis P_pvwall, die ersten Felder von s10daten */
+#define ENERGIEFELDER       7
+/* das Histogramm reicht von -HISTOGRAMM_MITTE bis HISTOGRAMM_MITTE - 1, Werte außerhalb zählen zum Rand */
+#define HISTOGRAMM_MITTE    (1 << 17)
+
+/**
+ * die Energien eines Tages.
+ */
+typedef struct
+{
+    size_t sekunden; /* Anzahl der vorhandenen Messwerte */
+    int64_t positiv[ENERGIEFELDER]; /* Summe der positiven Werte je Leistung in Ws */
+    int64_t negativ[ENERGIEFELDER]; /* Summe der Beträge der negativen Werte je Leistung in Ws */
+} s10tagesenergie;
+
+/* gemeinsamer Zustand der Threads */
+typedef struct
+{
+    bool datenbank; /* aus der Datenbank statt aus dem Archiv lesen */
+    char const *verzeichnis;
+    char const *anlage;
+    uint_fast8_t feld; /* Spalte für Perzentile und Histogramm */
+    time_t erster; /* 00:00:00 Uhr des ersten Tages */
+    size_t tage;
+    s10tagesenergie *energie; /* je Tag */
+    atomic_size_t naechster; /* jeder Thread holt sich den nächsten noch nicht ausgewerteten Tag */
+    atomic_size_t fehler;
+} s10analyse;
+
+/**
+ * Arbeitsbereich eines Threads.
+ */
+typedef struct
+{
+    s10analyse *analyse;
+    int32_t *spalte[ARCHIV_SPALTEN]; /* je benötigtem Feld ARCHIV_SEKUNDEN Werte, sonst NULL */
+    uint8_t *gueltig; /* je Sekunde 1 wenn ein Messwert vorliegt */
+    uint64_t *histogramm; /* 2 * HISTOGRAMM_MITTE Klassen */
+    pthread_t thread;
+} s10analysethread;
+
+/**
+ * ermittelt den Namen einer Spalte in den Tabellen der Messwerte.
+ * @param ziel Puffer mit mindestens 16 Zeichen, bleibt leer, wenn das Feld nicht in der Datenbank steht.
+ * @param spalte Nummer der Spalte, siehe archivspalten.
+ */
+static void SpaltennameSQL(char *const ziel, uint_fast8_t const spalte)
+{
+    /* emsrc und emsctrl (Spalten 12 und 13) stehen nicht in der Datenbank */
+    *ziel = '\0';
+    if (12 == spalte || 13 == spalte) return;
+    size_t nummer = spalte > 13 ? spalte - 2 : spalte;
+    char const *name = messwertspalten;
+    for (; nummer > 0; nummer--)
+        name = strchr(name + 1, ',');
+    size_t const laenge = strcspn(name + 1, " ");
+    memcpy(ziel, name + 1, laenge < 15 ? laenge : 15);
+    ziel[laenge < 15 ? laenge : 15] = '\0';
+}
+
+/**
+ * lädt die benötigten Spalten eines Tages aus seiner Archivdatei.
+ * @param arbeit Arbeitsbereich des Threads.
+ * @param tag 00:00:00 Uhr des Tages.
+ * @return EXIT_SUCCESS, auch wenn es für den Tag keine Archivdatei gibt.
+ */
+static int_fast8_t TagAusArchivLaden(s10analysethread *const arbeit, time_t const tag)
+{
+    s10analyse const *const analyse = arbeit->analyse;
+    struct tm datum;
+    gmtime_r(&tag, &datum);
+    char pfad[PATH_MAX];
+    snprintf(pfad, sizeof(pfad), "%s/%s%s%04d_%02d_%02d.s10a", analyse->verzeichnis, analyse->anlage, '\0' == *analyse->anlage ? "" : "_",
+             datum.tm_year + 1900, datum.tm_mon + 1, datum.tm_mday);
+    s10archiv archiv;
+    if (!ArchivVerbinden(pfad, &archiv)) return EXIT_SUCCESS;
+
+    bool erste = true;
+    for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+    {
+        int32_t *const werte = arbeit->spalte[spalte];
+        if (NULL == werte) continue;
+        ArchivSpalteLesen(&archiv, spalte, werte);
+        /* alle Spalten eines Blocks haben dieselbe Bitmap, die Gültigkeit ergibt sich daher aus einer beliebigen Spalte */
+        if (erste)
+            for (size_t i = 0; i < ARCHIV_SEKUNDEN; i++)
+                arbeit->gueltig[i] = ARCHIV_FEHLT != werte[i];
+        erste = false;
+        for (size_t i = 0; i < ARCHIV_SEKUNDEN; i++)
+            werte[i] = ARCHIV_FEHLT == werte[i] ? 0 : werte[i];
+    }
+    ArchivTrennen(&archiv);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * lädt die benötigten Spalten eines Tages aus seiner Tagestabelle bzw. mit SQL_ZEITREIHE aus s10messwerte.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param arbeit Arbeitsbereich des Threads.
+ * @param tag 00:00:00 Uhr des Tages.
+ * @return EXIT_SUCCESS wenn der Tag geladen wurde oder es ihn nicht gibt, sonst EXIT_FAILURE.
+ */
+static int_fast8_t TagAusDatenbankLaden(MYSQL *const sqlconnection, s10analysethread *const arbeit, time_t const tag)
+{
+    s10analyse const *const analyse = arbeit->analyse;
+    struct tm datum;
+    gmtime_r(&tag, &datum);
+    char sqlquery[LEN_TABELLE];
+    uint_fast8_t spalten[ARCHIV_SPALTEN];
+    uint_fast8_t anzahl = 0;
+    char *ende = sqlquery + sprintf(sqlquery, "SELECT TIME_TO_SEC(%s)", SQL_ZEITREIHE ? "TIME(zeit)" : "uhrzeit");
+    for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+    {
+        if (NULL == arbeit->spalte[spalte]) continue;
+        char name[16];
+        SpaltennameSQL(name, spalte);
+        if ('\0' == *name) continue;
+        ende += sprintf(ende, ",%s", name);
+        spalten[anzahl++] = spalte;
+    }
+    if (DELTA_MODUS) ende += sprintf(ende, ",dauer");
+    if (SQL_ZEITREIHE)
+    {
+        char name[2 * LEN_TABELLENAME + 1];
+        mysql_real_escape_string(sqlconnection, name, analyse->anlage, strnlen(analyse->anlage, LEN_TABELLENAME - 1));
+        sprintf(ende, " FROM s10messwerte JOIN s10anlagen ON s10anlagen.id=anlage WHERE name='%s' AND zeit>='%04d-%02d-%02d'"
+                " AND zeit<'%04d-%02d-%02d'+INTERVAL 1 DAY", name, datum.tm_year + 1900, datum.tm_mon + 1, datum.tm_mday, datum.tm_year + 1900,
+                datum.tm_mon + 1, datum.tm_mday);
+    }
+    else
+    {
+        strcpy(ende, " FROM ");
+        Tabellenname(ende + 6, analyse->anlage, datum);
+    }
+
+    /* 1146: für den Tag gibt es keine Tabelle */
+    if (0 != mysql_query(sqlconnection, sqlquery)) return 1146 == mysql_errno(sqlconnection) ? EXIT_SUCCESS : EXIT_FAILURE;
+    MYSQL_RES *const ergebnis = mysql_use_result(sqlconnection);
+    if (NULL == ergebnis) return EXIT_FAILURE;
+    for (MYSQL_ROW zeile; NULL != (zeile = mysql_fetch_row(ergebnis));)
+    {
+        size_t const sekunde = strtoul(zeile[0], NULL, 10);
+        size_t const dauer = DELTA_MODUS ? strtoul(zeile[anzahl + 1], NULL, 10) : 1;
+        size_t const bis = sekunde + dauer < ARCHIV_SEKUNDEN ? sekunde + dauer : ARCHIV_SEKUNDEN;
+        for (uint_fast8_t k = 0; k < anzahl; k++)
+        {
+            int32_t const wert = strtol(zeile[k + 1], NULL, 10);
+            for (size_t i = sekunde; i < bis; i++)
+                arbeit->spalte[spalten[k]][i] = wert;
+        }
+        for (size_t i = sekunde; i < bis; i++)
+            arbeit->gueltig[i] = 1;
+    }
+    int_fast8_t const result = 0 == mysql_errno(sqlconnection) ? EXIT_SUCCESS : EXIT_FAILURE;
+    mysql_free_result(ergebnis);
+    return result;
+}
+
+/**
+ * summiert die positiven und die negativen Werte einer Spalte getrennt, fehlende Messwerte sind 0 und zählen daher nicht mit.
+ * @param werte ARCHIV_SEKUNDEN Werte.
+ * @param positiv wird um die Summe der positiven Werte erhöht.
+ * @param negativ wird um die Summe der Beträge der negativen Werte erhöht.
+ */
+static void EnergieSummieren(int32_t const *restrict const werte, int64_t *const positiv, int64_t *const negativ)
+{
+    int64_t plus = 0, minus = 0;
+    for (size_t i = 0; i < ARCHIV_SEKUNDEN; i++)
+    {
+        int64_t const wert = werte[i];
+        plus += wert > 0 ? wert : 0;
+        minus += wert < 0 ? -wert : 0;
+    }
+    *positiv += plus;
+    *negativ += minus;
+}
+
+/**
+ * zählt die vorhandenen Werte einer Spalte in das Histogramm, Werte außerhalb des Histogramms zählen zur ersten bzw. letzten Klasse.
+ * @param werte ARCHIV_SEKUNDEN Werte.
+ * @param gueltig je Sekunde 1 wenn ein Messwert vorliegt, sonst 0.
+ * @param histogramm 2 * HISTOGRAMM_MITTE Klassen.
+ * @return Anzahl der vorhandenen Werte.
+ */
+static size_t HistogrammZaehlen(int32_t const *restrict const werte, uint8_t const *restrict const gueltig, uint64_t *restrict const histogramm)
+{
+    size_t anzahl = 0;
+    for (size_t i = 0; i < ARCHIV_SEKUNDEN; i++)
+    {
+        int32_t const wert = werte[i] < -HISTOGRAMM_MITTE ? -HISTOGRAMM_MITTE : werte[i] >= HISTOGRAMM_MITTE ? HISTOGRAMM_MITTE - 1 : werte[i];
+        histogramm[wert + HISTOGRAMM_MITTE] += gueltig[i];
+        anzahl += gueltig[i];
+    }
+    return anzahl;
+}
+
+/**
+ * wertet Tage aus, bis alle verteilt sind.
+ * @param arg s10analysethread mit dem Arbeitsbereich.
+ * @return NULL.
+ */
+static void *AnalyseThread(void *const arg)
+{
+    s10analysethread *const arbeit = (s10analysethread*) arg;
+    s10analyse *const analyse = arbeit->analyse;
+    MYSQL *sqlconnection = NULL;
+    if (analyse->datenbank)
+    {
+        mysql_thread_init();
+        sqlconnection = SQLVerbinden();
+        if (NULL == sqlconnection) fprintf(stderr, "S10analyse: keine Verbindung zu %s\n", SQL_ADRESSE);
+    }
+
+    for (size_t i; (NULL != sqlconnection || !analyse->datenbank) && (i = atomic_fetch_add(&analyse->naechster, 1)) < analyse->tage;)
+    {
+        for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+            if (NULL != arbeit->spalte[spalte]) memset(arbeit->spalte[spalte], 0, ARCHIV_SEKUNDEN * sizeof(int32_t));
+        memset(arbeit->gueltig, 0, ARCHIV_SEKUNDEN);
+
+        time_t const tag = analyse->erster + (time_t) i * ARCHIV_SEKUNDEN;
+        if (EXIT_SUCCESS != (analyse->datenbank ? TagAusDatenbankLaden(sqlconnection, arbeit, tag) : TagAusArchivLaden(arbeit, tag)))
+        {
+            fprintf(stderr, "S10analyse: Tag %zu nicht geladen: %s\n", i, mysql_error(sqlconnection));
+            atomic_fetch_add(&analyse->fehler, 1);
+            continue;
+        }
+        s10tagesenergie *const energie = analyse->energie + i;
+        for (uint_fast8_t feld = 0; feld < ENERGIEFELDER; feld++)
+            EnergieSummieren(arbeit->spalte[feld], energie->positiv + feld, energie->negativ + feld);
+        energie->sekunden = HistogrammZaehlen(arbeit->spalte[analyse->feld], arbeit->gueltig, arbeit->histogramm);
+    }
+
+    if (analyse->datenbank)
+    {
+        if (NULL != sqlconnection) mysql_close(sqlconnection);
+        mysql_thread_end();
+    }
+    return NULL;
+}
+
+/**
+ * wandelt ein Datum JJJJ-MM-TT in 00:00:00 Uhr des Tages.
+ * @param text das Datum.
+ * @return Sekunden seit 1.1.1970 (UTC) oder -1 bei einem ungültigen Datum.
+ */
+static time_t DatumLesen(char const *const text)
+{
+    struct tm datum = { 0 };
+    if (3 != sscanf(text, "%4d-%2d-%2d", &datum.tm_year, &datum.tm_mon, &datum.tm_mday)) return -1;
+    datum.tm_year -= 1900;
+    datum.tm_mon--;
+    return timegm(&datum);
+}
+
+/**
+ * ermittelt den ersten und den letzten Tag mit Messwerten der Anlage.
+ * @param analyse Quelle und Anlage.
+ * @param erster wird auf 00:00:00 Uhr des ersten Tages gesetzt.
+ * @param letzter wird auf 00:00:00 Uhr des letzten Tages gesetzt.
+ * @return EXIT_SUCCESS wenn Tage gefunden wurden, sonst EXIT_FAILURE.
+ */
+static int_fast8_t ZeitraumSuchen(s10analyse const *const analyse, time_t *const erster, time_t *const letzter)
+{
+    *erster = INT64_MAX;
+    *letzter = -1;
+    size_t const laengeName = strlen(analyse->anlage) + ('\0' == *analyse->anlage ? 0 : 1);
+    if (!analyse->datenbank)
+    {
+        /* Archivdateien [Name_]YYYY_MM_DD.s10a, ohne Namen nur die Dateien ohne Präfix */
+        DIR *const verzeichnis = opendir(analyse->verzeichnis);
+        if (NULL == verzeichnis) return EXIT_FAILURE;
+        for (struct dirent *eintrag; NULL != (eintrag = readdir(verzeichnis));)
+        {
+            size_t const laenge = strlen(eintrag->d_name);
+            if (laenge != laengeName + 15 || 0 != strncmp(eintrag->d_name, analyse->anlage, laengeName - ('\0' == *analyse->anlage ? 0 : 1))
+                || 0 != strcmp(eintrag->d_name + laenge - 5, ".s10a"))
+                continue;
+            char datum[11];
+            memcpy(datum, eintrag->d_name + laengeName, 10);
+            datum[4] = datum[7] = '-';
+            datum[10] = '\0';
+            time_t const tag = DatumLesen(datum);
+            if (tag < 0) continue;
+            if (tag < *erster) *erster = tag;
+            if (tag > *letzter) *letzter = tag;
+        }
+        closedir(verzeichnis);
+        return *letzter >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    MYSQL *const sqlconnection = SQLVerbinden();
+    if (NULL == sqlconnection) return EXIT_FAILURE;
+    char name[2 * LEN_TABELLENAME + 1];
+    mysql_real_escape_string(sqlconnection, name, analyse->anlage, strnlen(analyse->anlage, LEN_TABELLENAME - 1));
+    char sqlquery[LEN_TABELLE];
+    if (SQL_ZEITREIHE)
+        sprintf(sqlquery, "SELECT DATE(MIN(zeit)),DATE(MAX(zeit)) FROM s10messwerte JOIN s10anlagen ON s10anlagen.id=anlage WHERE name='%s'", name);
+    else
+        sprintf(sqlquery, "SELECT REPLACE(RIGHT(MIN(TABLE_NAME),10),'_','-'),REPLACE(RIGHT(MAX(TABLE_NAME),10),'_','-')"
+                " FROM information_schema.TABLES WHERE TABLE_SCHEMA=DATABASE() AND TABLE_NAME REGEXP '^%s%s[0-9]{4}_[0-9]{2}_[0-9]{2}$'", name,
+                '\0' == *name ? "" : "_");
+    if (0 == mysql_query(sqlconnection, sqlquery))
+    {
+        MYSQL_RES *const ergebnis = mysql_store_result(sqlconnection);
+        MYSQL_ROW const zeile = NULL == ergebnis ? NULL : mysql_fetch_row(ergebnis);
+        if (NULL != zeile && NULL != zeile[0] && NULL != zeile[1])
+        {
+            *erster = DatumLesen(zeile[0]);
+            *letzter = DatumLesen(zeile[1]);
+        }
+        if (NULL != ergebnis) mysql_free_result(ergebnis);
+    }
+    else
+        fprintf(stderr, "S10analyse: Zeitraum nicht ermittelt: %s\n", mysql_error(sqlconnection));
+    mysql_close(sqlconnection);
+    return *erster >= 0 && *letzter >= *erster ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * gibt Perzentile und Histogramm des gewählten Felds aus.
+ * @param name Name des Felds.
+ * @param histogramm 2 * HISTOGRAMM_MITTE Klassen.
+ * @param anzahl Summe aller Klassen.
+ * @param breite Klassenbreite der Ausgabe.
+ */
+static void HistogrammAusgeben(char const *const name, uint64_t const *const histogramm, uint64_t const anzahl, uint32_t const breite)
+{
+    if (0 == anzahl) return;
+    double const anteile[] = { 0, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99, 1 };
+    char const *const namen[] = { "Minimum", "P5", "P25", "Median", "P75", "P95", "P99", "Maximum" };
+    int64_t summe = 0;
+    for (size_t i = 0; i < 2 * HISTOGRAMM_MITTE; i++)
+        summe += (int64_t) histogramm[i] * ((int64_t) i - HISTOGRAMM_MITTE);
+    printf("%s: Mittelwert %.1f", name, (double) summe / anzahl);
+    uint64_t kumuliert = 0;
+    size_t klasse = 0;
+    for (size_t p = 0; p < sizeof(anteile) / sizeof(anteile[0]); p++)
+    {
+        /* der kleinste Wert, bis zu dem mindestens der Anteil der Messwerte reicht */
+        uint64_t const rang = 0 == p ? 1 : (uint64_t) (anteile[p] * anzahl + 0.5);
+        while (klasse < 2 * HISTOGRAMM_MITTE - 1 && kumuliert + histogramm[klasse] < (rang > 0 ? rang : 1))
+            kumuliert += histogramm[klasse++];
+        printf(", %s %ld", namen[p], (long) klasse - HISTOGRAMM_MITTE);
+    }
+    printf("\n");
+
+    for (int64_t von = -HISTOGRAMM_MITTE / (int64_t) breite * breite - breite; von < HISTOGRAMM_MITTE; von += breite)
+    {
+        uint64_t zaehler = 0;
+        for (int64_t wert = von; wert < von + breite; wert++)
+            if (wert >= -HISTOGRAMM_MITTE && wert < HISTOGRAMM_MITTE) zaehler += histogramm[wert + HISTOGRAMM_MITTE];
+        if (0 != zaehler) printf("%10" PRId64 " bis %10" PRId64 ": %10" PRIu64 " (%.2f %%)\n", von, von + breite - 1, zaehler, 100.0 * zaehler / anzahl);
+    }
+}
+
+/**
+ * 1) ermittelt den Zeitraum und das Feld und legt den Arbeitsbereich jedes Threads an.
+ * 2) wertet die Tage mit -t Threads aus und führt die Histogramme zusammen.
+ * 3) gibt die Ergebnisse, die Dauer und den Durchsatz aus.
+ * @return EXIT_SUCCESS wenn alle Tage ausgewertet wurden, sonst EXIT_FAILURE.
+ */
+int main(int argc, char *argv[])
+{
+    s10analyse analyse = { .verzeichnis = ARCHIV_VERZEICHNIS, .anlage = "" };
+    char const *feldname = "P_pv";
+    time_t von = -1, bis = -1;
+    uint32_t breite = 100;
+    double kapazitaet = 0;
+    size_t threads = 4;
+    bool tageweise = false;
+    for (int option; -1 != (option = getopt(argc, argv, "sa:n:v:b:f:w:k:t:d"));)
+    {
+        switch (option)
+        {
+            case 's': analyse.datenbank = true; break;
+            case 'a': analyse.verzeichnis = optarg; break;
+            case 'n': analyse.anlage = optarg; break;
+            case 'v': von = DatumLesen(optarg); break;
+            case 'b': bis = DatumLesen(optarg); break;
+            case 'f': feldname = optarg; break;
+            case 'w': breite = strtoul(optarg, NULL, 10); break;
+            case 'k': kapazitaet = strtod(optarg, NULL); break;
+            case 't': threads = strtoul(optarg, NULL, 10); break;
+            case 'd': tageweise = true; break;
+            default:
+                fprintf(stderr, "Aufruf: %s [-s] [-a Verzeichnis] [-n Anlage] [-v JJJJ-MM-TT] [-b JJJJ-MM-TT] [-f Feld] [-w Klassenbreite] [-k kWh]"
+                        " [-t Threads] [-d]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (0 == threads || threads > 64) threads = 4;
+    if (0 == breite) breite = 100;
+
+    /* 1) die Felder der Registerkarte stehen in derselben Reihenfolge wie die Spalten des Archivs */
+    analyse.feld = ARCHIV_SPALTEN;
+    for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+        if (0 == strcmp(registerkarte[spalte].name, feldname)) analyse.feld = spalte;
+    char sqlname[16];
+    if (ARCHIV_SPALTEN != analyse.feld) SpaltennameSQL(sqlname, analyse.feld);
+    if (ARCHIV_SPALTEN == analyse.feld || (analyse.datenbank && '\0' == *sqlname))
+    {
+        fprintf(stderr, "S10analyse: unbekanntes Feld %s\n", feldname);
+        return EXIT_FAILURE;
+    }
+    time_t erster, letzter;
+    if (EXIT_SUCCESS != ZeitraumSuchen(&analyse, &erster, &letzter))
+    {
+        fprintf(stderr, "S10analyse: keine Messwerte für die Anlage \"%s\" gefunden\n", analyse.anlage);
+        return EXIT_FAILURE;
+    }
+    if (von >= 0 && von > erster) erster = von;
+    if (bis >= 0 && bis < letzter) letzter = bis;
+    if (letzter < erster)
+    {
+        fprintf(stderr, "S10analyse: keine Messwerte im gewählten Zeitraum\n");
+        return EXIT_FAILURE;
+    }
+    analyse.erster = erster;
+    analyse.tage = (letzter - erster) / ARCHIV_SEKUNDEN + 1;
+    atomic_init(&analyse.naechster, 0);
+    atomic_init(&analyse.fehler, 0);
+
+    int_fast8_t result = EXIT_FAILURE;
+    analyse.energie = (s10tagesenergie*) calloc(analyse.tage, sizeof(s10tagesenergie));
+    s10analysethread *const arbeit = (s10analysethread*) calloc(threads, sizeof(s10analysethread));
+    uint64_t *const histogramm = (uint64_t*) calloc(2 * HISTOGRAMM_MITTE, sizeof(uint64_t));
+    bool angelegt = NULL != analyse.energie && NULL != arbeit && NULL != histogramm;
+    for (size_t t = 0; angelegt && t < threads; t++)
+    {
+        arbeit[t].analyse = &analyse;
+        for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN && angelegt; spalte++)
+            if (spalte < ENERGIEFELDER || spalte == analyse.feld)
+                angelegt = NULL != (arbeit[t].spalte[spalte] = (int32_t*) malloc(ARCHIV_SEKUNDEN * sizeof(int32_t)));
+        arbeit[t].gueltig = (uint8_t*) malloc(ARCHIV_SEKUNDEN);
+        arbeit[t].histogramm = (uint64_t*) calloc(2 * HISTOGRAMM_MITTE, sizeof(uint64_t));
+        angelegt = angelegt && NULL != arbeit[t].gueltig && NULL != arbeit[t].histogramm;
+    }
+
+    /* 2) */
+    if (angelegt)
+    {
+        struct timespec beginn, ende;
+        clock_gettime(CLOCK_MONOTONIC, &beginn);
+        size_t gestartet = 0;
+        for (; gestartet < threads; gestartet++)
+            if (0 != pthread_create(&arbeit[gestartet].thread, NULL, AnalyseThread, arbeit + gestartet)) break;
+        /* ohne einen einzigen Thread wertet der Haupt-Thread selbst aus */
+        if (0 == gestartet) AnalyseThread(arbeit);
+        for (size_t t = 0; t < gestartet; t++)
+            pthread_join(arbeit[t].thread, NULL);
+        for (size_t t = 0; t < threads; t++)
+            for (size_t i = 0; i < 2 * HISTOGRAMM_MITTE; i++)
+                histogramm[i] += arbeit[t].histogramm[i];
+        clock_gettime(CLOCK_MONOTONIC, &ende);
+
+        /* 3) */
+        s10tagesenergie gesamt = { 0 };
+        for (size_t i = 0; i < analyse.tage; i++)
+        {
+            s10tagesenergie const *const tag = analyse.energie + i;
+            gesamt.sekunden += tag->sekunden;
+            for (uint_fast8_t feld = 0; feld < ENERGIEFELDER; feld++)
+            {
+                gesamt.positiv[feld] += tag->positiv[feld];
+                gesamt.negativ[feld] += tag->negativ[feld];
+            }
+            if (!tageweise || 0 == tag->sekunden) continue;
+            time_t const zeit = analyse.erster + (time_t) i * ARCHIV_SEKUNDEN;
+            struct tm datum;
+            gmtime_r(&zeit, &datum);
+            printf("%04d-%02d-%02d %5zu Messwerte, PV %.2f kWh, Haus %.2f kWh, Bezug %.2f kWh, Einspeisung %.2f kWh, Batterie +%.2f/-%.2f kWh\n",
+                   datum.tm_year + 1900, datum.tm_mon + 1, datum.tm_mday, tag->sekunden, tag->positiv[0] / 3.6e6, tag->positiv[2] / 3.6e6,
+                   tag->positiv[3] / 3.6e6, tag->negativ[3] / 3.6e6, tag->positiv[1] / 3.6e6, tag->negativ[1] / 3.6e6);
+        }
+
+        double const dauer = (ende.tv_sec - beginn.tv_sec) + (ende.tv_nsec - beginn.tv_nsec) / 1e9;
+        printf("S10analyse: %zu Tage, %zu Messwerte in %.2f s, %.1f Mio. Messwerte/s\n", analyse.tage, gesamt.sekunden, dauer,
+               dauer > 0 ? gesamt.sekunden / dauer / 1e6 : 0.0);
+        printf("%-10s %12s %12s\n", "Leistung", "positiv kWh", "negativ kWh");
+        for (uint_fast8_t feld = 0; feld < ENERGIEFELDER; feld++)
+            printf("%-10s %12.2f %12.2f\n", registerkarte[feld].name, gesamt.positiv[feld] / 3.6e6, gesamt.negativ[feld] / 3.6e6);
+
+        /* positives P_netz ist Bezug, negatives Einspeisung; positives P_bat ist Laden, negatives Entladen */
+        double const pv = gesamt.positiv[0], verbrauch = gesamt.positiv[2] + gesamt.positiv[5];
+        if (pv > 0) printf("Eigenverbrauchsquote %.1f %%\n", 100.0 * (pv - gesamt.negativ[3]) / pv);
+        if (verbrauch > 0) printf("Autarkie %.1f %%\n", 100.0 * (verbrauch - gesamt.positiv[3]) / verbrauch);
+        if (kapazitaet > 0) printf("Batterie: %.1f Vollzyklen\n", (gesamt.positiv[1] + gesamt.negativ[1]) / 2 / 3.6e6 / kapazitaet);
+        HistogrammAusgeben(feldname, histogramm, gesamt.sekunden, breite);
+        result = 0 == atomic_load(&analyse.fehler) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else
+        fprintf(stderr, "S10analyse: nicht genügend Speicher\n");
+
+    for (size_t t = 0; NULL != arbeit && t < threads; t++)
+    {
+        for (uint_fast8_t spalte = 0; spalte < ARCHIV_SPALTEN; spalte++)
+            free(arbeit[t].spalte[spalte]);
+        free(arbeit[t].gueltig);
+        free(arbeit[t].histogramm);
+    }
+    free(histogramm);
+    free(arbeit);
+    free(analyse.energie);
+    return result;
+}
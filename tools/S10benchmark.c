@@ -0,0 +1,234 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * S10benchmark vermisst S10auslesen gegen den S10simulator und eine lokale MariaDB, damit Verschlechterungen messbar werden:
+ * 1) Zeitverhalten der sekündlichen Abfrage (Verzug zur Sekundengrenze, Modbus-Latenz) mit LeistungsdatenAuslesenModbus()
+ * 2) Lücken durch Verbindungsabbrüche und die Dauer bis zum ersten Messwert nach dem Neuverbinden (S10simulator mit -u starten)
+ * 3) Kosten der JSON-Ausgabe je Messwert mit ErzeugeJSON()
+ * 4) Durchsatz beim Eintragen einer vollen Stunde in die Datenbank mit MesswerteUebertragenSQL()
+ * S10auslesen.c wird dafür direkt eingebunden, so werden genau die Funktionen des Programms gemessen, auch die statischen.
+ *
+ * Aufruf: S10benchmark [-n Sekunden] [-j Wiederholungen] [-s]
+ *   -n so viele Sekunden wird abgefragt (60)
+ *   -j so oft wird die JSON-Datei geschrieben (10000)
+ *   -s ohne SQL-Messung
+ * Adresse und Port des S10simulator werden beim Kompilieren mit SIMULATOR_ADRESSE und SIMULATOR_PORT festgelegt.
+ */
+
+#include "../src/Einstellungen.h" /* für die Benutzerdaten, die Anlage wird hier auf den Simulator umgelenkt */
+
+#include <unistd.h> /* für getopt */
+
+#ifndef SIMULATOR_ADRESSE
+#define SIMULATOR_ADRESSE   "127.0.0.1"
+#endif
+#ifndef SIMULATOR_PORT
+#define SIMULATOR_PORT      1502
+#endif
+
+#undef S10_ADRESSE
+#define S10_ADRESSE SIMULATOR_ADRESSE
+#undef S10_PORT
+#define S10_PORT SIMULATOR_PORT
+#undef S10_WEITERE
+#define S10_WEITERE
+
+#define main S10auslesen
+#include "../src/S10auslesen.c"
+#undef main
+
+/**
+ * liefert die monotone Uhrzeit in Sekunden.
+ * @return Sekunden seit einem beliebigen, festen Zeitpunkt.
+ */
+static double Uhr(void)
+{
+    struct timespec jetzt;
+    clock_gettime(CLOCK_MONOTONIC, &jetzt);
+    return jetzt.tv_sec + jetzt.tv_nsec / 1e9;
+}
+
+/**
+ * fragt den Simulator sekündlich ab und gibt Zeitverhalten und Lücken aus.
+ * @param modbus offene Modbus-Verbindung.
+ * @param id Identifikationsdaten des Simulators.
+ * @param sekunden so viele Sekunden wird abgefragt.
+ * @return die Messwerte der Abfrage oder NULL falls kein Speicher verfügbar ist.
+ */
+static s10stunde *AbfrageMessen(modbus_t **const modbus, s10konstanten *const id, size_t const sekunden)
+{
+    /* die Stunde wird so gelegt, dass von ihr nur noch die gewünschten Sekunden übrig sind */
+    time_t const start = time(NULL) + 1 + sekunden - NO_DATEN;
+    s10stunde *const stunde = StundeAnlegen(0, start, id);
+    if (NULL == stunde) return NULL;
+    LeistungsdatenAuslesenModbus(modbus, id, stunde);
+
+    s10zeitstatistik const *const statistik = &stunde->statistik;
+    double const n = statistik->messungen > 0 ? statistik->messungen : 1;
+    double const verzug = statistik->verzugSumme / n;
+    double const varianz = statistik->verzugQuadratsumme / n - verzug * verzug;
+    printf("Abfrage:     %zu Messwerte, %zu ausgelassen, %zu Lesefehler, %zu ohne Verbindung, Verzug %.0f µs ± %.0f µs (max %" PRId64 " µs), Latenz %.2f ms (max %.2f ms)\n",
+           statistik->messungen, statistik->ausgelassen, statistik->lesefehler, statistik->getrennt, verzug, varianz > 0 ? sqrt(varianz) : 0, statistik->verzugMax,
+           statistik->latenzSumme / n / 1000, statistik->latenzMax / 1000.0);
+
+    size_t luecken = 0, fehlend = 0, laengste = 0;
+    for (size_t i = NO_DATEN - sekunden, laenge = 0; i < NO_DATEN; i++)
+    {
+        if (Gueltig(stunde->gueltig, i))
+        {
+            laenge = 0;
+            continue;
+        }
+        fehlend++;
+        if (0 == laenge++) luecken++;
+        if (laenge > laengste) laengste = laenge;
+    }
+    printf("Ausfälle:    %zu fehlende Messwerte in %zu Lücken, bis zum Wiederanlauf höchstens %zu s\n", fehlend, luecken, laengste);
+    return stunde;
+}
+
+/**
+ * misst die Kosten der JSON-Ausgabe.
+ * @param daten der Messwert, der ausgegeben wird.
+ * @param wiederholungen so oft wird die Datei geschrieben.
+ */
+static void JSONMessen(s10daten const *const daten, size_t const wiederholungen)
+{
+    char json[LEN_JSON];
+    double beginn = Uhr();
+    for (size_t i = 0; i < wiederholungen; i++)
+        JSONFormatieren(json, daten, -1);
+    double const formatieren = (Uhr() - beginn) / wiederholungen;
+
+    beginn = Uhr();
+    for (size_t i = 0; i < wiederholungen; i++)
+        ErzeugeJSON(daten, NULL, (int64_t) time(NULL) * 1000);
+    double const schreiben = (Uhr() - beginn) / wiederholungen;
+    printf("JSON:        %.2f µs formatieren, %.2f µs je Datei %s\n", formatieren * 1e6, schreiben * 1e6, JSON_FILE);
+}
+
+/**
+ * misst den Durchsatz beim Eintragen einer vollen Stunde in die Tabelle benchmark_2000_01_01, die danach wieder gelöscht wird.
+ * Mit SQL_ZEITREIHE wird die Stunde unter der Anlage "benchmark" für den heutigen Tag in s10messwerte eingetragen und danach entfernt,
+ * ein Datum im Jahr 2000 würde sonst Partitionen für alle Monate bis heute anlegen.
+ * @param id Identifikationsdaten für den Tabellenkommentar.
+ * @param stunde die abgefragten Messwerte, die reihum für die ganze Stunde verwendet werden.
+ * @param sekunden so viele Sekunden wurden abgefragt.
+ */
+static void SQLMessen(s10konstanten const *const id, s10stunde const *const stunde, size_t const sekunden)
+{
+    MYSQL *const sqlconnection = SQLVerbinden();
+    if (NULL == sqlconnection)
+    {
+        printf("SQL:         keine Verbindung zu %s\n", SQL_ADRESSE);
+        return;
+    }
+    s10daten *const daten = (s10daten*) malloc(NO_DATEN * sizeof(s10daten));
+    if (NULL != daten)
+    {
+        /* alle Sekunden gelten als gültig, damit immer eine volle Stunde eingetragen wird */
+        s10gueltig gueltig[GUELTIG_WORTE(NO_DATEN)];
+        for (size_t i = 0; i < GUELTIG_WORTE(NO_DATEN); i++)
+            atomic_init(gueltig + i, UINT64_MAX);
+        for (size_t i = 0; i < NO_DATEN; i++)
+            memcpy(daten + i, stunde->daten + NO_DATEN - sekunden + i % sekunden, sizeof(s10daten));
+        struct tm datum = { .tm_year = 100, .tm_mday = 1 };
+        if (SQL_ZEITREIHE)
+        {
+            datum = Jetzt();
+            datum.tm_hour = datum.tm_min = datum.tm_sec = 0;
+        }
+        uint16_t anlagenid = 0;
+        if (0 == IdentifikationsblockEintragenSQL(sqlconnection, "benchmark", id, datum, &anlagenid))
+        {
+            double const beginn = Uhr();
+            int_fast8_t const result = MesswerteUebertragenSQL(sqlconnection, "benchmark", anlagenid, daten, gueltig, datum, 0, NO_DATEN);
+            double const dauer = Uhr() - beginn;
+            if (EXIT_SUCCESS == result)
+                printf("SQL:         %d Zeilen in %.3f s, %.0f Zeilen/s\n", NO_DATEN, dauer, NO_DATEN / dauer);
+            else
+                printf("SQL:         Eintragen fehlgeschlagen\n");
+        }
+        else
+            printf("SQL:         Tabelle kann nicht angelegt werden: %s\n", mysql_error(sqlconnection));
+        if (SQL_ZEITREIHE)
+        {
+            char sqlquery[64];
+            char const *const tabellen[3] = { "s10messwerte WHERE anlage", "s10geraete WHERE anlage", "s10anlagen WHERE id" };
+            for (uint_fast8_t i = 0; i < 3; i++)
+            {
+                snprintf(sqlquery, sizeof(sqlquery), "DELETE FROM %s=%u", tabellen[i], anlagenid);
+                mysql_query(sqlconnection, sqlquery);
+            }
+        }
+        else
+            mysql_query(sqlconnection, "DROP TABLE IF EXISTS benchmark_2000_01_01, benchmark_2000_01_01_agg, benchmark_2000_01_01_luecken");
+        free(daten);
+    }
+    mysql_close(sqlconnection);
+}
+
+/**
+ * 1) verbindet sich mit dem S10simulator und liest dessen Identifikationsdaten.
+ * 2) fragt ihn sekündlich ab und gibt Zeitverhalten und Lücken aus.
+ * 3) misst die JSON-Ausgabe und das Eintragen in die Datenbank.
+ * @return EXIT_FAILURE wenn der Simulator nicht erreichbar ist.
+ */
+int main(int argc, char *argv[])
+{
+    size_t sekunden = 60, wiederholungen = 10000;
+    bool sql = SQL_AKTIV;
+    for (int option; -1 != (option = getopt(argc, argv, "n:j:s"));)
+    {
+        switch (option)
+        {
+            case 'n': sekunden = strtoul(optarg, NULL, 10); break;
+            case 'j': wiederholungen = strtoul(optarg, NULL, 10); break;
+            case 's': sql = false; break;
+            default:
+                fprintf(stderr, "Aufruf: %s [-n Sekunden] [-j Wiederholungen] [-s]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (0 == sekunden || sekunden >= NO_DATEN) sekunden = 60;
+    if (0 == wiederholungen) wiederholungen = 1;
+
+    if (EXIT_SUCCESS != RegisterPlanen()) return EXIT_FAILURE;
+    modbus_t *modbus = ModbusVerbinden(anlagen);
+    s10konstanten id;
+    if (NULL == modbus || EXIT_SUCCESS != IdentifikationsblockAuslesenModbus(modbus, &id))
+    {
+        fprintf(stderr, "S10benchmark: S10simulator auf %s:%d ist nicht erreichbar\n", SIMULATOR_ADRESSE, SIMULATOR_PORT);
+        ModbusTrennen(&modbus);
+        RegisterFreigeben();
+        return EXIT_FAILURE;
+    }
+    printf("S10benchmark: %s %s, %zu s Abfrage\n", id.modell, id.firmware, sekunden);
+
+    s10stunde *const stunde = AbfrageMessen(&modbus, &id, sekunden);
+    ModbusTrennen(&modbus);
+    RegisterFreigeben();
+    if (NULL == stunde) return EXIT_FAILURE;
+    JSONMessen(stunde->daten + NO_DATEN - 1, wiederholungen);
+    if (sql) SQLMessen(&id, stunde, sekunden);
+
+    StundeFreigeben(stunde);
+    return EXIT_SUCCESS;
+}
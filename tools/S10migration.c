@@ -0,0 +1,335 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * S10migration überträgt die Tagestabellen [Name_]YYYY_MM_DD (und ggfs. [Name_]YYYY_MM_DD_agg und _luecken) in die Tabellen der Zeitreihe
+ * (SQL_ZEITREIHE): s10messwerte, s10kennzahlen, s10anlagen und s10geraete.
+ * 1) sucht alle Tagestabellen der Datenbank und liest die Identifikationsdaten aus deren Tabellenkommentar.
+ * 2) legt die Tabellen der Zeitreihe und die Monatspartitionen vom ersten bis zum letzten Tag an.
+ * 3) überträgt die Tagestabellen mit mehreren Threads parallel, jeder Thread mit seiner eigenen Verbindung. Jede Tabelle wird mit
+ *    einem einzigen INSERT IGNORE ... SELECT innerhalb der Datenbank kopiert, bereits vorhandene Zeilen bleiben unverändert.
+ *    Ein abgebrochener Lauf kann daher einfach wiederholt werden.
+ * Die Tagestabellen werden nicht gelöscht. S10auslesen.c wird wie beim S10benchmark direkt eingebunden.
+ *
+ * Aufruf: S10migration [-t Threads]
+ *   -t so viele Tabellen werden gleichzeitig übertragen (4)
+ */
+
+#include <unistd.h> /* für getopt */
+
+#define main S10auslesen
+#include "../src/S10auslesen.c"
+#undef main
+
+/* eine zu übertragende Tagestabelle */
+typedef struct
+{
+    char tabelle[LEN_TABELLENAME];
+    char anlage[LEN_TABELLENAME]; /* Name der Anlage, "" für das erste Hauskraftwerk ohne Namen */
+    struct tm datum;
+    s10konstanten id; /* aus dem Tabellenkommentar */
+} s10tagestabelle;
+
+/* gemeinsamer Zustand der Threads */
+typedef struct
+{
+    s10tagestabelle const *tabellen;
+    size_t anzahl;
+    atomic_size_t naechste; /* jeder Thread holt sich die nächste noch nicht übertragene Tabelle */
+    atomic_size_t fertig;
+    atomic_uint_fast64_t zeilen;
+    atomic_size_t fehler;
+    char messwertnamen[LEN_TABELLE]; /* ",Ppv,Pbat,..." */
+    char kennzahlnamen[LEN_TABELLE]; /* ",dauer,anzahl,Ppvmin,..." */
+} s10migration;
+
+/**
+ * bildet aus Spaltendefinitionen der Form ",name TYP ...,name TYP ..." die Liste ",name,name".
+ * @param ziel Puffer, mindestens so lang wie die Definitionen.
+ * @param definitionen die Spaltendefinitionen.
+ */
+static void SpaltennamenBilden(char *ziel, char const *definitionen)
+{
+    for (; '\0' != *definitionen; definitionen++)
+    {
+        if (',' != *definitionen) continue;
+        *ziel++ = ',';
+        for (definitionen++; '\0' != *definitionen && ' ' != *definitionen; definitionen++)
+            *ziel++ = *definitionen;
+    }
+    *ziel = '\0';
+}
+
+/**
+ * kopiert den Text zwischen zwei Beschriftungen des Tabellenkommentars.
+ * @param ziel Puffer mit 32 Zeichen, bleibt leer, wenn die Beschriftung fehlt.
+ * @param kommentar der Tabellenkommentar.
+ * @param beschriftung der Text vor dem Wert.
+ * @param folgende die Beschriftung nach dem Wert, NULL = bis zum Ende.
+ */
+static void KommentarwertLesen(char *const ziel, char const *const kommentar, char const *const beschriftung, char const *const folgende)
+{
+    memset(ziel, 0, 32);
+    char const *const von = strstr(kommentar, beschriftung);
+    if (NULL == von) return;
+    char const *const wert = von + strlen(beschriftung);
+    char const *const bis = NULL == folgende ? NULL : strstr(wert, folgende);
+    size_t const laenge = NULL == bis ? strlen(wert) : (size_t) (bis - wert);
+    memcpy(ziel, wert, laenge < 31 ? laenge : 31);
+}
+
+/**
+ * liest die Identifikationsdaten aus dem Kommentar einer Tagestabelle, wie ihn IdentifikationsblockEintragenSQL() schreibt.
+ * @param kommentar der Tabellenkommentar.
+ * @param id s10konstanten_t, in welches die Identifikationsdaten eingetragen werden, fehlende Angaben bleiben 0 bzw. leer.
+ */
+static void KommentarLesen(char const *const kommentar, s10konstanten *const id)
+{
+    /* gleicher Aufbau wie s10konstanten_t, das wie beim Auslesen über Modbus als Ganzes kopiert wird */
+    struct
+    {
+        uint16_t magic;
+        uint8_t mb_minor;
+        uint8_t mb_major;
+        uint16_t reg;
+        char texte[4][32];
+    } werte = { 0 };
+    _Static_assert(sizeof(werte) == sizeof(s10konstanten), "Aufbau von s10konstanten_t geändert");
+    sscanf(kommentar, "%hx Modbus: %hhu.%hhu Register: %hu", &werte.magic, &werte.mb_major, &werte.mb_minor, &werte.reg);
+    KommentarwertLesen(werte.texte[0], kommentar, " Hersteller: ", " Modell: ");
+    KommentarwertLesen(werte.texte[1], kommentar, " Modell: ", " No: ");
+    KommentarwertLesen(werte.texte[2], kommentar, " No: ", " Firmware: ");
+    KommentarwertLesen(werte.texte[3], kommentar, " Firmware: ", NULL);
+    memcpy(id, &werte, sizeof(werte));
+}
+
+/**
+ * sucht alle Tagestabellen der Datenbank, zeitlich aufsteigend je Anlage geordnet.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param tabellen wird auf das Array der Tagestabellen gesetzt, welches mit free() freigegeben werden muss.
+ * @return Anzahl der Tagestabellen, 0 auch im Fehlerfall.
+ */
+static size_t TagestabellenSuchen(MYSQL *const sqlconnection, s10tagestabelle **const tabellen)
+{
+    *tabellen = NULL;
+    if (0 != mysql_query(sqlconnection, "SELECT TABLE_NAME,TABLE_COMMENT FROM information_schema.TABLES WHERE TABLE_SCHEMA=DATABASE()"
+                         " AND TABLE_NAME REGEXP '^([A-Za-z0-9_]+_)?[0-9]{4}_[0-9]{2}_[0-9]{2}$' ORDER BY TABLE_NAME"))
+    {
+        fprintf(stderr, "S10migration: Tagestabellen nicht gefunden: %s\n", mysql_error(sqlconnection));
+        return 0;
+    }
+    MYSQL_RES *const ergebnis = mysql_store_result(sqlconnection);
+    if (NULL == ergebnis) return 0;
+    size_t anzahl = 0;
+    *tabellen = (s10tagestabelle*) calloc(mysql_num_rows(ergebnis) + 1, sizeof(s10tagestabelle));
+    if (NULL != *tabellen)
+    {
+        for (MYSQL_ROW zeile; NULL != (zeile = mysql_fetch_row(ergebnis));)
+        {
+            s10tagestabelle *const tabelle = *tabellen + anzahl;
+            memset(tabelle, 0, sizeof(s10tagestabelle));
+            size_t const laenge = strlen(zeile[0]);
+            if (laenge < 10 || laenge >= LEN_TABELLENAME) continue;
+            strcpy(tabelle->tabelle, zeile[0]);
+            /* die letzten 10 Zeichen sind das Datum, davor steht ggfs. der Name der Anlage mit einem Unterstrich */
+            memcpy(tabelle->anlage, zeile[0], laenge > 10 ? laenge - 11 : 0);
+            if (3 != sscanf(zeile[0] + laenge - 10, "%4d_%2d_%2d", &tabelle->datum.tm_year, &tabelle->datum.tm_mon, &tabelle->datum.tm_mday))
+                continue;
+            tabelle->datum.tm_year -= 1900;
+            tabelle->datum.tm_mon--;
+            KommentarLesen(NULL == zeile[1] ? "" : zeile[1], &tabelle->id);
+            anzahl++;
+        }
+    }
+    mysql_free_result(ergebnis);
+    return anzahl;
+}
+
+/**
+ * überträgt eine Tagestabelle und ggfs. ihre Kennzahlen in die Tabellen der Zeitreihe.
+ * @param sqlconnection offene SQL-Verbindung.
+ * @param migration gemeinsamer Zustand mit den Spaltennamen.
+ * @param tabelle die Tagestabelle.
+ * @return Anzahl der übertragenen Messwerte oder -1 im Fehlerfall.
+ */
+static int64_t TabelleUebertragen(MYSQL *const sqlconnection, s10migration *const migration, s10tagestabelle const *const tabelle)
+{
+    /* legt auch den Eintrag in s10geraete an, die Partitionen sind bereits vorhanden */
+    uint16_t anlagenid;
+    if (EXIT_SUCCESS != ZeitreiheAnlegenSQL(sqlconnection, tabelle->anlage, &tabelle->id, tabelle->datum, &anlagenid)) return -1;
+
+    int64_t result = -1;
+    char *const sqlquery = (char*) malloc(3 * LEN_TABELLE * sizeof(char));
+    if (NULL != sqlquery)
+    {
+        char datum[11];
+        strftime(datum, sizeof(datum), "%Y-%m-%d", &tabelle->datum);
+        sprintf(sqlquery, "INSERT IGNORE INTO s10messwerte (anlage,zeit%s) SELECT %u,TIMESTAMP('%s',uhrzeit)%s FROM %s", migration->messwertnamen,
+                anlagenid, datum, migration->messwertnamen, tabelle->tabelle);
+        if (0 == mysql_query(sqlconnection, sqlquery))
+        {
+            result = mysql_affected_rows(sqlconnection);
+            if (AGGREGATE)
+            {
+                sprintf(sqlquery, "INSERT IGNORE INTO s10kennzahlen (anlage,beginn%s) SELECT %u,TIMESTAMP('%s',uhrzeit)%s FROM %s_agg",
+                        migration->kennzahlnamen, anlagenid, datum, migration->kennzahlnamen, tabelle->tabelle);
+                /* 1146: die Kennzahlen gibt es erst seit AGGREGATE, ältere Tage haben keine Tabelle dafür */
+                if (0 != mysql_query(sqlconnection, sqlquery) && 1146 != mysql_errno(sqlconnection)) result = -1;
+            }
+            if (LUECKEN && result >= 0)
+            {
+                sprintf(sqlquery, "INSERT IGNORE INTO s10luecken (anlage,beginn,dauer,grund) SELECT %u,TIMESTAMP('%s',uhrzeit),dauer,grund FROM %s_luecken",
+                        anlagenid, datum, tabelle->tabelle);
+                /* 1146: die Lücken gibt es erst seit LUECKEN */
+                if (0 != mysql_query(sqlconnection, sqlquery) && 1146 != mysql_errno(sqlconnection)) result = -1;
+            }
+        }
+        if (result < 0) fprintf(stderr, "S10migration: %s nicht übertragen: %s\n", tabelle->tabelle, mysql_error(sqlconnection));
+        free(sqlquery);
+    }
+    return result;
+}
+
+/**
+ * überträgt Tagestabellen, bis alle verteilt sind.
+ * @param arg s10migration mit den Tagestabellen.
+ * @return NULL.
+ */
+static void *MigrationsThread(void *const arg)
+{
+    s10migration *const migration = (s10migration*) arg;
+    mysql_thread_init();
+    MYSQL *const sqlconnection = SQLVerbinden();
+    if (NULL == sqlconnection)
+        fprintf(stderr, "S10migration: keine Verbindung zu %s\n", SQL_ADRESSE);
+    else
+    {
+        for (size_t i; (i = atomic_fetch_add(&migration->naechste, 1)) < migration->anzahl;)
+        {
+            int64_t const zeilen = TabelleUebertragen(sqlconnection, migration, migration->tabellen + i);
+            if (zeilen < 0)
+                atomic_fetch_add(&migration->fehler, 1);
+            else
+                atomic_fetch_add(&migration->zeilen, zeilen);
+            size_t const fertig = atomic_fetch_add(&migration->fertig, 1) + 1;
+            printf("S10migration: %zu/%zu %s %" PRId64 " Zeilen\n", fertig, migration->anzahl, migration->tabellen[i].tabelle, zeilen);
+        }
+        mysql_close(sqlconnection);
+    }
+    mysql_thread_end();
+    return NULL;
+}
+
+/**
+ * 1) sucht die Tagestabellen und legt die Tabellen und Partitionen der Zeitreihe an.
+ * 2) überträgt die Tagestabellen mit -t Threads und gibt die Dauer und den Durchsatz aus.
+ * @return EXIT_SUCCESS wenn alle Tagestabellen übertragen wurden, sonst EXIT_FAILURE.
+ */
+int main(int argc, char *argv[])
+{
+    size_t threads = 4;
+    for (int option; -1 != (option = getopt(argc, argv, "t:"));)
+    {
+        switch (option)
+        {
+            case 't': threads = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Aufruf: %s [-t Threads]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (0 == threads || threads > 64) threads = 4;
+
+    /* 1) */
+    MYSQL *const sqlconnection = SQLVerbinden();
+    if (NULL == sqlconnection)
+    {
+        fprintf(stderr, "S10migration: keine Verbindung zu %s\n", SQL_ADRESSE);
+        return EXIT_FAILURE;
+    }
+    s10tagestabelle *tabellen;
+    size_t const anzahl = TagestabellenSuchen(sqlconnection, &tabellen);
+    int_fast8_t result = EXIT_FAILURE;
+    if (0 == anzahl)
+        printf("S10migration: keine Tagestabellen gefunden\n");
+    else
+    {
+        /* die Monatspartitionen sind lückenlos, der erste und der letzte Monat genügen daher */
+        int erster = INT32_MAX, letzter = 0;
+        size_t letzte = 0;
+        for (size_t i = 0; i < anzahl; i++)
+        {
+            int const monat = (tabellen[i].datum.tm_year + 1900) * 12 + tabellen[i].datum.tm_mon;
+            if (monat < erster) erster = monat;
+            if (monat > letzter)
+            {
+                letzter = monat;
+                letzte = i;
+            }
+        }
+        if (EXIT_SUCCESS == ZeitreiheAnlegenSQL(sqlconnection, tabellen[letzte].anlage, &tabellen[letzte].id, tabellen[letzte].datum, NULL)
+            && EXIT_SUCCESS == PartitionAnlegenSQL(sqlconnection, erster))
+            result = EXIT_SUCCESS;
+    }
+    mysql_close(sqlconnection);
+
+    /* 2) */
+    if (EXIT_SUCCESS == result)
+    {
+        s10migration migration = { .tabellen = tabellen, .anzahl = anzahl };
+        atomic_init(&migration.naechste, 0);
+        atomic_init(&migration.fertig, 0);
+        atomic_init(&migration.zeilen, 0);
+        atomic_init(&migration.fehler, 0);
+        SpaltennamenBilden(migration.messwertnamen, messwertspalten);
+        char *const kennzahlspalten = (char*) calloc(LEN_TABELLE, sizeof(char));
+        pthread_t *const thread = (pthread_t*) malloc(threads * sizeof(pthread_t));
+        if (NULL != kennzahlspalten && NULL != thread)
+        {
+            KennzahlspaltenAnhaengen(kennzahlspalten);
+            SpaltennamenBilden(migration.kennzahlnamen, kennzahlspalten);
+
+            printf("S10migration: %zu Tagestabellen mit %zu Threads\n", anzahl, threads);
+            struct timespec beginn, ende;
+            clock_gettime(CLOCK_MONOTONIC, &beginn);
+            size_t gestartet = 0;
+            for (; gestartet < threads; gestartet++)
+                if (0 != pthread_create(thread + gestartet, NULL, MigrationsThread, &migration)) break;
+            /* ohne einen einzigen Thread überträgt der Haupt-Thread selbst */
+            if (0 == gestartet) MigrationsThread(&migration);
+            for (size_t i = 0; i < gestartet; i++)
+                pthread_join(thread[i], NULL);
+            clock_gettime(CLOCK_MONOTONIC, &ende);
+
+            double const dauer = (ende.tv_sec - beginn.tv_sec) + (ende.tv_nsec - beginn.tv_nsec) / 1e9;
+            uint64_t const zeilen = atomic_load(&migration.zeilen);
+            size_t const fehler = atomic_load(&migration.fehler);
+            size_t const uebertragen = atomic_load(&migration.fertig) - fehler;
+            printf("S10migration: %zu von %zu Tagestabellen, %" PRIu64 " Zeilen in %.1f s, %.0f Zeilen/s\n", uebertragen, anzahl, zeilen, dauer,
+                   dauer > 0 ? zeilen / dauer : 0.0);
+            if (uebertragen != anzahl) result = EXIT_FAILURE;
+        }
+        else
+            result = EXIT_FAILURE;
+        free(thread);
+        free(kennzahlspalten);
+    }
+    free(tabellen);
+    return result;
+}
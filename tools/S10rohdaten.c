@@ -0,0 +1,142 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * S10rohdaten dekodiert eine Rohdatei (ROH_VERZEICHNIS) mit der aktuellen Registerkarte, z.B. nachdem die Wortfolge oder das Vorzeichen
+ * eines Felds in der Registerkarte korrigiert wurde.
+ * 1) plant die Registerkarte und dekodiert alle Sekunden der Datei blockweise mit RohDekodieren().
+ * 2) gibt die Sekunden als CSV mit den Feldern von s10daten und den zusätzlichen Registern aus, oder hängt sie mit -a an das Archiv
+ *    der Anlage an. Bereits archivierte Sekunden bleiben dabei unverändert, für eine Korrektur wird die Archivdatei vorher entfernt.
+ * S10auslesen.c wird wie beim S10benchmark direkt eingebunden.
+ *
+ * Aufruf: S10rohdaten [-a Name] Rohdatei
+ *   -a in das Archiv (ARCHIV_VERZEICHNIS) der Anlage mit diesem Namen ("" = S10_ADRESSE) statt als CSV ausgeben
+ */
+
+#include <unistd.h> /* für getopt */
+
+#define main S10auslesen
+#include "../src/S10auslesen.c"
+#undef main
+
+/**
+ * gibt die dekodierten Sekunden als CSV auf stdout aus.
+ * @param tag 00:00:00 Uhr des Tages als Sekunden seit 1.1.1970 (UTC).
+ * @param daten Messwerte aller Sekunden des Tages.
+ * @param zusatz Werte der zusätzlichen Register aller Sekunden des Tages.
+ * @param gueltig Gültigkeit der Sekunden.
+ */
+static void CSVAusgeben(time_t const tag, s10daten const *const daten, int32_t const *const zusatz, s10gueltig const *const gueltig)
+{
+    printf("zeit");
+    for (size_t i = 0; i < leistungsfelder + zusatzregister; i++)
+        printf(";%s", registerkarte[i].name);
+    printf("\n");
+
+    for (size_t sekunde = GueltigSuchen(gueltig, 0, ARCHIV_SEKUNDEN); sekunde < ARCHIV_SEKUNDEN;
+         sekunde = GueltigSuchen(gueltig, sekunde + 1, ARCHIV_SEKUNDEN))
+    {
+        char zeit[24];
+        time_t const t = tag + sekunde;
+        struct tm tm;
+        strftime(zeit, sizeof(zeit), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+        printf("%s", zeit);
+        for (size_t i = 0; i < leistungsfelder; i++)
+            printf(";%" PRId64, ArchivFeldLesen(daten + sekunde, archivspalten + i));
+        for (size_t i = 0; i < zusatzregister; i++)
+        {
+            int32_t const wert = zusatz[sekunde * zusatzregister + i];
+            int32_t const skala = registerkarte[leistungsfelder + i].skala;
+            if (1 == skala)
+                printf(";%" PRId32, wert);
+            else
+                printf(";%g", (double) wert / skala);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * 1) dekodiert die Rohdatei mit der aktuellen Registerkarte.
+ * 2) gibt die Sekunden als CSV aus oder hängt sie an das Archiv an.
+ * @return EXIT_SUCCESS wenn die Datei dekodiert und ausgegeben wurde, sonst EXIT_FAILURE.
+ */
+int main(int argc, char *argv[])
+{
+    char const *archiv = NULL;
+    for (int option; -1 != (option = getopt(argc, argv, "a:"));)
+    {
+        switch (option)
+        {
+            case 'a': archiv = optarg; break;
+            default:
+                fprintf(stderr, "Aufruf: %s [-a Name] Rohdatei\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Aufruf: %s [-a Name] Rohdatei\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (NULL != archiv && !ARCHIV_AKTIV)
+    {
+        fprintf(stderr, "S10rohdaten: ohne ARCHIV_VERZEICHNIS kann nicht archiviert werden\n");
+        return EXIT_FAILURE;
+    }
+
+    /* 1) */
+    s10rohdatei datei;
+    if (EXIT_SUCCESS != RegisterPlanen()) return EXIT_FAILURE;
+    if (!RohVerbinden(argv[optind], &datei))
+    {
+        fprintf(stderr, "S10rohdaten: %s ist keine Rohdatei\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    s10daten *const daten = (s10daten*) calloc(ARCHIV_SEKUNDEN, sizeof(s10daten));
+    int32_t *const zusatz = (int32_t*) calloc(ARCHIV_SEKUNDEN * zusatzregister + 1, sizeof(int32_t));
+    s10gueltig *const gueltig = (s10gueltig*) calloc(GUELTIG_WORTE(ARCHIV_SEKUNDEN), sizeof(s10gueltig));
+    int_fast8_t result = EXIT_FAILURE;
+    if (NULL == daten || NULL == zusatz || NULL == gueltig)
+        fprintf(stderr, "S10rohdaten: kein Speicher verfügbar\n");
+    else
+    {
+        size_t const sekunden = RohDekodieren(&datei, daten, zusatz, gueltig);
+        time_t const tag = datei.kopf->tag;
+
+        /* 2) */
+        if (NULL == archiv)
+        {
+            CSVAusgeben(tag, daten, zusatz, gueltig);
+            result = EXIT_SUCCESS;
+        }
+        else
+        {
+            s10konstanten id;
+            RohIdentifikation(&datei, &id);
+            result = ArchivAnhaengen(archiv, &id, tag, daten, gueltig, 0, ARCHIV_SEKUNDEN);
+            fprintf(stderr, "S10rohdaten: %zu Sekunden %s\n", sekunden, EXIT_SUCCESS == result ? "archiviert" : "nicht archiviert");
+        }
+    }
+    free(gueltig);
+    free(zusatz);
+    free(daten);
+    RohTrennen(&datei);
+    return result;
+}
@@ -0,0 +1,285 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * S10auslesen makes the current reading of a E3/DC S10 available for processing *
+ * Copyright (C) 2018-2022 - senneschall <senneschall@web.de>                    *
+ * This file is part of S10auslesen.                                             *
+ *                                                                               *
+ * S10auslesen is free software: you can redistribute it and/or modify           *
+ * it under the terms of the GNU Affero General Public License as                *
+ * published by the Free Software Foundation, either version 3 of the            *
+ * License, or (at your option) any later version.                               *
+ *                                                                               *
+ * S10auslesen is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of                *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 *
+ * GNU Affero General Public License for more details.                           *
+ *                                                                               *
+ * You should have received a copy of the GNU Affero General Public License      *
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.        *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * S10simulator stellt ein S10 Hauskraftwerk als lokalen Modbus/TCP-Server nach, damit S10auslesen ohne echte Anlage getestet und
+ * vermessen werden kann. Die Registerbelegung entspricht der des S10: die Identifikationsdaten in den Registern 0 bis
+ * IDENTIFIKREGISTER-1, die Leistungswerte (Aufbau wie s10daten) in den folgenden LEISTUNGSREGISTER Registern.
+ * Die Leistungswerte folgen einem einfachen Tagesverlauf aus PV-Erzeugung, Hausverbrauch, Batterie und Netz.
+ *
+ * Aufruf: S10simulator [-a Adresse] [-p Port] [-l Latenz ms] [-j Streuung ms] [-d Aussetzer %] [-u alle:Dauer s] [-z Zeitraffer] [-t Uhrzeit h]
+ *   -a Adresse, an die der Server gebunden wird (127.0.0.1)
+ *   -p Modbus-Port (1502, für 502 werden root-Rechte benötigt)
+ *   -l feste Antwortverzögerung in Millisekunden
+ *   -j zusätzliche zufällige Antwortverzögerung von 0 bis zu so vielen Millisekunden
+ *   -d so viel Prozent der Anfragen bleiben unbeantwortet
+ *   -u alle so viele Sekunden fällt der Server für die angegebene Dauer komplett aus, z.B. -u 300:10
+ *   -z der simulierte Tag läuft so viel mal schneller ab als die Uhr
+ *   -t simulierte Uhrzeit beim Start in Stunden (sonst die aktuelle Uhrzeit)
+ */
+
+#include "../src/Einstellungen.h" /* für die Registeranzahl */
+#include "../src/S10daten.h" /* für den Aufbau der Leistungsregister */
+
+#include <modbus/modbus-tcp.h> /* für den Modbus-Server */
+
+#include <errno.h> /* für errno */
+#include <math.h> /* für sin */
+#include <stdbool.h> /* für bool */
+#include <stddef.h> /* für offsetof */
+#include <stdio.h> /* für Meldungen und snprintf */
+#include <stdlib.h> /* für atoi und rand */
+#include <string.h> /* für memcpy */
+#include <sys/select.h> /* für select */
+#include <sys/socket.h> /* für accept */
+#include <time.h> /* für clock_gettime */
+#include <unistd.h> /* für close und getopt */
+
+/* so viele Clients können gleichzeitig verbunden sein */
+#define SIM_CLIENTS         16
+/* Leistung der PV-Anlage zur Mittagszeit in W */
+#define SIM_PV_MAX          8000
+/* Kapazität der Batterie in Wh */
+#define SIM_KAPAZITAET      10000
+/* höchste Lade- bzw. Entladeleistung der Batterie in W */
+#define SIM_BAT_MAX         3000
+
+/* schreibt einen Wert in das Leistungsregister des gleichnamigen Felds von s10daten */
+#define SETZEN(werte, feld, wert)                                                   \
+    do                                                                              \
+    {                                                                               \
+        __typeof__(((s10daten*) 0)->feld) const w = (wert);                         \
+        memcpy((unsigned char*) (werte) + offsetof(s10daten, feld), &w, sizeof(w)); \
+    } while (0)
+
+/**
+ * Zustand der simulierten Anlage.
+ */
+typedef struct
+{
+    double tageszeit; /* simulierte Sekunde des Tages */
+    double energie; /* Ladezustand der Batterie in Wh */
+} simanlage;
+
+/**
+ * liefert die monotone Uhrzeit in Sekunden.
+ * @return Sekunden seit einem beliebigen, festen Zeitpunkt.
+ */
+static double Uhr(void)
+{
+    struct timespec jetzt;
+    clock_gettime(CLOCK_MONOTONIC, &jetzt);
+    return jetzt.tv_sec + jetzt.tv_nsec / 1e9;
+}
+
+/**
+ * schreibt einen String in Identifikationsregister, je zwei Zeichen pro Register mit dem ersten Zeichen im höherwertigen Byte.
+ * @param werte erstes Register des Strings.
+ * @param text der String, höchstens 31 Zeichen, das letzte Register endet immer mit einer 0.
+ */
+static void StringSetzen(uint16_t *const werte, char const *const text)
+{
+    char puffer[32] = { 0 };
+    snprintf(puffer, sizeof(puffer), "%s", text);
+    for (size_t i = 0; i < sizeof(puffer) / 2; i++)
+        werte[i] = (uint16_t) ((unsigned char) puffer[2 * i] << 8 | (unsigned char) puffer[2 * i + 1]);
+}
+
+/**
+ * füllt die Identifikationsregister.
+ * @param werte die IDENTIFIKREGISTER Register ab Register 0.
+ */
+static void IdentifikationSetzen(uint16_t *const werte)
+{
+    werte[0] = 0xE3DC; /* magic */
+    werte[1] = 2 << 8 | 0; /* Modbus-Version 2.0, mb_minor im niederwertigen Byte */
+    werte[2] = IDENTIFIKREGISTER + LEISTUNGSREGISTER;
+    StringSetzen(werte + 3, "E3/DC GmbH");
+    StringSetzen(werte + 19, "S10 Simulator");
+    StringSetzen(werte + 35, "SIM-0000001");
+    StringSetzen(werte + 51, "S10_SIM_1");
+}
+
+/**
+ * schreibt die Leistungswerte der simulierten Anlage für den aktuellen Zeitpunkt.
+ * @param werte die LEISTUNGSREGISTER Register ab IDENTIFIKREGISTER.
+ * @param anlage Zustand der simulierten Anlage.
+ * @param dauer so viele simulierte Sekunden sind seit dem letzten Aufruf vergangen.
+ */
+static void LeistungSetzen(uint16_t *const werte, simanlage *const anlage, double const dauer)
+{
+    anlage->tageszeit = fmod(anlage->tageszeit + dauer, 86400);
+    double const t = anlage->tageszeit;
+    double const stunde = t / 3600;
+
+    /* PV zwischen 6 und 20 Uhr mit durchziehenden Wolken, Haus mit Grundlast und Kochspitze zur Mittagszeit */
+    double pv = stunde > 6 && stunde < 20 ? SIM_PV_MAX * sin(M_PI * (stunde - 6) / 14) * (0.8 + 0.2 * sin(t / 97)) : 0;
+    pv *= 0.98 + 0.04 * rand() / RAND_MAX;
+    double const haus = 350 + 150 * sin(t / 600) + (stunde >= 12 && stunde < 12.5 ? 2000 : 0) + 20.0 * rand() / RAND_MAX;
+
+    /* der Überschuss geht in die Batterie, solange sie nicht voll ist, ein Defizit wird aus ihr gedeckt, solange sie nicht leer ist */
+    double bat = pv - haus;
+    if (bat > SIM_BAT_MAX) bat = SIM_BAT_MAX;
+    if (bat < -SIM_BAT_MAX) bat = -SIM_BAT_MAX;
+    if ((bat > 0 && anlage->energie >= SIM_KAPAZITAET) || (bat < 0 && anlage->energie <= SIM_KAPAZITAET * 0.05)) bat = 0;
+    anlage->energie += bat * dauer / 3600;
+    double const netz = haus - pv + bat; /* positiv = Bezug */
+
+    double const einspeisung = netz < 0 ? -netz : 0;
+    double const bezug = netz > 0 ? netz : 0;
+    SETZEN(werte, P_pv, (int32_t) pv);
+    SETZEN(werte, P_bat, (int32_t) bat);
+    SETZEN(werte, P_haus, (int32_t) haus);
+    SETZEN(werte, P_netz, (int32_t) netz);
+    SETZEN(werte, P_ext, 0);
+    SETZEN(werte, P_wall, 0);
+    SETZEN(werte, P_pvwall, 0);
+    SETZEN(werte, eigen, (uint8_t) (pv > 0 ? 100 * (pv - einspeisung) / pv : 0));
+    SETZEN(werte, autarkie, (uint8_t) (100 * (haus - bezug) / haus));
+    SETZEN(werte, soc, (uint16_t) (100 * anlage->energie / SIM_KAPAZITAET));
+    SETZEN(werte, Vdc1, (uint16_t) (pv > 0 ? 620 : 0));
+    SETZEN(werte, Vdc2, (uint16_t) (pv > 0 ? 580 : 0));
+    SETZEN(werte, Pdc1, (uint16_t) (pv * 0.55));
+    SETZEN(werte, Pdc2, (uint16_t) (pv * 0.45));
+    SETZEN(werte, Idc1, (uint16_t) (pv * 0.55 / 620 * 100)); /* in 0,01 A */
+    SETZEN(werte, Idc2, (uint16_t) (pv * 0.45 / 580 * 100));
+}
+
+/**
+ * 1) stellt einen Modbus/TCP-Server mit der Registerbelegung eines S10 bereit.
+ * 2) beantwortet die Anfragen aller Clients mit den Werten des simulierten Zeitpunkts, ggfs. verzögert oder gar nicht.
+ * 3) fällt auf Wunsch regelmäßig komplett aus, um das Neuverbinden von S10auslesen zu prüfen.
+ * @return EXIT_FAILURE wenn der Server nicht gestartet werden konnte.
+ */
+int main(int argc, char *argv[])
+{
+    char const *adresse = "127.0.0.1";
+    int port = 1502, latenz = 0, streuung = 0, aussetzer = 0, ausfallAlle = 0, ausfallDauer = 0;
+    double zeitraffer = 1, startzeit = -1;
+    for (int option; -1 != (option = getopt(argc, argv, "a:p:l:j:d:u:z:t:"));)
+    {
+        switch (option)
+        {
+            case 'a': adresse = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'l': latenz = atoi(optarg); break;
+            case 'j': streuung = atoi(optarg); break;
+            case 'd': aussetzer = atoi(optarg); break;
+            case 'u': if (2 != sscanf(optarg, "%d:%d", &ausfallAlle, &ausfallDauer)) ausfallAlle = 0; break;
+            case 'z': zeitraffer = atof(optarg); break;
+            case 't': startzeit = atof(optarg) * 3600; break;
+            default:
+                fprintf(stderr, "Aufruf: %s [-a Adresse] [-p Port] [-l Latenz ms] [-j Streuung ms] [-d Aussetzer %%] [-u alle:Dauer s] [-z Zeitraffer] "
+                        "[-t Uhrzeit h]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    modbus_t *const modbus = modbus_new_tcp(adresse, port);
+    modbus_mapping_t *const mapping = modbus_mapping_new(0, 0, IDENTIFIKREGISTER + LEISTUNGSREGISTER, 0);
+    if (NULL == modbus || NULL == mapping)
+    {
+        fprintf(stderr, "S10simulator: kein Speicher\n");
+        return EXIT_FAILURE;
+    }
+    IdentifikationSetzen(mapping->tab_registers);
+    simanlage anlage = { startzeit, SIM_KAPAZITAET / 2 };
+    if (startzeit < 0) anlage.tageszeit = time(NULL) % 86400;
+
+    uint8_t *const anfrage = (uint8_t*) malloc(MODBUS_TCP_MAX_ADU_LENGTH);
+    int clients[SIM_CLIENTS];
+    for (size_t i = 0; i < SIM_CLIENTS; i++)
+        clients[i] = -1;
+    int server = -1;
+    double const beginn = Uhr();
+    double zuletzt = beginn;
+    printf("S10simulator: %s:%d, Latenz %d+%d ms, %d %% Aussetzer, Zeitraffer %g\n", adresse, port, latenz, streuung, aussetzer, zeitraffer);
+
+    for (;;)
+    {
+        double const jetzt = Uhr();
+        bool const ausfall = ausfallAlle > 0 && fmod(jetzt - beginn, ausfallAlle) >= ausfallAlle - ausfallDauer;
+        if (ausfall && server >= 0)
+        {
+            /* Ausfall: alle Verbindungen trennen und keine neuen mehr annehmen */
+            printf("S10simulator: Ausfall für %d s\n", ausfallDauer);
+            close(server);
+            server = -1;
+            for (size_t i = 0; i < SIM_CLIENTS; i++)
+                if (clients[i] >= 0)
+                {
+                    close(clients[i]);
+                    clients[i] = -1;
+                }
+        }
+        else if (!ausfall && server < 0)
+        {
+            server = modbus_tcp_listen(modbus, SIM_CLIENTS);
+            if (server < 0)
+            {
+                fprintf(stderr, "S10simulator: Port %d kann nicht geöffnet werden: %s\n", port, modbus_strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+
+        fd_set lesbar;
+        FD_ZERO(&lesbar);
+        int hoechster = server;
+        if (server >= 0) FD_SET(server, &lesbar);
+        for (size_t i = 0; i < SIM_CLIENTS; i++)
+            if (clients[i] >= 0)
+            {
+                FD_SET(clients[i], &lesbar);
+                if (clients[i] > hoechster) hoechster = clients[i];
+            }
+        struct timeval warten = { 0, 100000 };
+        if (select(hoechster + 1, &lesbar, NULL, NULL, &warten) <= 0) continue;
+
+        if (server >= 0 && FD_ISSET(server, &lesbar))
+        {
+            int const client = accept(server, NULL, NULL);
+            size_t i = 0;
+            while (i < SIM_CLIENTS && clients[i] >= 0)
+                i++;
+            if (i < SIM_CLIENTS)
+                clients[i] = client;
+            else if (client >= 0)
+                close(client);
+        }
+        for (size_t i = 0; i < SIM_CLIENTS; i++)
+        {
+            if (clients[i] < 0 || !FD_ISSET(clients[i], &lesbar)) continue;
+            modbus_set_socket(modbus, clients[i]);
+            int const laenge = modbus_receive(modbus, anfrage);
+            if (laenge < 0)
+            {
+                close(clients[i]);
+                clients[i] = -1;
+                continue;
+            }
+            if (0 == laenge || rand() % 100 < aussetzer) continue;
+
+            double const antwort = Uhr();
+            LeistungSetzen(mapping->tab_registers + IDENTIFIKREGISTER, &anlage, (antwort - zuletzt) * zeitraffer);
+            zuletzt = antwort;
+            if (latenz > 0 || streuung > 0) usleep(1000 * (latenz + (streuung > 0 ? rand() % (streuung + 1) : 0)));
+            modbus_reply(modbus, anfrage, laenge, mapping);
+        }
+    }
+}